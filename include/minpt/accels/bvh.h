@@ -1,6 +1,8 @@
 #pragma once
 
+#include <minpt/math/simd.h>
 #include <minpt/core/accelerator.h>
+#include <minpt/accels/triangleblock.h>
 
 namespace minpt {
 
@@ -26,27 +28,197 @@ struct BVHNode {
   { }
 };
 
+/// Bounds, center and primitive index of a triangle, the input of the builders
+struct PrimInfo {
+  Bounds3f bounds;
+  Vector3f center;
+  std::uint32_t index;
+
+  PrimInfo() = default;
+
+  PrimInfo(const Bounds3f& bounds, std::uint32_t index)
+    : bounds(bounds), center(bounds.centroid()), index(index)
+  { }
+};
+
+/**
+ * \brief N-wide BVH node collapsed from the binary SAH tree
+ *
+ * Child bounds are stored SoA (bounds[min/max][axis][child]) so that all
+ * children are tested against a ray with one sequence of SIMD instructions.
+ * Leaves are stored inline: a child with nPrims != 0 refers to a range of
+ * primitives, unused slots have inverted bounds and never pass the test.
+ */
+template <int N>
+struct alignas(sizeof(float) * N) WideBVHNode {
+  float bounds[2][3][N];
+  std::uint32_t children[N];
+  std::uint16_t nPrims[N];
+
+  WideBVHNode() {
+    for (auto i = 0; i < N; ++i) {
+      for (auto axis = 0; axis < 3; ++axis) {
+        bounds[0][axis][i] = std::numeric_limits<float>::infinity();
+        bounds[1][axis][i] = -std::numeric_limits<float>::infinity();
+      }
+      children[i] = 0;
+      nPrims[i] = 0;
+    }
+  }
+
+  void setBounds(int child, const Bounds3f& b) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      bounds[0][axis][child] = b.pMin[axis];
+      bounds[1][axis][child] = b.pMax[axis];
+    }
+  }
+};
+
 class BVHAccel : public Accelerator {
 public:
-  BVHAccel(const PropertyList& props)
-  { }
+  BVHAccel(const PropertyList& props);
 
+  /**
+   * Builds the tree, or loads it from the cache directory when one is set
+   * and holds a tree built from the same geometry with the same builder
+   */
   void build() override;
 
-  std::pair<float, std::uint32_t> statistics(std::uint32_t nodeIndex) const;
+  /**
+   * Recomputes the bounds of all nodes bottom-up for the moved vertices,
+   * the topology of the tree stays. Rebuilds instead when the SAH cost of
+   * the refitted tree exceeds rebuildThreshold times the cost of the last
+   * build
+   */
+  void refit() override;
 
-  void compactNodes(std::uint32_t nodeIndex, std::vector<BVHNode>& packedNodes) const;
+  std::pair<float, std::uint32_t> statistics(std::uint32_t nodeIndex) const;
 
   bool intersect(const Ray& ray, Interaction& isect) const override;
 
   bool intersect(const Ray& ray) const override;
 
+  void intersect(RayBatch& rays, HitBatch& hits) const override;
+
+  void occluded(RayBatch& rays, bool* occluded) const override;
+
   std::string toString() const override {
-    return "BVHAccel[]";
+    return tfm::format(
+      "BVHAccel[builder=%s, width=%i, triangleBlocks=%s, cacheDir=%s]",
+      builder == ESAH ? "sah" : tfm::format("lbvh (%i bit codes%s)", mortonBits, restructure ? ", treelets" : ""),
+      width, useTriangleBlocks ? "true" : "false",
+      cacheDir.empty() ? "<none>" : cacheDir
+    );
   }
 
+public:
+  /**
+   * \brief Builders of the binary tree
+   *
+   * The SAH builder gives the best trees for final renders. The LBVH
+   * builder sorts the primitives along a Morton curve and is several times
+   * faster, at a higher SAH cost; for interactive edits of the scene.
+   */
+  enum EBuilder {
+    ESAH = 0,
+    ELBVH
+  };
+
+  static constexpr int TriangleBlockSize = 4;
+  static constexpr int PacketSize = 8;
+  static constexpr std::size_t StreamThreshold = 256;
+  // entries of the binary traversal stacks, wide ones hold N times as many
+  static constexpr int StackSize = 64;
+  // levels of the wide tree refitted in parallel
+  static constexpr int RefitParallelDepth = 3;
+
+private:
+  /// build(), skipping the cache directory unless useCache is set
+  void build(bool useCache);
+
+  /// Build of the binary tree into nodes and indices with the selected builder
+  void buildBinary();
+
+  /// Identifies the builder and its parameters in cache files
+  std::uint32_t builderId() const {
+    return builder == ESAH ? 0u : builder | (std::uint32_t)restructure << 8 | (std::uint32_t)mortonBits << 16;
+  }
+
+  /// Copies the subtree at nodeIndex of the sparse build array to nodes in depth first order
+  void compactNodes(
+    const BVHNode* sparseNodes, const std::uint32_t* subtreeSizes,
+    std::uint32_t nodeIndex, std::uint32_t packedIndex);
+
+  /// Hash of the triangles of all meshes, of the builder and of its version
+  std::uint64_t hashGeometry() const;
+
+  std::string cacheFileName(std::uint64_t hash) const;
+
+  /// Reads nodes and indices from a cache file, false if it is missing or does not match
+  bool loadCache(const std::string& filename, std::uint64_t hash);
+
+  void saveCache(const std::string& filename, std::uint64_t hash) const;
+
+  template <int N>
+  void collapse(std::vector<WideBVHNode<N>>& wideNodes) const;
+
+  template <int N>
+  bool intersectWide(const std::vector<WideBVHNode<N>>& wideNodes, const Ray& ray, Interaction& isect) const;
+
+  template <int N>
+  bool intersectWide(const std::vector<WideBVHNode<N>>& wideNodes, const Ray& ray) const;
+
+  void buildTriangleBlocks();
+
+  /// SAH cost of the tree in the layout of the current width, after refitting its bounds
+  float refitNodes();
+
+  /// Bounds and SAH cost of the subtree at nodeIndex of the binary tree
+  std::pair<Bounds3f, float> refitBinary(std::uint32_t nodeIndex);
+
+  template <int N>
+  std::pair<Bounds3f, float> refitWide(std::vector<WideBVHNode<N>>& wideNodes, std::uint32_t nodeIndex, int depth);
+
+  /// Bounds of the triangles of a leaf, its triangle blocks take the moved vertices on the way
+  Bounds3f refitLeaf(std::uint32_t primsOffset, std::uint32_t nPrims);
+
+  bool intersectLeaf(
+    std::uint32_t primsOffset, std::uint32_t nPrims,
+    const Ray& ray, const TriangleRay& triRay,
+    Interaction& isect, PrimitiveRef& prim) const;
+
+  bool intersectLeaf(
+    std::uint32_t primsOffset, std::uint32_t nPrims,
+    const Ray& ray, const TriangleRay& triRay) const;
+
+  bool intersectBinary(const Ray& ray, Interaction& isect) const;
+
+  bool intersectBinary(const Ray& ray) const;
+
+  void intersectPacket(RayBatch& rays, std::size_t first, int count, HitBatch* hits, bool* occluded) const;
+
+  void intersectStream(RayBatch& rays, HitBatch* hits, bool* occluded) const;
+
+  void benchmark() const;
+
+  void benchmarkMeshLookup() const;
+
 private:
+  int width;
+  bool runBenchmark;
+  bool useTriangleBlocks;
+  std::string cacheDir;
+  EBuilder builder;
+  bool restructure;
+  int mortonBits;
+  float rebuildThreshold;
+  // SAH cost after the last build, refitted trees are compared to it
+  float builtCost = 0.0f;
   std::vector<BVHNode> nodes;
+  std::vector<PrimitiveRef> prims;
+  std::vector<WideBVHNode<4>> nodes4;
+  std::vector<WideBVHNode<8>> nodes8;
+  std::vector<TriangleBlock<TriangleBlockSize>> triangleBlocks;
 };
 
 }
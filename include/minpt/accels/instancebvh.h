@@ -0,0 +1,53 @@
+#pragma once
+
+#include <minpt/core/instance.h>
+#include <minpt/accels/bvh.h>
+
+namespace minpt {
+
+/**
+ * \brief Top level BVH over the world bounds of instances
+ *
+ * Leaves refer to instances, which carry the ray on into the bottom
+ * level accelerator of their shape group. Only the instances are
+ * referenced, the geometry of a group is never copied.
+ */
+class InstanceBVH {
+public:
+  /// Binned SAH build over the instances, which must refer to their groups already
+  void build(const std::vector<Instance*>& instances);
+
+  bool empty() const {
+    return nodes.empty();
+  }
+
+  const Bounds3f& getBoundingBox() const {
+    return bounds;
+  }
+
+  bool intersect(const Ray& ray) const;
+
+  bool intersect(const Ray& ray, Interaction& isect) const;
+
+public:
+  static constexpr int BinCount = 16;
+  static constexpr std::uint32_t MaxLeafSize = 4;
+  // relative to the cost of an instance, which traverses a whole bottom level tree
+  static constexpr float TraversalCost = 0.125f;
+  // entries of the traversal stacks, an inner node at depth d fills at most d + 2
+  static constexpr int StackSize = 64;
+  static constexpr int MaxDepth = StackSize - 1;
+
+private:
+  /// Splits at the median once a SAH split could take the subtree below MaxDepth
+  std::uint32_t buildRecursive(
+    std::vector<std::uint32_t>& order, std::uint32_t begin, std::uint32_t end,
+    const std::vector<Bounds3f>& instanceBounds, int depth);
+
+private:
+  Bounds3f bounds;
+  std::vector<BVHNode> nodes;
+  std::vector<const Instance*> instances;
+};
+
+}
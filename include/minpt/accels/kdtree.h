@@ -4,11 +4,17 @@
 
 namespace minpt {
 
+/**
+ * \brief Compact 8 byte k-d tree node
+ *
+ * The two low bits of flags hold the split axis, or 3 for leaves, the
+ * remaining bits hold the right child index or the primitive count.
+ * The left child of an interior node directly follows its parent.
+ */
 struct KdTreeNode {
   union {
     float split;
-    std::uint32_t onePrim;
-    std::uint32_t primOffset;
+    std::uint32_t primsOffset;
   };
 
   union {
@@ -22,23 +28,29 @@ struct KdTreeNode {
   // interior node
   KdTreeNode(std::uint32_t rightChild, int axis, float split) {
     this->split = split;
-    flags = 3;
-    this->rightChild = (rightChild << 2) | flags;
+    this->rightChild = (rightChild << 2) | (std::uint32_t)axis;
   }
 
   // leaf node
-  KdTreeNode(std::uint32_t* prims, int nPrims, std::vector<std::uint32_t>& primIndices) {
-    flags = 3;
-    this->nPrims |= (nPrims << 2);
-    if (nPrims == 0)
-      onePrim = 0;
-    else if (nPrims == 1)
-      onePrim = prims[0];
-    else {
-      primOffset = primIndices.size();
-      for (auto i = 0; i < nPrims; ++i)
-        primIndices.push_back(prims[i]);
-    }
+  KdTreeNode(std::uint32_t primsOffset, std::uint32_t nPrims) {
+    this->primsOffset = primsOffset;
+    this->nPrims = (nPrims << 2) | 3;
+  }
+
+  bool isLeaf() const {
+    return (flags & 3) == 3;
+  }
+
+  int getSplitAxis() const {
+    return flags & 3;
+  }
+
+  std::uint32_t getPrimCount() const {
+    return nPrims >> 2;
+  }
+
+  std::uint32_t getRightChild() const {
+    return rightChild >> 2;
   }
 };
 
@@ -48,17 +60,33 @@ public:
 
   void build() override;
 
+  using Accelerator::intersect;
+
+  bool intersect(const Ray& ray, Interaction& isect) const override;
+
+  bool intersect(const Ray& ray) const override;
+
   std::string toString() const override {
     return tfm::format(
       "KdTreeAccel[\n"
-      "  emptyBonus = %f"
+      "  intersectCost = %f,\n"
+      "  traversalCost = %f,\n"
+      "  emptyBonus = %f,\n"
+      "  maxPrims = %i,\n"
+      "  maxDepth = %i\n"
       "]",
-      emptyBonus
+      intersectCost, traversalCost, emptyBonus, maxPrims, maxDepth
     );
   }
 
 private:
+  float intersectCost;
+  float traversalCost;
   float emptyBonus;
+  int maxPrims;
+  int maxDepth;
+  std::vector<KdTreeNode> nodes;
+  std::vector<PrimitiveRef> prims;
 };
 
 }
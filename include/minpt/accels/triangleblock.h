@@ -0,0 +1,124 @@
+#pragma once
+
+#include <minpt/math/simd.h>
+#include <minpt/core/ray.h>
+#include <minpt/core/accelerator.h>
+
+namespace minpt {
+
+/**
+ * \brief K triangles of a BVH leaf stored SoA
+ *
+ * The blocks are emitted in leaf order by the BVH builder so that
+ * intersecting a leaf touches contiguous memory only, the indexed
+ * mesh data is only needed for the final hit. Unused lanes hold NaN
+ * vertices which fail every comparison of the intersection test.
+ */
+template <int K>
+struct alignas(sizeof(float) * K) TriangleBlock {
+  float v[3][3][K];
+  PrimitiveRef prims[K];
+
+  TriangleBlock() {
+    for (auto i = 0; i < K; ++i) {
+      for (auto j = 0; j < 3; ++j)
+        for (auto axis = 0; axis < 3; ++axis)
+          v[j][axis][i] = std::numeric_limits<float>::quiet_NaN();
+      prims[i] = { (std::uint32_t)-1, (std::uint32_t)-1 };
+    }
+  }
+
+  void set(int lane, const PrimitiveRef& prim, const Vector3f& a, const Vector3f& b, const Vector3f& c) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      v[0][axis][lane] = a[axis];
+      v[1][axis][lane] = b[axis];
+      v[2][axis][lane] = c[axis];
+    }
+    prims[lane] = prim;
+  }
+};
+
+/**
+ * \brief Per-ray data of the watertight ray/triangle test
+ *
+ * ref http://jcgt.org/published/0002/01/05/paper.pdf
+ */
+struct TriangleRay {
+  TriangleRay() = default;
+
+  explicit TriangleRay(const Ray& ray) noexcept {
+    auto d = abs(ray.d);
+    kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    kx = kz == 2 ? 0 : kz + 1;
+    ky = kx == 2 ? 0 : kx + 1;
+    // preserve winding direction of the triangles
+    if (ray.d[kz] < 0) std::swap(kx, ky);
+    sx = ray.d[kx] / ray.d[kz];
+    sy = ray.d[ky] / ray.d[kz];
+    sz = 1.0f / ray.d[kz];
+    o = Vector3f(ray.o[kx], ray.o[ky], ray.o[kz]);
+  }
+
+  int kx, ky, kz;
+  float sx, sy, sz;
+  Vector3f o;
+};
+
+/**
+ * Intersect all triangles of a block at once, returns the bit mask of the
+ * lanes hit in (0, tMax], the hit distance and barycentrics are written
+ * to t, u and v.
+ */
+template <int K>
+int intersectTriangles(
+    const TriangleBlock<K>& block, const TriangleRay& ray, float tMax,
+    FloatN<K>& t, FloatN<K>& u, FloatN<K>& v) {
+
+  using FloatK = FloatN<K>;
+
+  FloatK ox(ray.o.x), oy(ray.o.y), oz(ray.o.z);
+  FloatK sx(ray.sx), sy(ray.sy), sz(ray.sz);
+
+  // translate and shear the vertices into ray space
+  auto az = FloatK::load(block.v[0][ray.kz]) - oz;
+  auto bz = FloatK::load(block.v[1][ray.kz]) - oz;
+  auto cz = FloatK::load(block.v[2][ray.kz]) - oz;
+  auto ax = FloatK::load(block.v[0][ray.kx]) - ox - sx * az;
+  auto ay = FloatK::load(block.v[0][ray.ky]) - oy - sy * az;
+  auto bx = FloatK::load(block.v[1][ray.kx]) - ox - sx * bz;
+  auto by = FloatK::load(block.v[1][ray.ky]) - oy - sy * bz;
+  auto cx = FloatK::load(block.v[2][ray.kx]) - ox - sx * cz;
+  auto cy = FloatK::load(block.v[2][ray.ky]) - oy - sy * cz;
+
+  // scaled barycentrics, the edge functions are evaluated identically for
+  // triangles sharing an edge so that no ray slips through between them
+  auto e0 = cx * by - cy * bx;
+  auto e1 = ax * cy - ay * cx;
+  auto e2 = bx * ay - by * ax;
+
+  FloatK zero(0.0f);
+  auto mask =
+    ~(movemask((e0 < zero) | (e1 < zero) | (e2 < zero)) &
+      movemask((e0 > zero) | (e1 > zero) | (e2 > zero)));
+
+  auto det = e0 + e1 + e2;
+  auto absDet = abs(det);
+  mask &= movemask(absDet > zero);
+  if (!(mask & ((1 << K) - 1))) return 0;
+
+  // scaled hit distance, compared without dividing by det
+  auto tScaled = e0 * (sz * az) + e1 * (sz * bz) + e2 * (sz * cz);
+  tScaled = tScaled ^ (det & FloatK(-0.0f));
+  mask &= movemask((tScaled > zero) & (tScaled <= absDet * FloatK(tMax)));
+  mask &= (1 << K) - 1;
+  if (!mask) return 0;
+
+  auto detInv = FloatK(1.0f) / det;
+  t = tScaled / absDet;
+  u = e1 * detInv;
+  v = e2 * detInv;
+
+  return mask;
+}
+
+}
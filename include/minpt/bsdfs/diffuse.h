@@ -62,6 +62,10 @@ public:
     return albedo->eval(bRec.uv);
   }
 
+  Spectrum getAlbedo(const Vector2f& uv) const override {
+    return albedo->eval(uv);
+  }
+
   std::string toString() const override {
     return tfm::format(
       "Diffuse[\n"
@@ -32,6 +32,10 @@ public:
     return kr * frConductor(absCosTheta(bRec.wi), eta, k);
   }
 
+  Spectrum getAlbedo(const Vector2f& uv) const override {
+    return kr;
+  }
+
   std::string toString() const override {
     return tfm::format(
       "Metal[\n"
@@ -27,6 +27,10 @@ public:
     return kr;
   }
 
+  Spectrum getAlbedo(const Vector2f& uv) const override {
+    return kr;
+  }
+
   std::string toString() const override {
     return tfm::format("Mirror[kr = %s]", kr.toString());
   }
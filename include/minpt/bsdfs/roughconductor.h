@@ -16,6 +16,10 @@ public:
 
   Spectrum sample(BSDFQueryRecord& bRec, const Vector2f& u, float& pdf) const override;
 
+  Spectrum getAlbedo(const Vector2f& uv) const override {
+    return kr;
+  }
+
   std::string toString() const override;
 
 private:
@@ -15,6 +15,10 @@ public:
 
   Spectrum sample(BSDFQueryRecord& bRec, const Vector2f& u, float& pdf) const override;
 
+  Spectrum getAlbedo(const Vector2f& uv) const override {
+    return kt;
+  }
+
   std::string toString() const override;
 
 public:
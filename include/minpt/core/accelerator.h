@@ -3,9 +3,21 @@
 #include <vector>
 #include <minpt/core/mesh.h>
 #include <minpt/core/object.h>
+#include <minpt/core/raybatch.h>
 
 namespace minpt {
 
+/**
+ * \brief Triangle referenced by its mesh and its index inside the mesh
+ *
+ * Resolved once at build time so that traversal never has to search
+ * primOffset for the mesh owning a global primitive index.
+ */
+struct PrimitiveRef {
+  std::uint32_t meshIndex;
+  std::uint32_t triIndex;
+};
+
 class Accelerator : public Object {
 public:
   Accelerator() noexcept {
@@ -18,6 +30,7 @@ public:
   };
 
   void addMesh(Mesh* mesh) {
+    mesh->index = (int)meshes.size();
     meshes.push_back(mesh);
     bounds.merge(mesh->bounds);
     primOffset.push_back(primOffset.back() + mesh->getPrimitiveCount());
@@ -37,16 +50,53 @@ public:
     return meshes[itr - primOffset.begin()];
   }
 
+  PrimitiveRef findPrimitive(std::uint32_t index) const {
+    auto itr = std::lower_bound(primOffset.begin(), primOffset.end(), index + 1) - 1;
+    return { (std::uint32_t)(itr - primOffset.begin()), index - *itr };
+  }
+
   virtual void build() = 0;
 
+  /**
+   * Follows the meshes after their vertices moved, their triangles must
+   * stay the same. Rebuilds from scratch unless the accelerator can refit
+   */
+  virtual void refit() {
+    updateBounds();
+    build();
+  }
+
   virtual bool intersect(const Ray& ray) const = 0;
 
   virtual bool intersect(const Ray& ray, Interaction& isect) const = 0;
 
+  /// Closest hits of a batch of rays, traces the rays one by one by default
+  virtual void intersect(RayBatch& rays, HitBatch& hits) const {
+    hits.resize(rays.size());
+    for (std::size_t i = 0, n = rays.size(); i < n; ++i) {
+      auto ray = rays.get(i);
+      hits.hit[i] = intersect(ray, hits.isects[i]);
+      rays.tMax[i] = ray.tMax;
+    }
+  }
+
+  /// Any hit test of a batch of rays, occluded holds one entry per ray
+  virtual void occluded(RayBatch& rays, bool* occluded) const {
+    for (std::size_t i = 0, n = rays.size(); i < n; ++i)
+      occluded[i] = intersect(rays.get(i));
+  }
+
   EClassType getClassType() const override {
     return EAccel;
   }
 
+protected:
+  void updateBounds() {
+    bounds.reset();
+    for (auto mesh : meshes)
+      bounds.merge(mesh->bounds);
+  }
+
 protected:
   Bounds3f bounds;
   std::vector<Mesh*> meshes;
@@ -1,6 +1,9 @@
 #pragma once
 
-#include <tbb/mutex.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include <minpt/core/spectrum.h>
 #include <minpt/core/filter.h>
 #include <minpt/utils/bitmap.h>
@@ -19,6 +22,35 @@ public:
 
   void clear() {
     setConstant(Color4f());
+    std::fill(channelData.begin(), channelData.end(), 0.0f);
+    std::fill(nearestDistances.begin(), nearestDistances.end(), Infinity);
+  }
+
+  /**
+   * Adds channels filtered with the same weights as the radiance, like the
+   * AOVs, names follow the layers of Bitmap. Clears their values.
+   *
+   * The last unfiltered channels are not filtered, a pixel keeps their
+   * values from the sample nearest to its center. Meant for values that
+   * do not average, like ids.
+   */
+  void setChannels(const std::vector<std::string>& names, int unfiltered = 0) {
+    channelNames = names;
+    unfilteredCount = unfiltered;
+    channelData.assign((std::size_t)rows() * cols() * names.size(), 0.0f);
+    nearestDistances.assign(unfiltered > 0 ? (std::size_t)rows() * cols() : 0, Infinity);
+  }
+
+  const std::vector<std::string>& getChannelNames() const {
+    return channelNames;
+  }
+
+  int getChannelCount() const {
+    return (int)channelNames.size();
+  }
+
+  int getUnfilteredCount() const {
+    return unfilteredCount;
   }
 
   void fromBitmap(const Bitmap& bitmap) {
@@ -34,20 +66,56 @@ public:
     for (auto y = 0; y < size.y; ++y)
       for (auto x = 0; x < size.x; ++x)
         result(y, x) = coeff(y + borderSize, x + borderSize).eval();
+    auto nChannels = channelNames.size();
+    auto nFiltered = nChannels - unfilteredCount;
+    for (std::size_t c = 0; c < nChannels; ++c) {
+      auto& channel = result.addChannel(channelNames[c]);
+      for (auto y = 0; y < size.y; ++y)
+        for (auto x = 0; x < size.x; ++x) {
+          auto weight = coeff(y + borderSize, x + borderSize)[3];
+          auto value = channelData[((std::size_t)(y + borderSize) * cols() + x + borderSize) * nChannels + c];
+          channel(y, x) = c >= nFiltered ? value : weight != 0.0f ? value / weight : 0.0f;
+        }
+    }
     return result;
   }
 
-  void put(const Vector2f& pos, const Spectrum& value);
+  /// Splats a sample, channels holds getChannelCount() values if not null
+  void put(const Vector2f& pos, const Spectrum& value, const float* channels = nullptr);
 
-  void put(const ImageBlock& block);
-
-  void lock() const {
-    mutex.lock();
+private:
+  /// Keeps the unfiltered channels of a sample at squared distance dist2 from the pixel center if it is the nearest
+  void putUnfiltered(std::size_t pixel, float dist2, const float* channels) {
+    if (dist2 >= nearestDistances[pixel]) return;
+    nearestDistances[pixel] = dist2;
+    auto nChannels = channelNames.size();
+    auto nFiltered = nChannels - unfilteredCount;
+    std::copy(channels + nFiltered, channels + nChannels, &channelData[pixel * nChannels + nFiltered]);
   }
 
-  void unlock() const {
-    mutex.unlock();
-  }
+public:
+
+  /**
+   * Adds a rendered block, including its border. Takes no lock, blocks
+   * merged concurrently must not overlap.
+   */
+  void put(const ImageBlock& block);
+
+  /**
+   * \brief Relative error of the pixels in the given area
+   *
+   * half holds every second sample of this image, the error of a pixel is
+   * the difference between the estimates of the two halves relative to the
+   * square root of its value. Returns the largest pixel error of the area.
+   */
+  float estimateError(const ImageBlock& half, const Vector2i& offset, const Vector2i& size) const;
+
+  /**
+   * Variance of the estimate of every pixel, from the difference between
+   * the two halves of its samples like estimateError(), averaged over the
+   * color channels
+   */
+  Bitmap::Channel estimateVariance(const ImageBlock& half) const;
 
   std::string toString() const {
     return tfm::format(
@@ -63,12 +131,57 @@ public:
   Vector2i size;
 
 private:
-  mutable tbb::mutex mutex;
+  // resolution of the tabulated filter, over the radius
+  static constexpr int FilterResolution = 64;
+
   float filterRadius;
   float lookupFactor;
+  bool isBox = false;
   float* filters = nullptr;
   float* weightsX = nullptr;
   float* weightsY = nullptr;
+  std::vector<std::string> channelNames;
+  int unfilteredCount = 0;
+  // weighted sums of the extra channels, interleaved per pixel, the unfiltered ones last
+  std::vector<float> channelData;
+  // squared distance of the sample the unfiltered channels of each pixel come from
+  std::vector<float> nearestDistances;
+};
+
+/**
+ * \brief Lock free triple buffer of the pixels of an image
+ *
+ * The renderer publishes copies of its film while the display thread
+ * keeps reading the newest complete copy, neither ever waits for the other.
+ */
+class ImageSnapshot {
+public:
+  explicit ImageSnapshot(const Vector2i& size) : size(size) {
+    for (auto& buffer : buffers)
+      buffer.resize((std::size_t)size.x * size.y);
+  }
+
+  /// Copies the pixels of block, without its border, and makes them the newest snapshot
+  void publish(const ImageBlock& block);
+
+  /// Newest published snapshot, size.x * size.y pixels valid until the next call
+  const Color4f* acquire() {
+    if (middle.load(std::memory_order_relaxed) & Fresh)
+      front = middle.exchange(front, std::memory_order_acq_rel) & ~Fresh;
+    return buffers[front].data();
+  }
+
+public:
+  Vector2i size;
+
+private:
+  static constexpr int Fresh = 4;
+
+  std::vector<Color4f> buffers[3];
+  int back = 0;
+  int front = 1;
+  // index of the buffer between writer and reader, Fresh if not read yet
+  std::atomic<int> middle { 2 };
 };
 
 class BlockGenerator {
@@ -78,35 +191,34 @@ public:
       , size(size)
       , nBlocks(
         (size.x + blockSize - 1) / blockSize,
-        (size.y + blockSize - 1) / blockSize) {
-    blocksLeft = nBlocks.x * nBlocks.y;
-  }
+        (size.y + blockSize - 1) / blockSize)
+  { }
 
   int getBlockCount() const {
-    return blocksLeft;
+    return nBlocks.x * nBlocks.y;
   }
 
-  bool next(ImageBlock& block) {
-    tbb::mutex::scoped_lock lock(mutex);
-
-    if (!blocksLeft)
-      return false;
+  /**
+   * Splits blocks by the color of their tile on a 2x2 checkerboard. Blocks
+   * of one color never overlap, borders included, so they can be merged
+   * into an image concurrently without locking.
+   */
+  void splitCheckerboard(const std::vector<int>& blocks, std::vector<int> (&colors)[4]) const {
+    for (auto index : blocks)
+      colors[(index / nBlocks.x % 2) * 2 + index % nBlocks.x % 2].push_back(index);
+  }
 
-    auto blockIndex = nBlocks.x * nBlocks.y - blocksLeft;
+  /// Offset and size of the block with the given index, blocks are numbered row by row
+  void getBlock(int blockIndex, Vector2i& offset, Vector2i& size) const {
     Vector2i tile(blockIndex % nBlocks.x, blockIndex / nBlocks.x);
-    block.offset = tile * blockSize;
-    block.size = min(size - block.offset, Vector2i(blockSize));
-    --blocksLeft;
-
-    return true;
+    offset = tile * blockSize;
+    size = min(this->size - offset, Vector2i(blockSize));
   }
 
 private:
   int blockSize;
-  int blocksLeft;
   Vector2i size;
   Vector2i nBlocks;
-  tbb::mutex mutex;
 };
 
 }
@@ -35,6 +35,11 @@ public:
 
   virtual Spectrum sample(BSDFQueryRecord& bRec, const Vector2f& u, float& pdf) const = 0;
 
+  /// Reflectance or transmittance color at uv, written to the albedo AOV
+  virtual Spectrum getAlbedo(const Vector2f& uv) const {
+    return Spectrum(1.0f);
+  }
+
   EClassType getClassType() const override {
     return EBSDF;
   }
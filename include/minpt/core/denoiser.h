@@ -0,0 +1,60 @@
+#pragma once
+
+#include <minpt/utils/bitmap.h>
+
+namespace minpt {
+
+/**
+ * \brief Feature guided cross bilateral filter
+ *
+ * Denoises a rendered image with the help of its AOVs. The weight of a
+ * neighbour falls off with its screen distance, with the difference of its
+ * albedo, shading normal and relative depth, and with its color difference
+ * relative to the variance of both pixels. The albedo is divided out
+ * before filtering so that texture detail is kept.
+ *
+ * Runs on the CPU only, over tiles in parallel, the neighbours of a pixel
+ * are weighted in packets of 8.
+ */
+class Denoiser {
+public:
+  struct Parameters {
+    // the window has 2 * radius + 1 pixels on each side
+    int radius = 8;
+    float sigmaSpatial = 4.0f;
+    // color differences are relative to the standard deviation of the noise
+    float sigmaColor = 1.0f;
+    float sigmaAlbedo = 0.1f;
+    float sigmaNormal = 0.2f;
+    // depth differences are relative to the depth
+    float sigmaDepth = 0.05f;
+  };
+
+  Denoiser() = default;
+
+  explicit Denoiser(const Parameters& params) : params(params)
+  { }
+
+  /**
+   * Denoises image, which must hold the AOV layers of the integrators.
+   * variance holds the variance of the estimate of every pixel, as given
+   * by ImageBlock::estimateVariance(). The result has no extra channels.
+   */
+  Bitmap denoise(const Bitmap& image, const Bitmap::Channel& variance) const;
+
+  /// Relative mean squared error of image against reference
+  static double relMSE(const Bitmap& image, const Bitmap& reference);
+
+  std::string toString() const {
+    return tfm::format(
+      "Denoiser[radius=%i, sigmaSpatial=%f, sigmaColor=%f, sigmaAlbedo=%f, sigmaNormal=%f, sigmaDepth=%f]",
+      params.radius, params.sigmaSpatial, params.sigmaColor,
+      params.sigmaAlbedo, params.sigmaNormal, params.sigmaDepth
+    );
+  }
+
+private:
+  Parameters params;
+};
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <minpt/core/accelerator.h>
+
+namespace minpt {
+
+/**
+ * \brief Named group of meshes shared by instances
+ *
+ * The meshes of a group stay in object space and get their own bottom
+ * level accelerator, "bvh" by default, built with the properties of the
+ * group. A group is only rendered through the instances referring to it,
+ * so its memory is paid once however many times it is placed.
+ */
+class ShapeGroup : public Object {
+public:
+  ShapeGroup(const PropertyList& props);
+
+  ~ShapeGroup() {
+    delete accel;
+  }
+
+  void addChild(Object* child) override;
+
+  void activate() override;
+
+  const Bounds3f& getBoundingBox() const {
+    return accel->getBoundingBox();
+  }
+
+  std::uint32_t getPrimitiveCount() const {
+    return accel->getPrimitiveCount();
+  }
+
+  bool intersect(const Ray& ray) const {
+    return accel->intersect(ray);
+  }
+
+  bool intersect(const Ray& ray, Interaction& isect) const {
+    return accel->intersect(ray, isect);
+  }
+
+  EClassType getClassType() const override {
+    return EShapeGroup;
+  }
+
+  std::string toString() const override;
+
+private:
+  Accelerator* accel;
+  std::uint32_t nMeshes = 0;
+};
+
+/**
+ * \brief Shape group placed in the scene by a transform
+ *
+ * Rays are transformed into the space of the group instead of the
+ * geometry into world space. The direction is not normalized so that
+ * distances along the ray are the same in both spaces.
+ */
+class Instance : public Object {
+public:
+  Instance(const PropertyList& props);
+
+  /// Refers the instance to its group and computes its world bounds
+  void setShapeGroup(const ShapeGroup* group);
+
+  const std::string& getShapeGroupName() const {
+    return groupName;
+  }
+
+  const Bounds3f& getBoundingBox() const {
+    return bounds;
+  }
+
+  bool intersect(const Ray& ray) const {
+    return group->intersect(toLocal(ray));
+  }
+
+  bool intersect(const Ray& ray, Interaction& isect) const {
+    auto localRay = toLocal(ray);
+    if (!group->intersect(localRay, isect))
+      return false;
+
+    // normals transform with the inverse transpose of toWorld
+    ray.tMax = localRay.tMax;
+    isect.p = toWorld.fastApplyP(isect.p);
+    isect.n = normalize(toLocal.applyN(isect.n));
+    isect.shFrame = Frame(normalize(toLocal.applyN(isect.shFrame.n)));
+    isect.wo = -ray.d;
+    return true;
+  }
+
+  EClassType getClassType() const override {
+    return EInstance;
+  }
+
+  std::string toString() const override {
+    return tfm::format(
+      "Instance[\n"
+      "  shapeGroup = \"%s\",\n"
+      "  toWorld = %s\n"
+      "]",
+      groupName, indent(toWorld.toString(), 12)
+    );
+  }
+
+private:
+  std::string groupName;
+  const ShapeGroup* group = nullptr;
+  Matrix4f toWorld;
+  Matrix4f toLocal;
+  Bounds3f bounds;
+};
+
+}
@@ -1,12 +1,37 @@
 #pragma once
 
+#include <vector>
 #include <minpt/core/ray.h>
+#include <minpt/core/raybatch.h>
 #include <minpt/core/sampler.h>
 
 namespace minpt {
 
 class Scene;
 
+/**
+ * Channels of the first hit features written by Integrator::liBatch().
+ * Albedo, normal, position and depth are filtered like the radiance, as
+ * the denoiser expects, so they blend across silhouettes. The mesh index
+ * comes unfiltered from the sample nearest to the pixel center.
+ */
+enum EAOVChannel {
+  EAOVAlbedoR = 0,
+  EAOVAlbedoG,
+  EAOVAlbedoB,
+  EAOVNormalX,
+  EAOVNormalY,
+  EAOVNormalZ,
+  EAOVPositionX,
+  EAOVPositionY,
+  EAOVPositionZ,
+  EAOVDepth,
+  EAOVMeshId,
+  EAOVChannelCount,
+  // the unfiltered channels of ImageBlock::setChannels(), from EAOVMeshId on
+  EAOVUnfilteredCount = EAOVChannelCount - EAOVMeshId
+};
+
 class Integrator : public Object {
 public:
   virtual void preprocess(const Scene& scene)
@@ -14,6 +39,40 @@ public:
 
   virtual Spectrum li(const Ray& ray, const Scene&, Sampler& sampler) const = 0;
 
+  /**
+   * Like li(), for a camera ray whose first intersection was already found
+   * by a batched query, isect is null if the ray left the scene. Traces the
+   * ray again by default.
+   */
+  virtual Spectrum liPrimary(const Ray& ray, const Interaction* isect, const Scene& scene, Sampler& sampler) const {
+    return li(ray, scene, sampler);
+  }
+
+  /**
+   * Radiance of a batch of camera rays written to result, pixels holds the
+   * pixel every ray was sampled for. By default the primary hits are found
+   * with one batched query and shaded one by one with liPrimary(),
+   * integrators working in stages override this. If aovs is not null it
+   * receives EAOVChannelCount channels per ray, see writeAOVs().
+   */
+  virtual void liBatch(
+    RayBatch& rays, const Vector2i* pixels, const Scene& scene, Sampler& sampler,
+    Spectrum* result, float* aovs = nullptr) const;
+
+  /// Called once the image is done, to print integrator specific statistics
+  virtual void printStatistics() const
+  { }
+
+  /// Names of the AOV channels, the layers of the EXR file they are saved to
+  static std::vector<std::string> aovChannelNames();
+
+  /**
+   * First hit features of a camera ray: albedo, shading normal, position,
+   * distance along the ray and mesh index. isect is null if the ray left
+   * the scene, which gives zeros and a mesh index of -1.
+   */
+  static void writeAOVs(const Ray& ray, const Interaction* isect, float* aov);
+
   static float weight(float a, float b) {
     return a / (a + b);
   }
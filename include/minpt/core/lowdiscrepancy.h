@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <minpt/math/math.h>
+
+namespace minpt {
+
+/// Largest float below one, so that samples stay in [0, 1)
+constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+inline std::uint32_t reverseBits(std::uint32_t v) {
+  v = (v << 16) | (v >> 16);
+  v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+  v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+  v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+  v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+  return v;
+}
+
+inline std::uint64_t mixBits(std::uint64_t v) {
+  v ^= v >> 31;
+  v *= 0x7fb5d329728ea185ull;
+  v ^= v >> 27;
+  v *= 0x81dadef4bc2dd44dull;
+  v ^= v >> 33;
+  return v;
+}
+
+/// Hash of a pixel, a dimension and a seed, used to decorrelate pixels and dimensions
+inline std::uint64_t sampleHash(const Vector2i& pixel, int dimension, std::uint64_t seed) {
+  auto h = mixBits(((std::uint64_t)(std::uint32_t)pixel.x << 32) | (std::uint32_t)pixel.y);
+  return mixBits(h ^ mixBits(((std::uint64_t)(std::uint32_t)dimension << 32) ^ seed));
+}
+
+inline float toUnitFloat(std::uint32_t v) {
+  return std::min(v * 0x1p-32f, OneMinusEpsilon);
+}
+
+/// First dimension of the Sobol sequence, the van der Corput sequence
+inline std::uint32_t sobol0(std::uint32_t index) {
+  return reverseBits(index);
+}
+
+/// Second dimension of the Sobol sequence, the direction numbers follow v ^= v >> 1
+inline std::uint32_t sobol1(std::uint32_t index) {
+  std::uint32_t result = 0;
+  for (std::uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    if (index & 1) result ^= v;
+  return result;
+}
+
+/**
+ * Owen scrambling of all the bits of v in one pass, with the hash based
+ * permutation of Burley, "Practical Hash-based Owen Scrambling", 2020
+ */
+inline std::uint32_t owenScramble(std::uint32_t v, std::uint32_t seed) {
+  v = reverseBits(v);
+  v += seed;
+  v ^= v * 0x6c50b47cu;
+  v ^= v * 0xb82f1e52u;
+  v ^= v * 0xc7afe638u;
+  v ^= v * 0x8d22f6e6u;
+  return reverseBits(v);
+}
+
+/**
+ * Element i of a random permutation of [0, n), Kensler, "Correlated
+ * Multi-Jittered Sampling", 2013. Needs no storage for the permutation.
+ */
+inline std::uint32_t permutationElement(std::uint32_t i, std::uint32_t n, std::uint32_t seed) {
+  auto w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do {
+    i ^= seed;
+    i *= 0xe170893d;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3f;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | seed >> 27;
+    i *= 0x6935fa69;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3df;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + seed) % n;
+}
+
+}
@@ -21,6 +21,12 @@ struct LightSample {
  * for querying the individual triangles. Subclasses of \c Mesh implement
  * the specifics of how to create its contents (e.g. by loading from an
  * external file)
+ *
+ * With compact set, activate() trades precision of the shading attributes
+ * for memory: normals are stored in 32 bit octahedral encoding, texture
+ * coordinates as 16 bit fixed point over their bounds and the indices of
+ * meshes with at most 65536 vertices in 16 bits. Positions are kept at
+ * full precision, computeIntersection() decodes the rest on the fly.
  */
 class Mesh : public Object {
 public:
@@ -29,6 +35,8 @@ public:
   void addChild(Object* object) override;
 
   void activate() override {
+    if (compact) compress();
+
     auto nPrims = getPrimitiveCount();
     pdf.reserve(nPrims);
     for (std::uint32_t i = 0; i < nPrims; ++i)
@@ -54,27 +62,34 @@ public:
 
   float getSurfaceArea(std::uint32_t index) const {
     auto offset = 3 * index;
-    auto& a = p[f[offset]];
-    auto& b = p[f[offset + 1]];
-    auto& c = p[f[offset + 2]];
+    auto& a = p[vertexIndex(offset)];
+    auto& b = p[vertexIndex(offset + 1)];
+    auto& c = p[vertexIndex(offset + 2)];
     return cross(b - a, b - c).length() / 2;
   }
 
   Bounds3f getBounds(int index) const {
     auto offset = 3 * index;
-    auto& a = p[f[offset]];
-    auto& b = p[f[offset + 1]];
-    auto& c = p[f[offset + 2]];
+    auto& a = p[vertexIndex(offset)];
+    auto& b = p[vertexIndex(offset + 1)];
+    auto& c = p[vertexIndex(offset + 2)];
     return merge(Bounds3f(min(a, b), max(a, b)), c);
   }
 
+  void getVertices(std::uint32_t index, Vector3f& a, Vector3f& b, Vector3f& c) const {
+    auto offset = 3 * index;
+    a = p[vertexIndex(offset)];
+    b = p[vertexIndex(offset + 1)];
+    c = p[vertexIndex(offset + 2)];
+  }
+
   LightSample sample(Vector2f& u, float& _pdf) const {
     _pdf = totalAreaInv;
     auto index = pdf.sampleReuse(u.x);
     auto uv = uniformSampleTriangle(u);
-    auto& a = p[f[3 * index]];
-    auto& b = p[f[3 * index + 1]];
-    auto& c = p[f[3 * index + 2]];
+    auto& a = p[vertexIndex(3 * index)];
+    auto& b = p[vertexIndex(3 * index + 1)];
+    auto& c = p[vertexIndex(3 * index + 2)];
     auto n = normalize(cross(b - a, c - a));
     return { barycentric(a, b, c, uv), (reverseOrientation ^ transformSwapsHandedness) ? -n : n };
   }
@@ -93,15 +108,33 @@ public:
 
   void computeIntersection(std::uint32_t index, Interaction& isect) const;
 
+  /**
+   * Takes the vertex positions and normals of another activated mesh with
+   * the same triangles, e.g. the next frame of an animation. Bounds and
+   * the area distribution follow, accelerators holding the mesh need a
+   * refit afterwards
+   */
+  void updateVertices(Mesh& other);
+
   EClassType getClassType() const override {
     return EMesh;
   }
 
+  /// Bytes taken by the vertices and indices
+  std::size_t getMemoryUsage() const;
+
   std::string toString() const override;
 
 protected:
   Mesh() = default;
 
+  std::uint32_t vertexIndex(std::uint32_t i) const {
+    return f16 ? f16[i] : f[i];
+  }
+
+  /// Replaces the shading attributes and indices with their compact encodings
+  void compress();
+
 protected:
   float totalArea;
   float totalAreaInv;
@@ -111,12 +144,23 @@ protected:
   std::unique_ptr<Vector3f[]> n;
   std::unique_ptr<Vector2f[]> uv;
   std::unique_ptr<std::uint32_t[]> f;
+  // compact storage, replaces n, uv and f when present
+  std::unique_ptr<std::uint32_t[]> nOctahedral;
+  std::unique_ptr<std::uint16_t[]> uvQuantized;
+  std::unique_ptr<std::uint16_t[]> f16;
+  Vector2f uvOffset;
+  Vector2f uvScale;
   Distribution1D pdf;
 
 public:
   bool reverseOrientation;
   bool transformSwapsHandedness;
+  bool compact = false;
   std::string name;
+  // properties the mesh was loaded with, frames of an animation are loaded with them too
+  PropertyList properties;
+  // position in the scene, written to the mesh id AOV
+  int index = -1;
   Bounds3f bounds;
   BSDF* bsdf = nullptr;
   AreaLight* light = nullptr;
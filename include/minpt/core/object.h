@@ -17,6 +17,8 @@ public:
     ELight,
     EFilter,
     ETexture,
+    EShapeGroup,
+    EInstance,
     EClassTypeCount
   };
 
@@ -54,6 +56,8 @@ public:
       case ELight:        return "light";
       case EFilter:       return "filter";
       case ETexture:      return "texture";
+      case EShapeGroup:   return "shapegroup";
+      case EInstance:     return "instance";
       default:            return "<unknown>";
     }
   }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include <minpt/core/object.h>
 
 namespace minpt {
@@ -13,6 +14,30 @@ struct Options {
   std::string outfile;
   std::string filename;
   TransformType transformType;
+  // render without the preview window
+  bool headless = false;
+  bool progressive = false;
+  // progressive rendering limits and snapshots, times are in seconds
+  double timeBudget = 0.0;
+  std::int64_t sppTarget = 0;
+  double snapshotInterval = 0.0;
+  int snapshotPasses = 0;
+  // adaptive sampling stops sampling blocks below this relative error
+  bool adaptive = false;
+  float adaptiveThreshold = 0.01f;
+  std::int64_t adaptiveMinSpp = 16;
+  bool verifyDeterminism = false;
+  // batch of frames of the scene, one output and camera per line
+  std::string framesFile;
+  // raw samples stored and filtered after rendering
+  bool sampleBuffer = false;
+  std::string sampleFile;
+  std::vector<std::string> sampleFilters;
+  // first hit features and sample counts saved as layers of the EXR output
+  bool aovs = false;
+  // feature guided denoising, with the error against a reference if given
+  bool denoise = false;
+  std::string denoiseReference;
 };
 
 Object* loadFromXML(const Options& options);
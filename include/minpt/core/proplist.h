@@ -38,6 +38,11 @@ public:
     return props.find(name) != props.end();
   }
 
+  /// Drops a property, it can be set again without a warning
+  void remove(const std::string& name) {
+    props.erase(name);
+  }
+
   DEFINE_PROPERTY_ACCESSOR(bool, Boolean);
   DEFINE_PROPERTY_ACCESSOR(int, Integer);
   DEFINE_PROPERTY_ACCESSOR(float, Float);
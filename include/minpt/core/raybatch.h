@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <minpt/core/interaction.h>
+
+namespace minpt {
+
+/**
+ * \brief Rays of a batched accelerator query, stored SoA
+ *
+ * tMax is updated with the distance of the closest hit found, in the
+ * same way as Ray::tMax for single ray queries.
+ */
+class RayBatch {
+public:
+  RayBatch() = default;
+
+  explicit RayBatch(std::size_t size) {
+    resize(size);
+  }
+
+  void resize(std::size_t size) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      o[axis].resize(size);
+      d[axis].resize(size);
+    }
+    tMax.resize(size);
+  }
+
+  std::size_t size() const {
+    return tMax.size();
+  }
+
+  void set(std::size_t index, const Ray& ray) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      o[axis][index] = ray.o[axis];
+      d[axis][index] = ray.d[axis];
+    }
+    tMax[index] = ray.tMax;
+  }
+
+  Ray get(std::size_t index) const {
+    return Ray(
+      Vector3f(o[0][index], o[1][index], o[2][index]),
+      Vector3f(d[0][index], d[1][index], d[2][index]),
+      tMax[index]
+    );
+  }
+
+public:
+  std::vector<float> o[3];
+  std::vector<float> d[3];
+  std::vector<float> tMax;
+};
+
+/**
+ * \brief Results of a batched closest hit query
+ */
+class HitBatch {
+public:
+  void resize(std::size_t size) {
+    isects.resize(size);
+    hit.resize(size);
+  }
+
+  std::size_t size() const {
+    return hit.size();
+  }
+
+public:
+  std::vector<Interaction> isects;
+  std::vector<std::uint8_t> hit;
+};
+
+}
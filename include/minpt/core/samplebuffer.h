@@ -0,0 +1,73 @@
+#pragma once
+
+#include <mutex>
+#include <cstdio>
+#include <vector>
+#include <minpt/core/block.h>
+#include <minpt/utils/utils.h>
+
+namespace minpt {
+
+/// A raw radiance sample and the film position it was taken for
+struct SampleRecord {
+  Vector2f pFilm;
+  Spectrum value;
+};
+
+/**
+ * \brief Raw samples of a render, filtered into an image afterwards
+ *
+ * Samples are appended per image block, by the thread rendering the block,
+ * so that no locking is needed and the reconstruction sees them in a fixed
+ * order. With a spill file the samples of every finished block are written
+ * to disk instead of being kept in memory, for renders with more samples
+ * than fit in memory.
+ */
+class SampleBuffer {
+public:
+  SampleBuffer(const Vector2i& size, int blockSize, const std::string& spillFile = "");
+
+  ~SampleBuffer();
+
+  /// Appends samples of a block, blocks may be appended to concurrently
+  void append(int blockIndex, const std::vector<SampleRecord>& records);
+
+  /// Filters all the samples into image, which has the size of the render
+  void reconstruct(const Filter* filter, ImageBlock& image) const;
+
+  std::size_t size() const {
+    return count;
+  }
+
+  std::string toString() const {
+    return tfm::format(
+      "SampleBuffer[samples=%i, memory=%s, file=%s]",
+      (std::size_t)count, memString(count * sizeof(SampleRecord)),
+      spillFile.empty() ? "<none>" : spillFile
+    );
+  }
+
+private:
+  /// Samples of a block, read back from the spill file
+  void read(int blockIndex, std::vector<SampleRecord>& records) const;
+
+private:
+  // a range of records in the spill file
+  struct Chunk {
+    std::int64_t offset;
+    std::size_t count;
+  };
+
+  int blockSize;
+  BlockGenerator generator;
+  std::vector<std::vector<SampleRecord>> blocks;
+  std::vector<std::vector<Chunk>> chunks;
+  std::atomic<std::size_t> count { 0 };
+
+  std::string spillFile;
+  std::FILE* file = nullptr;
+  std::int64_t fileSize = 0;
+  mutable std::mutex fileMutex;
+};
+
+}
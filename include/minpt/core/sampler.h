@@ -11,19 +11,56 @@ public:
 
   explicit Sampler(std::int64_t samplesPerPixel) noexcept
     : samplesPerPixel(samplesPerPixel)
+    , sampleEnd(samplesPerPixel)
   { }
 
   virtual ~Sampler() = default;
 
+  /**
+   * Restricts the samples taken for every pixel to [begin, end), used by
+   * progressive rendering to take the samples of a pixel over several
+   * passes. Must be called before prepare().
+   */
+  void setSampleRange(std::int64_t begin, std::int64_t end) {
+    sampleBegin = begin;
+    sampleEnd = end;
+  }
+
   void startPixel() {
-    currentPixelSampleIndex = 0;
+    currentPixelSampleIndex = sampleBegin;
   }
 
   bool startNextSample() {
-    return ++currentPixelSampleIndex < samplesPerPixel;
+    return ++currentPixelSampleIndex < sampleEnd;
+  }
+
+  /**
+   * Makes the following get1D()/get2D() calls return the dimensions of the
+   * current sample of the given pixel, starting at the given dimension.
+   * Integrators tracing several pixels at once call this before sampling
+   * a path. The samples only depend on the pixel, the sample index and the
+   * dimension, which keeps renders independent of the thread count.
+   */
+  virtual void startPixelSample(const Vector2i& pixel, int dimension = 0) {
+    currentPixel = pixel;
+    currentDimension = dimension;
+  }
+
+  const Vector2i& getPixel() const {
+    return currentPixel;
+  }
+
+  /// Next dimension of the current sample, to resume with startPixelSample()
+  int getDimension() const {
+    return currentDimension;
+  }
+
+  std::int64_t getSampleIndex() const {
+    return currentPixelSampleIndex;
   }
 
   CameraSample getCameraSample(const Vector2i& pFilm) {
+    startPixelSample(pFilm);
     return { Vector2f(pFilm) + get2D() };
   }
 
@@ -40,10 +77,17 @@ public:
   }
 
 public:
+  /// Dimensions taken by getCameraSample()
+  static constexpr int CameraDimensions = 2;
+
   std::int64_t samplesPerPixel;
 
 protected:
+  std::int64_t sampleBegin = 0;
+  std::int64_t sampleEnd = 0;
   std::int64_t currentPixelSampleIndex;
+  Vector2i currentPixel;
+  int currentDimension = 0;
 };
 
 }
@@ -9,6 +9,8 @@
 #include <minpt/core/sampler.h>
 #include <minpt/core/integrator.h>
 #include <minpt/core/accelerator.h>
+#include <minpt/core/instance.h>
+#include <minpt/accels/instancebvh.h>
 
 namespace minpt {
 
@@ -26,6 +28,10 @@ public:
     delete accel;
     for (auto light : lights)
       delete light;
+    for (auto instance : instances)
+      delete instance;
+    for (auto group : shapeGroups)
+      delete group;
   }
 
   void addChild(Object* child) override;
@@ -53,12 +59,25 @@ public:
     }
 
     accel->build();
+    instanceAccel.build(instances);
+    bounds = merge(accel->getBoundingBox(), instanceAccel.getBoundingBox());
+    integrator->preprocess(*this);
+    if (envLight) envLight->preprocess(*this);
+  }
+
+  /**
+   * Follows the meshes of the scene after their vertices moved, e.g. to
+   * the next frame of an animation. Shape groups stay as they are
+   */
+  void refit() {
+    accel->refit();
+    bounds = merge(accel->getBoundingBox(), instanceAccel.getBoundingBox());
     integrator->preprocess(*this);
     if (envLight) envLight->preprocess(*this);
   }
 
   const Bounds3f& getBoundingBox() const {
-    return accel->getBoundingBox();
+    return bounds;
   }
 
   const Light& sampleOneLight(Sampler& sampler, float& pdf) const {
@@ -69,13 +88,19 @@ public:
   }
 
   bool intersect(const Ray& ray) const {
-    return accel->intersect(ray);
+    return accel->intersect(ray) || instanceAccel.intersect(ray);
   }
 
+  /// Meshes first, a hit shortens ray.tMax so that instances only report closer hits
   bool intersect(const Ray& ray, Interaction& isect) const {
-    return accel->intersect(ray, isect);
+    auto hit = accel->intersect(ray, isect);
+    return instanceAccel.intersect(ray, isect) || hit;
   }
 
+  void intersect(RayBatch& rays, HitBatch& hits) const;
+
+  void occluded(RayBatch& rays, bool* occluded) const;
+
   EClassType getClassType() const override {
     return EScene;
   }
@@ -90,7 +115,11 @@ public:
   std::string outputName;
   std::vector<Mesh*> meshes;
   std::vector<Light*> lights;
+  std::vector<ShapeGroup*> shapeGroups;
+  std::vector<Instance*> instances;
+  InstanceBVH instanceAccel;
   InfiniteLight* envLight;
+  Bounds3f bounds;
 };
 
 }
@@ -16,6 +16,9 @@ public:
 
   bool unoccluded(const Scene& scene) const;
 
+  /// Tests a batch of shadow rays with one accelerator query
+  static void unoccluded(const Scene& scene, const VisibilityTester* testers, std::size_t count, bool* unoccluded);
+
 private:
   const Interaction* ref;
   Vector3f target;
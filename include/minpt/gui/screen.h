@@ -8,7 +8,7 @@ namespace minpt {
 
 class Screen : public nanogui::Screen {
 public:
-  Screen(const ImageBlock& block);
+  Screen(ImageSnapshot& snapshot);
 
   ~Screen() {
     glDeleteTextures(1, &texture);
@@ -17,7 +17,7 @@ public:
   void drawContents() override;
 
 private:
-  const ImageBlock& block;
+  ImageSnapshot& snapshot;
   nanogui::GLShader shader;
   GLuint texture = 0;
 };
@@ -19,15 +19,27 @@ public:
 
   Spectrum li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
     Interaction isect;
+    auto hit = scene.intersect(ray, isect);
+    return liPrimary(ray, hit ? &isect : nullptr, scene, sampler);
+  }
+
+  Spectrum liPrimary(const Ray& ray, const Interaction* isect, const Scene& scene, Sampler& sampler) const override {
     auto ret = 0.0f;
-    if (!scene.intersect(ray, isect))
+    if (!isect)
       return Spectrum(ret);
+
+    // all shadow rays of the shading point are tested with one query, the
+    // buffers are kept per thread and only grow
+    static thread_local ShadowQuery query;
+    query.resize(shadingSamples);
     for (auto i = 0; i < shadingSamples; ++i) {
-      auto w = isect.toWorld(cosineSampleHemisphere(sampler.get2D()));
-      auto shadowRay = isect.spawnRay(w, rayLength);
-      if (!scene.intersect(shadowRay))
-        ret += 1.0f;
+      auto w = isect->toWorld(cosineSampleHemisphere(sampler.get2D()));
+      query.rays.set(i, isect->spawnRay(w, rayLength));
     }
+    scene.occluded(query.rays, query.occluded.get());
+    for (auto i = 0; i < shadingSamples; ++i)
+      if (!query.occluded[i])
+        ret += 1.0f;
     return Spectrum(ret / shadingSamples);
   }
 
@@ -42,6 +54,20 @@ public:
   }
 
 private:
+  struct ShadowQuery {
+    RayBatch rays;
+    std::unique_ptr<bool[]> occluded;
+    int capacity = 0;
+
+    void resize(int size) {
+      rays.resize(size);
+      if (size > capacity) {
+        occluded.reset(new bool[size]);
+        capacity = size;
+      }
+    }
+  };
+
   int shadingSamples;
   float rayLength;
 };
@@ -19,6 +19,8 @@ public:
 
   Spectrum li(const Ray& ray, const Scene& scene, Sampler& sampler) const override;
 
+  Spectrum liPrimary(const Ray& ray, const Interaction* primary, const Scene& scene, Sampler& sampler) const override;
+
   std::string toString() const override {
     return "DirectIntegrator[]";
   }
@@ -11,8 +11,13 @@ public:
 
   Spectrum li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
     Interaction isect;
-    if (scene.intersect(ray, isect)) {
-      auto n = abs(isect.shFrame.n);
+    auto hit = scene.intersect(ray, isect);
+    return liPrimary(ray, hit ? &isect : nullptr, scene, sampler);
+  }
+
+  Spectrum liPrimary(const Ray& ray, const Interaction* isect, const Scene& scene, Sampler& sampler) const override {
+    if (isect) {
+      auto n = abs(isect->shFrame.n);
       return Spectrum(n.x, n.y, n.z);
     }
     return Spectrum(0.0f);
@@ -10,6 +10,12 @@ public:
   { }
 
   Spectrum li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
+    Interaction isect;
+    auto hit = scene.intersect(ray, isect);
+    return liPrimary(ray, hit ? &isect : nullptr, scene, sampler);
+  }
+
+  Spectrum liPrimary(const Ray& ray, const Interaction* primary, const Scene& scene, Sampler& sampler) const override {
     Ray r(ray);
     auto etaScaleFix = 1.0f;
     Spectrum l(0.0f), t(1.0f), albedo(1.0f);
@@ -18,7 +24,9 @@ public:
     auto envLight = scene.envLight;
 
     for (auto bounce = 0; bounce < maxDepth; ++bounce) {
-      if (!scene.intersect(r, isect)) {
+      auto hit = bounce == 0 ? primary != nullptr : scene.intersect(r, isect);
+      if (bounce == 0 && primary) isect = *primary;
+      if (!hit) {
         if (!envLight) break;
         return l + albedo * envLight->le(r);
       }
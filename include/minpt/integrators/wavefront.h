@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <minpt/core/scene.h>
+
+namespace minpt {
+
+/**
+ * \brief Path tracer processing a whole batch of paths stage by stage
+ *
+ * Computes the same estimator as PathIntegrator, but instead of running
+ * each path to completion the live paths of a batch are kept in a queue
+ * and advanced one bounce at a time: all rays are intersected with one
+ * batched query, the hits are grouped by BSDF before shading and all
+ * shadow rays are tested with one batched query.
+ */
+class WavefrontIntegrator : public Integrator {
+public:
+  enum EStage {
+    EGenerate = 0,
+    EIntersect,
+    EShade,
+    ELightSample,
+    EShadow,
+    EAccumulate,
+    EStageCount
+  };
+
+  WavefrontIntegrator(const PropertyList& props);
+
+  Spectrum li(const Ray& ray, const Scene& scene, Sampler& sampler) const override;
+
+  void liBatch(
+    RayBatch& rays, const Vector2i* pixels, const Scene& scene, Sampler& sampler,
+    Spectrum* result, float* aovs = nullptr) const override;
+
+  void printStatistics() const override;
+
+  std::string toString() const override {
+    return tfm::format("WavefrontIntegrator[maxDepth = %d]", maxDepth);
+  }
+
+public:
+  int maxDepth;
+
+private:
+  mutable std::atomic<std::int64_t> stageTimes[EStageCount];
+  mutable std::atomic<std::int64_t> stageItems[EStageCount];
+};
+
+}
@@ -84,6 +84,22 @@ public:
     return true;
   }
 
+  /// Computes the parametric range [t0, t1] of the ray inside the bounds
+  bool intersect(const Ray& ray, float& t0, float& t1) const {
+    t0 = 0.0f;
+    t1 = ray.tMax;
+    for (auto axis = 0; axis < 3; ++axis) {
+      auto invDir = 1 / ray.d[axis];
+      auto tNear = (pMin[axis] - ray.o[axis]) * invDir;
+      auto tFar = (pMax[axis] - ray.o[axis]) * invDir;
+      if (tNear > tFar) std::swap(tNear, tFar);
+      t0 = tNear > t0 ? tNear : t0;
+      t1 = tFar < t1 ? tFar : t1;
+      if (t0 > t1) return false;
+    }
+    return true;
+  }
+
   bool operator==(const Bounds3& b) const {
     return pMin == b.pMin && pMax == b.pMax;
   }
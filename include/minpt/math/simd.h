@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <immintrin.h>
+  #define MINPT_SSE 1
+#endif
+
+#if defined(__AVX__)
+  #define MINPT_AVX 1
+#endif
+
+namespace minpt {
+
+/**
+ * \brief Packet of N floats
+ *
+ * Portable fallback used when no matching instruction set is available,
+ * the loops are simple enough to be auto-vectorized. Comparisons return
+ * a lane mask with all bits set, in the same way as the SSE/AVX versions.
+ */
+template <int N>
+class alignas(sizeof(float) * N) FloatN {
+public:
+  static constexpr int Width = N;
+
+  FloatN() noexcept = default;
+
+  explicit FloatN(float x) noexcept {
+    for (auto i = 0; i < N; ++i) v[i] = x;
+  }
+
+  static FloatN load(const float* p) {
+    FloatN r;
+    std::memcpy(r.v, p, sizeof(float) * N);
+    return r;
+  }
+
+  void store(float* p) const {
+    std::memcpy(p, v, sizeof(float) * N);
+  }
+
+  static FloatN loadUnaligned(const float* p) {
+    return load(p);
+  }
+
+  void storeUnaligned(float* p) const {
+    store(p);
+  }
+
+  float operator[](int index) const {
+    return v[index];
+  }
+
+#define MINPT_FLOATN_BINARY_OP(op)                    \
+  FloatN operator op(const FloatN& b) const {         \
+    FloatN r;                                         \
+    for (auto i = 0; i < N; ++i) r.v[i] = v[i] op b.v[i]; \
+    return r;                                         \
+  }
+
+  MINPT_FLOATN_BINARY_OP(+)
+  MINPT_FLOATN_BINARY_OP(-)
+  MINPT_FLOATN_BINARY_OP(*)
+  MINPT_FLOATN_BINARY_OP(/)
+#undef MINPT_FLOATN_BINARY_OP
+
+#define MINPT_FLOATN_BITWISE_OP(op)                   \
+  FloatN operator op(const FloatN& b) const {         \
+    FloatN r;                                         \
+    for (auto i = 0; i < N; ++i)                      \
+      r.v[i] = fromBits(toBits(v[i]) op toBits(b.v[i])); \
+    return r;                                         \
+  }
+
+  MINPT_FLOATN_BITWISE_OP(&)
+  MINPT_FLOATN_BITWISE_OP(|)
+  MINPT_FLOATN_BITWISE_OP(^)
+#undef MINPT_FLOATN_BITWISE_OP
+
+#define MINPT_FLOATN_COMPARE_OP(op)                   \
+  FloatN operator op(const FloatN& b) const {         \
+    FloatN r;                                         \
+    for (auto i = 0; i < N; ++i)                      \
+      r.v[i] = fromBits(v[i] op b.v[i] ? ~0u : 0u);   \
+    return r;                                         \
+  }
+
+  MINPT_FLOATN_COMPARE_OP(<)
+  MINPT_FLOATN_COMPARE_OP(<=)
+  MINPT_FLOATN_COMPARE_OP(>)
+  MINPT_FLOATN_COMPARE_OP(>=)
+#undef MINPT_FLOATN_COMPARE_OP
+
+  /// Same NaN semantics as minps/maxps: the second operand is returned
+  friend FloatN min(const FloatN& a, const FloatN& b) {
+    FloatN r;
+    for (auto i = 0; i < N; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    return r;
+  }
+
+  friend FloatN max(const FloatN& a, const FloatN& b) {
+    FloatN r;
+    for (auto i = 0; i < N; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    return r;
+  }
+
+  friend FloatN abs(const FloatN& a) {
+    FloatN r;
+    for (auto i = 0; i < N; ++i) r.v[i] = std::abs(a.v[i]);
+    return r;
+  }
+
+  friend FloatN select(const FloatN& mask, const FloatN& a, const FloatN& b) {
+    FloatN r;
+    for (auto i = 0; i < N; ++i) r.v[i] = toBits(mask.v[i]) ? a.v[i] : b.v[i];
+    return r;
+  }
+
+  /// Returns a bit mask with one bit per lane whose sign bit is set
+  friend int movemask(const FloatN& a) {
+    auto mask = 0;
+    for (auto i = 0; i < N; ++i) mask |= (int)(toBits(a.v[i]) >> 31) << i;
+    return mask;
+  }
+
+private:
+  static std::uint32_t toBits(float f) {
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(float));
+    return u;
+  }
+
+  static float fromBits(std::uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(float));
+    return f;
+  }
+
+private:
+  float v[N];
+};
+
+#if defined(MINPT_SSE)
+
+template <>
+class alignas(16) FloatN<4> {
+public:
+  static constexpr int Width = 4;
+
+  FloatN() noexcept = default;
+
+  explicit FloatN(float x) noexcept : v(_mm_set1_ps(x))
+  { }
+
+  FloatN(__m128 v) noexcept : v(v)
+  { }
+
+  static FloatN load(const float* p) {
+    return _mm_load_ps(p);
+  }
+
+  void store(float* p) const {
+    _mm_store_ps(p, v);
+  }
+
+  static FloatN loadUnaligned(const float* p) {
+    return _mm_loadu_ps(p);
+  }
+
+  void storeUnaligned(float* p) const {
+    _mm_storeu_ps(p, v);
+  }
+
+  float operator[](int index) const {
+    alignas(16) float tmp[4];
+    _mm_store_ps(tmp, v);
+    return tmp[index];
+  }
+
+  FloatN operator+(const FloatN& b) const { return _mm_add_ps(v, b.v); }
+  FloatN operator-(const FloatN& b) const { return _mm_sub_ps(v, b.v); }
+  FloatN operator*(const FloatN& b) const { return _mm_mul_ps(v, b.v); }
+  FloatN operator/(const FloatN& b) const { return _mm_div_ps(v, b.v); }
+  FloatN operator&(const FloatN& b) const { return _mm_and_ps(v, b.v); }
+  FloatN operator|(const FloatN& b) const { return _mm_or_ps(v, b.v); }
+  FloatN operator^(const FloatN& b) const { return _mm_xor_ps(v, b.v); }
+  FloatN operator<(const FloatN& b) const { return _mm_cmplt_ps(v, b.v); }
+  FloatN operator<=(const FloatN& b) const { return _mm_cmple_ps(v, b.v); }
+  FloatN operator>(const FloatN& b) const { return _mm_cmpgt_ps(v, b.v); }
+  FloatN operator>=(const FloatN& b) const { return _mm_cmpge_ps(v, b.v); }
+
+  friend FloatN min(const FloatN& a, const FloatN& b) { return _mm_min_ps(a.v, b.v); }
+  friend FloatN max(const FloatN& a, const FloatN& b) { return _mm_max_ps(a.v, b.v); }
+  friend FloatN abs(const FloatN& a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+  friend FloatN select(const FloatN& mask, const FloatN& a, const FloatN& b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+  }
+
+  friend int movemask(const FloatN& a) {
+    return _mm_movemask_ps(a.v);
+  }
+
+private:
+  __m128 v;
+};
+
+#endif
+
+#if defined(MINPT_AVX)
+
+template <>
+class alignas(32) FloatN<8> {
+public:
+  static constexpr int Width = 8;
+
+  FloatN() noexcept = default;
+
+  explicit FloatN(float x) noexcept : v(_mm256_set1_ps(x))
+  { }
+
+  FloatN(__m256 v) noexcept : v(v)
+  { }
+
+  static FloatN load(const float* p) {
+    return _mm256_load_ps(p);
+  }
+
+  void store(float* p) const {
+    _mm256_store_ps(p, v);
+  }
+
+  static FloatN loadUnaligned(const float* p) {
+    return _mm256_loadu_ps(p);
+  }
+
+  void storeUnaligned(float* p) const {
+    _mm256_storeu_ps(p, v);
+  }
+
+  float operator[](int index) const {
+    alignas(32) float tmp[8];
+    _mm256_store_ps(tmp, v);
+    return tmp[index];
+  }
+
+  FloatN operator+(const FloatN& b) const { return _mm256_add_ps(v, b.v); }
+  FloatN operator-(const FloatN& b) const { return _mm256_sub_ps(v, b.v); }
+  FloatN operator*(const FloatN& b) const { return _mm256_mul_ps(v, b.v); }
+  FloatN operator/(const FloatN& b) const { return _mm256_div_ps(v, b.v); }
+  FloatN operator&(const FloatN& b) const { return _mm256_and_ps(v, b.v); }
+  FloatN operator|(const FloatN& b) const { return _mm256_or_ps(v, b.v); }
+  FloatN operator^(const FloatN& b) const { return _mm256_xor_ps(v, b.v); }
+  FloatN operator<(const FloatN& b) const { return _mm256_cmp_ps(v, b.v, _CMP_LT_OQ); }
+  FloatN operator<=(const FloatN& b) const { return _mm256_cmp_ps(v, b.v, _CMP_LE_OQ); }
+  FloatN operator>(const FloatN& b) const { return _mm256_cmp_ps(v, b.v, _CMP_GT_OQ); }
+  FloatN operator>=(const FloatN& b) const { return _mm256_cmp_ps(v, b.v, _CMP_GE_OQ); }
+
+  friend FloatN min(const FloatN& a, const FloatN& b) { return _mm256_min_ps(a.v, b.v); }
+  friend FloatN max(const FloatN& a, const FloatN& b) { return _mm256_max_ps(a.v, b.v); }
+  friend FloatN abs(const FloatN& a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+  friend FloatN select(const FloatN& mask, const FloatN& a, const FloatN& b) {
+    return _mm256_blendv_ps(b.v, a.v, mask.v);
+  }
+
+  friend int movemask(const FloatN& a) {
+    return _mm256_movemask_ps(a.v);
+  }
+
+private:
+  __m256 v;
+};
+
+#endif
+
+using Float4 = FloatN<4>;
+using Float8 = FloatN<8>;
+
+}
@@ -4,9 +4,22 @@
 
 namespace minpt {
 
+/**
+ * \brief Wavefront OBJ mesh
+ *
+ * The file is mapped into memory and parsed in chunks of lines in
+ * parallel, face vertices are deduplicated in a concurrent hash table.
+ * The result is the same for any number of threads.
+ */
 class WavefrontOBJ : public Mesh {
 public:
   WavefrontOBJ(const PropertyList& props);
+
+private:
+  // bytes parsed by one task, rounded up to the next line
+  static constexpr std::size_t ChunkSize = 4 << 20;
+
+  void load(const char* data, std::size_t size, const Matrix4f& mat);
 };
 
 }
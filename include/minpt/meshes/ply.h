@@ -4,6 +4,14 @@
 
 namespace minpt {
 
+/**
+ * \brief Stanford PLY mesh
+ *
+ * Reads ascii and binary files of either byte order with properties of
+ * any of the standard scalar types. Binary files are mapped into memory
+ * and vertices are decoded from their fixed size records in parallel,
+ * faces too when they are all triangles.
+ */
 class PLY : public Mesh {
 public:
   PLY(const PropertyList& props);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <minpt/core/sampler.h>
+#include <minpt/core/lowdiscrepancy.h>
+
+namespace minpt {
+
+/**
+ * \brief Progressive multi-jittered (0,2) sampler
+ *
+ * 2D dimensions are looked up in a few precomputed tables of pmj02 points,
+ * shared by all clones. Every pixel, dimension and pass over the table
+ * picks a table and a Cranley-Patterson rotation from a hash, in the
+ * spirit of the pmj02bn sampler of pbrt-v4. The tables are filled with
+ * Owen scrambled Sobol (0,2) points, which have the progressive
+ * multi-jittered and (0,2) stratification of Christensen et al. 2018,
+ * 1D dimensions are stratified with a hashed permutation.
+ */
+class PMJ02Sampler : public Sampler {
+public:
+  static constexpr int TableCount = 32;
+
+  PMJ02Sampler(const PropertyList& props)
+      : Sampler(props.getInteger("sampleCount", 1))
+      , seed(props.getInteger("seed", 0)) {
+    // the prefixes of power of two length are the well stratified ones
+    tableSize = 1;
+    while (tableSize < samplesPerPixel && tableSize < MaxTableSize)
+      tableSize *= 2;
+    auto points = std::make_shared<std::vector<Vector2f>>(TableCount * tableSize);
+    for (std::uint32_t t = 0; t < TableCount; ++t) {
+      auto hash = mixBits(((std::uint64_t)t << 32) ^ (std::uint32_t)seed);
+      for (std::uint32_t i = 0; i < tableSize; ++i)
+        (*points)[t * tableSize + i] = Vector2f(
+          toUnitFloat(owenScramble(sobol0(i), (std::uint32_t)hash)),
+          toUnitFloat(owenScramble(sobol1(i), (std::uint32_t)(hash >> 32)))
+        );
+    }
+    tables = points;
+  }
+
+  void prepare(const Vector2i& block) override
+  { }
+
+  float get1D() override {
+    auto hash = sampleHash(currentPixel, currentDimension++, seed);
+    auto n = (std::uint32_t)samplesPerPixel;
+    auto set = (std::uint32_t)(currentPixelSampleIndex / n);
+    auto stratum = permutationElement((std::uint32_t)(currentPixelSampleIndex % n), n, (std::uint32_t)mixBits(hash + set));
+    auto offset = toUnitFloat((std::uint32_t)mixBits(hash ^ currentPixelSampleIndex));
+    return std::min((stratum + offset) / n, OneMinusEpsilon);
+  }
+
+  Vector2f get2D() override {
+    auto hash = sampleHash(currentPixel, currentDimension, seed);
+    currentDimension += 2;
+    // every pass over the table picks another table and rotation, so that
+    // renders past the table size keep converging
+    auto pass = (std::uint64_t)(currentPixelSampleIndex / tableSize);
+    auto passHash = mixBits(hash + pass);
+    auto table = passHash % TableCount;
+    auto index = (std::uint32_t)(currentPixelSampleIndex % tableSize);
+    auto u = (*tables)[table * tableSize + index];
+    auto rotation = mixBits(passHash);
+    u.x += toUnitFloat((std::uint32_t)rotation);
+    u.y += toUnitFloat((std::uint32_t)(rotation >> 32));
+    if (u.x >= 1.0f) u.x -= 1.0f;
+    if (u.y >= 1.0f) u.y -= 1.0f;
+    return Vector2f(std::min(u.x, OneMinusEpsilon), std::min(u.y, OneMinusEpsilon));
+  }
+
+  std::unique_ptr<Sampler> clone() const override {
+    return std::make_unique<PMJ02Sampler>(*this);
+  }
+
+  std::string toString() const override {
+    return tfm::format("PMJ02Sampler[samplesPerPixel=%i, tableSize=%i]", samplesPerPixel, tableSize);
+  }
+
+private:
+  static constexpr std::uint32_t MaxTableSize = 1 << 16;
+
+  int seed;
+  std::uint32_t tableSize;
+  std::shared_ptr<const std::vector<Vector2f>> tables;
+};
+
+}
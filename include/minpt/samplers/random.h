@@ -2,6 +2,7 @@
 
 #include <pcg32.h>
 #include <minpt/core/sampler.h>
+#include <minpt/core/lowdiscrepancy.h>
 
 namespace minpt {
 
@@ -11,21 +12,33 @@ public:
     : Sampler(props.getInteger("sampleCount", 1))
   { }
 
-  void prepare(const Vector2i& block) override {
-    random.seed(block.x, block.y);
+  void prepare(const Vector2i& block) override
+  { }
+
+  /// One stream per pixel sample, every dimension takes one number of it
+  void startPixelSample(const Vector2i& pixel, int dimension = 0) override {
+    Sampler::startPixelSample(pixel, dimension);
+    random.seed(sampleHash(pixel, 0, mixBits(currentPixelSampleIndex)));
+    if (dimension) random.advance(dimension);
   }
 
   float get1D() override {
+    ++currentDimension;
     return random.nextFloat();
   }
 
   Vector2f get2D() override {
-    return Vector2f(random.nextFloat(), random.nextFloat());
+    currentDimension += 2;
+    // argument evaluation order is unspecified, keep the draws in order
+    auto x = random.nextFloat();
+    return Vector2f(x, random.nextFloat());
   }
 
   std::unique_ptr<Sampler> clone() const override {
     auto cloned = new RandomSampler();
     cloned->samplesPerPixel = samplesPerPixel;
+    cloned->sampleBegin = sampleBegin;
+    cloned->sampleEnd = sampleEnd;
     cloned->random = random;
     return std::unique_ptr<Sampler>(cloned);
   }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <minpt/core/sampler.h>
+#include <minpt/core/lowdiscrepancy.h>
+
+namespace minpt {
+
+/**
+ * \brief Owen scrambled Sobol sampler
+ *
+ * Every pair of dimensions of a pixel sample is a point of the 2D Sobol
+ * (0,2)-sequence, with the sample index shuffled and the point Owen
+ * scrambled by a hash of the pixel and the dimension. This decorrelates
+ * the dimensions without the tables of a high dimensional Sobol sequence,
+ * see Burley, "Practical Hash-based Owen Scrambling", 2020. Converges best
+ * with a power of two sample count.
+ */
+class SobolSampler : public Sampler {
+public:
+  SobolSampler(const PropertyList& props)
+    : Sampler(props.getInteger("sampleCount", 1))
+    , seed(props.getInteger("seed", 0))
+  { }
+
+  void prepare(const Vector2i& block) override
+  { }
+
+  float get1D() override {
+    auto hash = sampleHash(currentPixel, currentDimension++, seed);
+    auto index = owenScramble((std::uint32_t)currentPixelSampleIndex, (std::uint32_t)hash);
+    return toUnitFloat(owenScramble(sobol0(index), (std::uint32_t)(hash >> 32)));
+  }
+
+  Vector2f get2D() override {
+    auto hash = sampleHash(currentPixel, currentDimension, seed);
+    currentDimension += 2;
+    auto index = owenScramble((std::uint32_t)currentPixelSampleIndex, (std::uint32_t)hash);
+    auto hashY = mixBits(hash);
+    return Vector2f(
+      toUnitFloat(owenScramble(sobol0(index), (std::uint32_t)(hash >> 32))),
+      toUnitFloat(owenScramble(sobol1(index), (std::uint32_t)hashY))
+    );
+  }
+
+  std::unique_ptr<Sampler> clone() const override {
+    return std::make_unique<SobolSampler>(*this);
+  }
+
+  std::string toString() const override {
+    return tfm::format("SobolSampler[samplesPerPixel=%i, seed=%i]", samplesPerPixel, seed);
+  }
+
+private:
+  int seed;
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <minpt/core/sampler.h>
+#include <minpt/core/lowdiscrepancy.h>
+
+namespace minpt {
+
+/**
+ * \brief Stratified sampler
+ *
+ * Each dimension of a pixel is split into sampleCount strata, the 2D
+ * dimensions into a grid of about sqrt(sampleCount) by sqrt(sampleCount)
+ * cells. The samples of a pixel visit the strata in an order given by a
+ * hashed permutation, so no per pixel tables are needed. Samples past
+ * sampleCount, as taken by progressive rendering, start a new set of strata.
+ */
+class StratifiedSampler : public Sampler {
+public:
+  StratifiedSampler(const PropertyList& props)
+    : Sampler(props.getInteger("sampleCount", 1))
+    , jitter(props.getBoolean("jitter", true))
+    , seed(props.getInteger("seed", 0)) {
+    nx = std::max(1, (int)std::sqrt((float)samplesPerPixel));
+    ny = (int)((samplesPerPixel + nx - 1) / nx);
+  }
+
+  void prepare(const Vector2i& block) override
+  { }
+
+  float get1D() override {
+    auto hash = sampleHash(currentPixel, currentDimension++, seed);
+    auto n = (std::uint32_t)samplesPerPixel;
+    auto set = (std::uint32_t)(currentPixelSampleIndex / n);
+    auto stratum = permutationElement((std::uint32_t)(currentPixelSampleIndex % n), n, (std::uint32_t)mixBits(hash + set));
+    auto offset = jitter ? toUnitFloat((std::uint32_t)mixBits(hash ^ currentPixelSampleIndex)) : 0.5f;
+    return std::min((stratum + offset) / n, OneMinusEpsilon);
+  }
+
+  Vector2f get2D() override {
+    auto hash = sampleHash(currentPixel, currentDimension, seed);
+    currentDimension += 2;
+    auto n = (std::uint32_t)(nx * ny);
+    auto set = (std::uint32_t)(currentPixelSampleIndex / n);
+    auto stratum = permutationElement((std::uint32_t)(currentPixelSampleIndex % n), n, (std::uint32_t)mixBits(hash + set));
+    auto bits = mixBits(hash ^ currentPixelSampleIndex);
+    auto dx = jitter ? toUnitFloat((std::uint32_t)bits) : 0.5f;
+    auto dy = jitter ? toUnitFloat((std::uint32_t)(bits >> 32)) : 0.5f;
+    return Vector2f(
+      std::min((stratum % nx + dx) / nx, OneMinusEpsilon),
+      std::min((stratum / nx + dy) / ny, OneMinusEpsilon)
+    );
+  }
+
+  std::unique_ptr<Sampler> clone() const override {
+    return std::make_unique<StratifiedSampler>(*this);
+  }
+
+  std::string toString() const override {
+    return tfm::format(
+      "StratifiedSampler[samplesPerPixel=%i, strata=%ix%i, jitter=%s]",
+      samplesPerPixel, nx, ny, jitter ? "true" : "false"
+    );
+  }
+
+private:
+  bool jitter;
+  int seed;
+  int nx, ny;
+};
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+#include <vector>
 #include <Eigen/Core>
 #include <minpt/core/spectrum.h>
 
@@ -8,6 +10,7 @@ namespace minpt {
 class Bitmap : public Eigen::Array<Spectrum, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
   using Base = Eigen::Array<Spectrum, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using Channel = Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
 
   /**
    * \brief Allocate a new bitmap of the specified size
@@ -24,6 +27,30 @@ public:
   /// Save the bitmap as an EXR file
   void save(const std::string& filename);
 
+  /**
+   * \brief Add a named channel of the size of the bitmap
+   *
+   * Extra channels are saved next to R, G and B to EXR files only, names
+   * like "albedo.R" group them into layers. The reference is valid until
+   * the next channel is added.
+   */
+  Channel& addChannel(const std::string& name) {
+    channelNames.push_back(name);
+    channels.emplace_back(rows(), cols());
+    return channels.back();
+  }
+
+  /// Channel with the given name, null if there is none
+  const Channel* getChannel(const std::string& name) const {
+    for (std::size_t i = 0; i < channelNames.size(); ++i)
+      if (channelNames[i] == name) return &channels[i];
+    return nullptr;
+  }
+
+public:
+  std::vector<std::string> channelNames;
+  std::vector<Channel> channels;
+
 private:
   void readImagePFM(const std::string& filename);
   void readImagePNG(const std::string& filename);
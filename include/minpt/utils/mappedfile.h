@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace minpt {
+
+/**
+ * \brief Read only memory mapping of a whole file
+ *
+ * Lets loaders parse or copy large files without reading them through a
+ * stream first, pages are read by the OS on demand.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& filename);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const {
+    return bytes;
+  }
+
+  std::size_t size() const {
+    return length;
+  }
+
+private:
+  const char* bytes = nullptr;
+  std::size_t length = 0;
+#if defined(_WIN32)
+  void* file = nullptr;
+  void* mapping = nullptr;
+#endif
+};
+
+}
@@ -1,198 +1,328 @@
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <atomic>
 #include <tbb/tbb.h>
+#include <pcg32.h>
 
 #include <minpt/core/timer.h>
+#include <minpt/core/sampling.h>
+#include <minpt/core/lowdiscrepancy.h>
+#include <minpt/utils/mappedfile.h>
 #include <minpt/accels/bvh.h>
+#include <minpt/accels/lbvh.h>
 
 namespace minpt {
 
-struct PrimInfo {
-  Bounds3f bounds;
-  Vector3f center;
+/**
+ * \brief Maps centroids to N bins per axis over the centroid bounds of a node
+ *
+ * Binning and partitioning both go through operator(), so a primitive
+ * always lands on the side of the split its bin was counted on.
+ */
+struct BinMapping {
+  Vector3f min;
+  Vector3f scale;
+  int binCount;
 
-  PrimInfo() = default;
+  BinMapping() = default;
 
-  PrimInfo(const Bounds3f& bounds) : bounds(bounds), center(bounds.centroid())
-  { }
+  BinMapping(const Bounds3f& centroidBounds, int binCount)
+    : min(centroidBounds.pMin), binCount(binCount) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      auto extent = centroidBounds.pMax[axis] - centroidBounds.pMin[axis];
+      scale[axis] = extent > 0 ? binCount / extent : 0.0f;
+    }
+  }
+
+  int operator()(const Vector3f& center, int axis) const {
+    return std::min(binCount - 1, (int)((center[axis] - min[axis]) * scale[axis]));
+  }
 };
 
+/**
+ * \brief SAH bins of all three axes
+ */
+template <int N>
 struct Bins {
-  static constexpr auto BinCount = 16;
-  std::uint32_t counts[BinCount];
-  Bounds3f bounds[BinCount];
+  std::uint32_t counts[3][N];
+  Bounds3f bounds[3][N];
 
   Bins() {
-    memset(counts, 0, sizeof(std::uint32_t) * BinCount);
+    memset(counts, 0, sizeof(counts));
+  }
+
+  void add(const PrimInfo& info, const BinMapping& mapping) {
+    for (auto axis = 0; axis < 3; ++axis) {
+      auto bin = mapping(info.center, axis);
+      ++counts[axis][bin];
+      bounds[axis][bin].merge(info.bounds);
+    }
+  }
+
+  void merge(const Bins& bins) {
+    for (auto axis = 0; axis < 3; ++axis)
+      for (auto i = 0; i < N; ++i) {
+        counts[axis][i] += bins.counts[axis][i];
+        bounds[axis][i].merge(bins.bounds[axis][i]);
+      }
   }
 };
 
-class BVHBuildTask : public tbb::task {
+struct BVHSplit {
+  int axis = -1;
+  int bin;
+  float cost = std::numeric_limits<float>::infinity();
+  std::uint32_t leftCount;
+  BinMapping mapping;
+  Bounds3f bounds[2];
+  Bounds3f centroidBounds[2];
+};
+
+/**
+ * \brief Top down binned SAH builder
+ *
+ * The subtree of n primitives at node i owns the slots [i, i + 2n - 1) of
+ * the node array, its left child is i + 1 and its right child
+ * i + 2 * leftCount, so subtrees are built as independent tasks without
+ * any synchronization. Large nodes are binned and partitioned in parallel
+ * as well, the primitives are partitioned in place and stream through the
+ * cache in order instead of being gathered through indices. Small nodes
+ * sort their few primitives for an exact SAH sweep. The tree only depends
+ * on the geometry, never on the number of threads.
+ */
+class BVHBuilder {
 public:
-  BVHBuildTask(
-      std::vector<BVHNode>& nodes,
-      const std::uint32_t* indices,
-      const PrimInfo* primInfos,
-      std::uint32_t nodeIndex,
-      std::uint32_t* start, std::uint32_t* end, std::uint32_t* buffer)
-    : nodes(nodes)
-    , indices(indices)
-    , primInfos(primInfos)
-    , nodeIndex(nodeIndex)
-    , start(start) , end(end) , buffer(buffer)
+  BVHBuilder(PrimInfo* primInfos, BVHNode* nodes, std::uint32_t* subtreeSizes)
+    : primInfos(primInfos), nodes(nodes), subtreeSizes(subtreeSizes)
   { }
 
-  tbb::task* execute() override {
-    auto nPrims = (std::uint32_t)(end - start);
+  /// Builds primInfos[start, end) into the subtree at nodeIndex, returns its node count
+  std::uint32_t build(
+      std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end,
+      const Bounds3f& bounds, const Bounds3f& centroidBounds) {
+    auto nPrims = end - start;
+    if (nPrims <= SweepThreshold)
+      return buildSweep(nodeIndex, start, end);
+
+    auto split = nPrims >= TopBinThreshold
+      ? findSplit<TopBinCount>(start, end, bounds, centroidBounds)
+      : findSplit<BinCount>(start, end, bounds, centroidBounds);
 
-    if (nPrims < SerialThreshold) {
-      seriallyBuild(nodeIndex, start, end, buffer);
-      return nullptr;
+    std::uint32_t mid;
+    if (split.axis != -1 && (split.cost < nPrims || nPrims > MaxLeafSize)) {
+      mid = partition(start, end, split);
+    } else if (nPrims <= MaxLeafSize) {
+      nodes[nodeIndex] = BVHNode(bounds, start, (std::uint16_t)nPrims);
+      return 1;
+    } else {
+      // no split separates the centroids, e.g. all in one point, halves the range
+      mid = start + nPrims / 2;
+      split.axis = 0;
+      split.bounds[0].reset();
+      split.bounds[1].reset();
+      for (auto i = start; i < end; ++i)
+        split.bounds[i >= mid].merge(primInfos[i].bounds);
+      split.centroidBounds[0] = split.centroidBounds[1] = centroidBounds;
     }
 
-    auto& node = nodes[nodeIndex];
-    auto axis = node.bounds.majorAxis();
-    auto min = node.bounds.pMin[axis];
-    auto max = node.bounds.pMax[axis];
-    auto binSizeInv = Bins::BinCount / (max - min);
-
-    auto bins = tbb::parallel_reduce(
-      tbb::blocked_range<std::uint32_t>(0u, nPrims, GrainSize),
-      Bins(),
-      [=](const tbb::blocked_range<std::uint32_t>& range, Bins bins) -> Bins {
-        for (auto i = range.begin(); i != range.end(); ++i) {
-          auto f = start[i];
-          auto centeroid = primInfos[f].center[axis];
-          auto index = (int)((centeroid - min) * binSizeInv);
-          if (index == Bins::BinCount) --index;
-          ++bins.counts[index];
-          bins.bounds[index].merge(primInfos[f].bounds);
-        }
-        return bins;
-      },
-      [](const Bins& a, const Bins& b) {
-        Bins bins;
-        for (auto i = 0; i < Bins::BinCount; ++i) {
-          bins.counts[i] = a.counts[i] + b.counts[i];
-          bins.bounds[i] = merge(a.bounds[i], b.bounds[i]);
+    auto rightChild = nodeIndex + 2 * (mid - start);
+    nodes[nodeIndex] = BVHNode(bounds, (std::uint16_t)split.axis, rightChild);
+
+    std::uint32_t sizes[2];
+    auto buildLeft = [&] {
+      sizes[0] = build(nodeIndex + 1, start, mid, split.bounds[0], split.centroidBounds[0]);
+    };
+    auto buildRight = [&] {
+      sizes[1] = build(rightChild, mid, end, split.bounds[1], split.centroidBounds[1]);
+    };
+    if (nPrims >= ParallelThreshold)
+      tbb::parallel_invoke(buildLeft, buildRight);
+    else {
+      buildLeft();
+      buildRight();
+    }
+
+    return subtreeSizes[nodeIndex] = sizes[0] + sizes[1] + 1;
+  }
+
+private:
+  template <int N>
+  BVHSplit findSplit(
+      std::uint32_t start, std::uint32_t end,
+      const Bounds3f& bounds, const Bounds3f& centroidBounds) const {
+    BinMapping mapping(centroidBounds, N);
+    Bins<N> bins;
+    if (end - start >= 2 * GrainSize)
+      bins = tbb::parallel_reduce(
+        tbb::blocked_range<std::uint32_t>(start, end, GrainSize),
+        Bins<N>(),
+        [&](const tbb::blocked_range<std::uint32_t>& range, Bins<N> bins) {
+          for (auto i = range.begin(); i != range.end(); ++i)
+            bins.add(primInfos[i], mapping);
+          return bins;
+        },
+        [](Bins<N> a, const Bins<N>& b) {
+          a.merge(b);
+          return a;
         }
-        return bins;
+      );
+    else
+      for (auto i = start; i < end; ++i)
+        bins.add(primInfos[i], mapping);
+
+    BVHSplit split;
+    auto totalAreaInv = 1 / bounds.area();
+    for (auto axis = 0; axis < 3; ++axis) {
+      if (mapping.scale[axis] == 0) continue;
+
+      float rightAreas[N];
+      std::uint32_t rightCounts[N];
+      Bounds3f sweep;
+      std::uint32_t count = 0;
+      for (auto i = N - 1; i > 0; --i) {
+        sweep.merge(bins.bounds[axis][i]);
+        count += bins.counts[axis][i];
+        rightAreas[i] = sweep.area();
+        rightCounts[i] = count;
       }
-    );
 
-    std::uint8_t boundsBuffer[Bins::BinCount * sizeof(Bounds3f)];
-    auto leftBounds = reinterpret_cast<Bounds3f*>(boundsBuffer);
-    leftBounds[0] = bins.bounds[0];
-    for (auto i = 1; i < Bins::BinCount - 1; ++i) {
-      bins.counts[i] += bins.counts[i - 1];
-      leftBounds[i] = merge(leftBounds[i - 1], bins.bounds[i]);
-    }
-
-    auto splitIndex = -1;
-    auto minCost = (float)nPrims;
-    auto totalAreaInv = 1 / node.bounds.area();
-    Bounds3f bestRightBounds, rightBounds = bins.bounds[Bins::BinCount - 1];
-
-    for (auto i = Bins::BinCount - 2; i >= 0; --i) {
-      auto cost = TraversalCost + totalAreaInv * (
-        bins.counts[i] * leftBounds[i].area() +
-        (nPrims - bins.counts[i]) * rightBounds.area());
-      if (cost < minCost) {
-        minCost = cost;
-        splitIndex = i;
-        bestRightBounds = rightBounds;
+      sweep.reset();
+      count = 0;
+      for (auto i = 1; i < N; ++i) {
+        sweep.merge(bins.bounds[axis][i - 1]);
+        count += bins.counts[axis][i - 1];
+        if (!count || !rightCounts[i]) continue;
+        auto cost = TraversalCost + (count * sweep.area() + rightCounts[i] * rightAreas[i]) * totalAreaInv;
+        if (cost < split.cost) {
+          split.cost = cost;
+          split.axis = axis;
+          split.bin = i;
+          split.leftCount = count;
+        }
       }
-      rightBounds.merge(bins.bounds[i]);
     }
 
-    if (splitIndex == -1) {
-      seriallyBuild(nodeIndex, start, end, buffer);
-      return nullptr;
-    }
+    if (split.axis != -1)
+      for (auto i = 0; i < N; ++i)
+        split.bounds[i >= split.bin].merge(bins.bounds[split.axis][i]);
+    split.mapping = mapping;
+    return split;
+  }
 
-    auto leftCount = bins.counts[splitIndex];
-    node.nPrims = 0;
-    node.splitAxis = axis;
-    node.rightChild = nodeIndex + 2 * leftCount;
-    nodes[nodeIndex + 1].bounds = leftBounds[splitIndex];
-    nodes[node.rightChild].bounds = bestRightBounds;
+  /**
+   * Moves the primitives left of the split to the front of the range and
+   * collects the centroid bounds of both sides, returns the first right one
+   */
+  std::uint32_t partition(std::uint32_t start, std::uint32_t end, BVHSplit& split) {
+    // every primitive is classified once, the right ones are swapped to the back
+    auto partitionRange = [&](std::uint32_t first, std::uint32_t last, Bounds3f* centroidBounds) {
+      while (first < last) {
+        auto& center = primInfos[first].center;
+        if (split.mapping(center, split.axis) < split.bin) {
+          centroidBounds[0].merge(center);
+          ++first;
+        } else {
+          centroidBounds[1].merge(center);
+          std::swap(primInfos[first], primInfos[--last]);
+        }
+      }
+      return first;
+    };
+
+    auto nPrims = end - start;
+    if (nPrims < 2 * GrainSize)
+      return partitionRange(start, end, split.centroidBounds);
+
+    // blocks are partitioned on their own first
+    auto nBlocks = (nPrims + GrainSize - 1) / GrainSize;
+    std::vector<std::uint32_t> pivots(nBlocks);
+    std::vector<Bounds3f> blockCentroidBounds(2 * nBlocks);
+    tbb::parallel_for(0u, nBlocks, [&](std::uint32_t block) {
+      auto first = start + block * GrainSize;
+      auto last = std::min(end, first + GrainSize);
+      pivots[block] = partitionRange(first, last, &blockCentroidBounds[2 * block]);
+    });
+    for (std::uint32_t block = 0; block < nBlocks; ++block) {
+      split.centroidBounds[0].merge(blockCentroidBounds[2 * block]);
+      split.centroidBounds[1].merge(blockCentroidBounds[2 * block + 1]);
+    }
 
-    std::atomic<std::uint32_t> offsetLeft(0);
-    std::atomic<std::uint32_t> offsetRight(leftCount);
+    // then the right primitives before mid swap places with the left ones after it,
+    // both are runs at the pivots of the blocks
+    auto mid = start + split.leftCount;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> rightRuns, leftRuns;
+    std::vector<std::uint32_t> rightOffsets(1, 0u), leftOffsets(1, 0u);
+    for (std::uint32_t block = 0; block < nBlocks; ++block) {
+      auto first = start + block * GrainSize;
+      auto last = std::min(end, first + GrainSize);
+      auto pivot = pivots[block];
+      if (pivot < mid && pivot < last) {
+        rightRuns.emplace_back(pivot, std::min(last, mid));
+        rightOffsets.push_back(rightOffsets.back() + rightRuns.back().second - pivot);
+      }
+      if (pivot > mid && pivot > first) {
+        leftRuns.emplace_back(std::max(first, mid), pivot);
+        leftOffsets.push_back(leftOffsets.back() + pivot - leftRuns.back().first);
+      }
+    }
 
     tbb::parallel_for(
-      tbb::blocked_range<std::uint32_t>(0u, nPrims, GrainSize),
-      [=, &offsetLeft, &offsetRight](const tbb::blocked_range<std::uint32_t>& range) {
-        std::uint32_t leftCount = 0;
-        std::uint32_t rightCount = 0;
+      tbb::blocked_range<std::uint32_t>(0u, rightOffsets.back(), GrainSize),
+      [&](const tbb::blocked_range<std::uint32_t>& range) {
+        auto r = std::upper_bound(rightOffsets.begin(), rightOffsets.end(), range.begin()) - rightOffsets.begin() - 1;
+        auto l = std::upper_bound(leftOffsets.begin(), leftOffsets.end(), range.begin()) - leftOffsets.begin() - 1;
+        auto right = rightRuns[r].first + (range.begin() - rightOffsets[r]);
+        auto left = leftRuns[l].first + (range.begin() - leftOffsets[l]);
         for (auto i = range.begin(); i != range.end(); ++i) {
-          auto f = start[i];
-          auto centroid = primInfos[f].center[axis];
-          auto index = (int)((centroid - min) * binSizeInv);
-          if (index == Bins::BinCount) --index;
-          ++(index <= splitIndex ? leftCount : rightCount);
-        }
-        auto left = offsetLeft.fetch_add(leftCount);
-        auto right = offsetRight.fetch_add(rightCount);
-        for (auto i = range.begin(); i != range.end(); ++i) {
-          auto f = start[i];
-          auto centroid = primInfos[f].center[axis];
-          auto index = (int)((centroid - min) * binSizeInv);
-          if (index == Bins::BinCount) --index;
-          if (index <= splitIndex)
-            buffer[left++] = f;
-          else
-            buffer[right++] = f;
+          if (right == rightRuns[r].second) right = rightRuns[++r].first;
+          if (left == leftRuns[l].second) left = leftRuns[++l].first;
+          std::swap(primInfos[right++], primInfos[left++]);
         }
       }
     );
 
-    memcpy(start, buffer, nPrims * sizeof(uint32_t));
-    auto& c = *new(allocate_continuation()) tbb::empty_task();
-    c.set_ref_count(2);
-    auto& b = *new(c.allocate_child()) BVHBuildTask(
-      nodes, indices, primInfos, node.rightChild, start + leftCount, end, buffer + leftCount);
-    spawn(b);
-    recycle_as_child_of(c);
-    ++nodeIndex;
-    end = start + leftCount;
-
-    return this;
+    return mid;
   }
 
-  void seriallyBuild(std::uint32_t nodeIndex, std::uint32_t* start, std::uint32_t* end, std::uint32_t* buffer) {
-    auto& node = nodes[nodeIndex];
-    auto nPrims = (std::uint32_t)(end - start);
+  std::uint32_t buildSweep(std::uint32_t nodeIndex, std::uint32_t start, std::uint32_t end) {
+    auto first = primInfos + start;
+    auto last = primInfos + end;
+    auto nPrims = end - start;
+
+    Bounds3f bounds;
+    for (auto prim = first; prim != last; ++prim)
+      bounds.merge(prim->bounds);
 
     if (nPrims == 1) {
-      node = BVHNode(primInfos[*start].bounds, (std::uint32_t)(start - indices), 1);
-      return;
+      nodes[nodeIndex] = BVHNode(bounds, start, (std::uint16_t)1);
+      return 1;
     }
 
     int splitAxis = -1;
     std::uint32_t splitIndex = 0;
-    float minCost = nPrims;
-    float totalAreaInv;
-    auto rightAreas = (float*)buffer;
+    float minCost = (float)nPrims;
+    auto totalAreaInv = 1 / bounds.area();
+    float rightAreas[SweepThreshold];
 
-    for (auto axis = 0; axis < 3; ++axis) {
-      std::sort(start, end, [&, axis](auto a, auto b) {
-        return primInfos[a].center[axis] < primInfos[b].center[axis];
+    auto sortByAxis = [&](int axis) {
+      std::sort(first, last, [axis](const PrimInfo& a, const PrimInfo& b) {
+        return a.center[axis] < b.center[axis];
       });
-      Bounds3f bounds;
+    };
+
+    for (auto axis = 0; axis < 3; ++axis) {
+      sortByAxis(axis);
+      Bounds3f sweep;
       for (std::uint32_t i = 1; i < nPrims; ++i) {
-        bounds.merge(primInfos[*(end - i)].bounds);
-        rightAreas[nPrims - i] = bounds.area();
-      }
-      if (axis == 0) {
-        node.bounds = bounds.merge(primInfos[*start].bounds);
-        totalAreaInv = 1 / node.bounds.area();
+        sweep.merge((last - i)->bounds);
+        rightAreas[nPrims - i] = sweep.area();
       }
-      bounds.reset();
+      sweep.reset();
       for (std::uint32_t i = 1; i < nPrims; ++i) {
-        bounds.merge(primInfos[*(start + i - 1)].bounds);
-        auto cost = TraversalCost + (bounds.area() * i + rightAreas[i] * (nPrims - i)) * totalAreaInv;
+        sweep.merge((first + i - 1)->bounds);
+        auto cost = TraversalCost + (sweep.area() * i + rightAreas[i] * (nPrims - i)) * totalAreaInv;
         if (cost < minCost) {
           minCost = cost;
           splitIndex = i;
@@ -202,113 +332,700 @@ public:
     }
 
     if (splitAxis == -1) {
-      node = BVHNode(node.bounds, (std::uint32_t)(start - indices), (std::uint16_t)nPrims);
-      return;
+      nodes[nodeIndex] = BVHNode(bounds, start, (std::uint16_t)nPrims);
+      return 1;
     }
 
-    std::sort(start, end, [&, splitAxis](auto a, auto b) {
-      return primInfos[a].center[splitAxis] < primInfos[b].center[splitAxis];
-    });
+    if (splitAxis != 2)
+      sortByAxis(splitAxis);
 
-    node.splitAxis = splitAxis;
-    node.rightChild = nodeIndex + splitIndex * 2;
-    seriallyBuild(nodeIndex + 1, start, start + splitIndex, buffer);
-    seriallyBuild(node.rightChild, start + splitIndex, end, buffer + splitIndex);
+    auto rightChild = nodeIndex + 2 * splitIndex;
+    nodes[nodeIndex] = BVHNode(bounds, (std::uint16_t)splitAxis, rightChild);
+    auto size =
+      buildSweep(nodeIndex + 1, start, start + splitIndex) +
+      buildSweep(rightChild, start + splitIndex, end) + 1;
+    return subtreeSizes[nodeIndex] = size;
   }
 
 public:
-  static constexpr std::uint32_t SerialThreshold = 128;
-  static constexpr std::uint32_t GrainSize = 1000;
+  static constexpr int BinCount = 16;
+  // nodes of at least TopBinThreshold primitives, near the root, use more bins
+  static constexpr int TopBinCount = 64;
+  static constexpr std::uint32_t TopBinThreshold = 1 << 16;
+  static constexpr std::uint32_t SweepThreshold = 32;
+  static constexpr std::uint32_t MaxLeafSize = 64;
+  // subtrees of at least ParallelThreshold primitives are built as tasks
+  static constexpr std::uint32_t ParallelThreshold = 1 << 12;
+  // primitives binned or partitioned by one task
+  static constexpr std::uint32_t GrainSize = 1 << 14;
   static constexpr float TraversalCost = 1.0f / 2;
 
 private:
-  std::vector<BVHNode>& nodes;
-  const std::uint32_t* indices;
-  const PrimInfo* primInfos;
-  std::uint32_t nodeIndex;
-  std::uint32_t* start;
-  std::uint32_t* end;
-  std::uint32_t* buffer;
+  PrimInfo* primInfos;
+  BVHNode* nodes;
+  std::uint32_t* subtreeSizes;
 };
 
+static_assert(LBVHBuilder::TraversalCost == BVHBuilder::TraversalCost, "SAH costs of both builders must compare");
 
+/**
+ * \brief Header of a BVH cache file
+ *
+ * Followed by nNodes compacted BVHNodes and nPrims primitive indices. The
+ * builder parameters are stored so that a tree built by a different
+ * builder is never loaded, even on a hash collision of the file name.
+ */
+struct BVHCacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t nodeSize;
+  std::uint32_t binCount;
+  std::uint32_t serialThreshold;
+  float traversalCost;
+  std::uint32_t nPrims;
+  std::uint64_t hash;
+  std::uint32_t nNodes;
+  std::uint32_t builder;
+};
+
+// bump whenever the builder or the node layout changes
+static constexpr std::uint32_t BVHCacheVersion = 2;
+static const char BVHCacheMagic[8] = { 'M', 'I', 'N', 'P', 'T', 'B', 'V', 'H' };
+
+static BVHCacheHeader makeCacheHeader(
+    std::uint64_t hash, std::uint32_t nPrims, std::uint32_t nNodes, std::uint32_t builder) {
+  BVHCacheHeader header;
+  std::memcpy(header.magic, BVHCacheMagic, sizeof(header.magic));
+  header.version = BVHCacheVersion;
+  header.nodeSize = sizeof(BVHNode);
+  header.binCount = BVHBuilder::TopBinCount;
+  header.serialThreshold = BVHBuilder::SweepThreshold;
+  header.traversalCost = BVHBuilder::TraversalCost;
+  header.nPrims = nPrims;
+  header.hash = hash;
+  header.nNodes = nNodes;
+  header.builder = builder;
+  return header;
+}
+
+BVHAccel::BVHAccel(const PropertyList& props)
+    : width(props.getInteger("width", 2))
+    , runBenchmark(props.getBoolean("benchmark", false))
+    , useTriangleBlocks(props.getBoolean("triangleBlocks", true))
+    , cacheDir(props.getString("cacheDir", ""))
+    , restructure(props.getBoolean("treelets", false))
+    , mortonBits(props.getInteger("mortonBits", 63))
+    , rebuildThreshold(props.getFloat("rebuildThreshold", 1.5f)) {
+  if (width != 2 && width != 4 && width != 8)
+    throw Exception("BVHAccel: unsupported width %i, expected 2, 4 or 8!", width);
+
+  auto builderName = props.getString("builder", "sah");
+  if (builderName == "sah")
+    builder = ESAH;
+  else if (builderName == "lbvh")
+    builder = ELBVH;
+  else
+    throw Exception("BVHAccel: unknown builder \"%s\", expected \"sah\" or \"lbvh\"!", builderName);
+  if (mortonBits != 30 && mortonBits != 63)
+    throw Exception("BVHAccel: unsupported Morton code length %i, expected 30 or 63!", mortonBits);
+  if (!(rebuildThreshold >= 1))
+    throw Exception("BVHAccel: rebuildThreshold must be at least 1, not %f!", rebuildThreshold);
+}
 
 void BVHAccel::build() {
+  build(true);
+}
+
+void BVHAccel::build(bool useCache) {
   auto nPrims = getPrimitiveCount();
   if (!nPrims) return;
 
   std::cout
-    << "Constructing a SAH BVH (" << meshes.size()
+    << "Constructing " << (builder == ESAH ? "a SAH" : "an LBVH") << " BVH (" << meshes.size()
     << (meshes.size() == 1 ? " shape, " : " shapes, ")
     << nPrims << " primitives) .. ";
 
   Timer timer;
 
+  std::string cacheFile;
+  auto cached = false;
+  std::uint64_t hash = 0;
+  if (useCache && !cacheDir.empty()) {
+    hash = hashGeometry();
+    cacheFile = cacheFileName(hash);
+    cached = loadCache(cacheFile, hash);
+  }
+  if (!cached) {
+    buildBinary();
+    if (!cacheFile.empty())
+      saveCache(cacheFile, hash);
+  }
+  auto stats = statistics(0u);
+
+  // resolve the owning mesh of every primitive once, in leaf order
+  prims.resize(nPrims);
+  tbb::parallel_for(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims),
+    [&](const tbb::blocked_range<std::uint32_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i)
+        prims[i] = findPrimitive(indices[i]);
+    }
+  );
+
+  if (useTriangleBlocks)
+    buildTriangleBlocks();
+
+  if (width == 4)
+    collapse(nodes4);
+  else if (width == 8)
+    collapse(nodes8);
+  // the wide trees have a cost of their own
+  builtCost = width == 2 ? stats.first : refitNodes();
+
+  auto nodesSize =
+    width == 4 ? sizeof(WideBVHNode<4>) * nodes4.size() :
+    width == 8 ? sizeof(WideBVHNode<8>) * nodes8.size() :
+    sizeof(BVHNode) * nodes.size();
+
+  std::cout
+    << "done (" << (cached ? "loaded from cache, " : "") << "took " << timer.elapsedString() << " and "
+    << memString(
+      nodesSize +
+      (useTriangleBlocks ? 0 : sizeof(PrimitiveRef) * prims.size()) +
+      sizeof(TriangleBlock<TriangleBlockSize>) * triangleBlocks.size())
+    << ", node count = " << stats.second;
+  if (width != 2)
+    std::cout << ", " << width << "-wide node count = " << (width == 4 ? nodes4.size() : nodes8.size());
+  std::cout << ", SAH cost = " << stats.first << ")." << std::endl;
+
+  if (runBenchmark) {
+    benchmarkMeshLookup();
+    benchmark();
+  }
+
+  // leaves refer to prims or triangleBlocks from now on
+  indices.clear();
+  indices.shrink_to_fit();
+  if (useTriangleBlocks) {
+    prims.clear();
+    prims.shrink_to_fit();
+  }
+
+  // the binary tree is only needed to build the wide one
+  if (width != 2) {
+    nodes.clear();
+    nodes.shrink_to_fit();
+  }
+}
+
+void BVHAccel::buildBinary() {
+  auto nPrims = getPrimitiveCount();
   auto primInfos = std::make_unique<PrimInfo[]>(nPrims);
   indices.resize(nPrims);
-  auto primIndex = 0u;
-  for (auto mesh : meshes)
-    for (std::uint32_t i = 0, n = mesh->getPrimitiveCount(); i < n; ++i) {
-      primInfos[primIndex] = PrimInfo(mesh->getBounds(i));
-      indices[primIndex] = primIndex;
-      ++primIndex;
-    }
-
-  auto buffer = std::make_unique<std::uint32_t[]>(nPrims);
-  nodes.resize(nPrims * 2);
-  nodes[0].bounds = bounds;
-  auto& task = *new(tbb::task::allocate_root()) BVHBuildTask(
-    nodes, indices.data(), primInfos.get(),
-    0u, indices.data(), indices.data() + nPrims, buffer.get());
-  tbb::task::spawn_root_and_wait(task);
 
-  auto stats = statistics(0u);
-  std::vector<BVHNode> packedNodes;
-  packedNodes.reserve(stats.second);
-  compactNodes(0u, packedNodes);
-  nodes = std::move(packedNodes);
+  // root bounds and centroid bounds, ranges may span several meshes
+  using BoundsPair = std::pair<Bounds3f, Bounds3f>;
+  auto rootBounds = tbb::parallel_reduce(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims, BVHBuilder::GrainSize),
+    BoundsPair(),
+    [&](const tbb::blocked_range<std::uint32_t>& range, BoundsPair result) {
+      auto prim = findPrimitive(range.begin());
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        while (prim.triIndex == meshes[prim.meshIndex]->getPrimitiveCount()) {
+          ++prim.meshIndex;
+          prim.triIndex = 0;
+        }
+        primInfos[i] = PrimInfo(meshes[prim.meshIndex]->getBounds(prim.triIndex++), i);
+        result.first.merge(primInfos[i].bounds);
+        result.second.merge(primInfos[i].center);
+      }
+      return result;
+    },
+    [](const BoundsPair& a, const BoundsPair& b) {
+      return BoundsPair(merge(a.first, b.first), merge(a.second, b.second));
+    }
+  );
+
+  if (builder == ELBVH) {
+    LBVHBuilder lbvh(primInfos.get(), nPrims, rootBounds.second, mortonBits, restructure);
+    lbvh.build(nodes, indices);
+    return;
+  }
+
+  // a subtree only writes the slots it owns, the array is never initialized as a whole
+  auto nSlots = 2 * (std::size_t)nPrims - 1;
+  std::unique_ptr<BVHNode, decltype(&std::free)> sparseNodes(
+    static_cast<BVHNode*>(std::malloc(nSlots * sizeof(BVHNode))), &std::free);
+  if (!sparseNodes)
+    throw std::bad_alloc();
+  std::unique_ptr<std::uint32_t[]> subtreeSizes(new std::uint32_t[nSlots]);
+
+  BVHBuilder builder(primInfos.get(), sparseNodes.get(), subtreeSizes.get());
+  auto nNodes = builder.build(0u, 0u, nPrims, rootBounds.first, rootBounds.second);
+  tbb::parallel_for(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims),
+    [&](const tbb::blocked_range<std::uint32_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i)
+        indices[i] = primInfos[i].index;
+    }
+  );
+
+  nodes.resize(nNodes);
+  compactNodes(sparseNodes.get(), subtreeSizes.get(), 0u, 0u);
+}
+
+void BVHAccel::refit() {
+  auto nPrims = getPrimitiveCount();
+  if (!nPrims) return;
 
+  updateBounds();
   std::cout
-    << "done (took " << timer.elapsedString() << " and "
-    << memString(sizeof(BVHNode) * nodes.size() + sizeof(std::uint32_t) * indices.size())
-    << ", node count = " << stats.second
-    << ", SAH cost = " << stats.first << ")." << std::endl;
+    << "Refitting the BVH (" << meshes.size()
+    << (meshes.size() == 1 ? " shape, " : " shapes, ")
+    << nPrims << " primitives) .. ";
+
+  Timer timer;
+  auto cost = refitNodes();
+  std::cout << tfm::format(
+    "done (took %s, SAH cost = %g, %.2fx the cost after the last build).",
+    timer.elapsedString(), cost, cost / builtCost) << std::endl;
+
+  // the tree degrades as the vertices move away from where it was built
+  if (cost > rebuildThreshold * builtCost) {
+    std::cout << "SAH cost exceeds " << rebuildThreshold << "x the built tree, rebuilding." << std::endl;
+    // trees of moved vertices are never loaded again, they stay out of the cache
+    build(false);
+  }
+}
+
+float BVHAccel::refitNodes() {
+  if (width == 4)
+    return refitWide(nodes4, 0u, 0).second;
+  if (width == 8)
+    return refitWide(nodes8, 0u, 0).second;
+  return refitBinary(0u).second;
+}
+
+std::pair<Bounds3f, float> BVHAccel::refitBinary(std::uint32_t nodeIndex) {
+  auto& node = nodes[nodeIndex];
+  if (node.nPrims) {
+    node.bounds = refitLeaf(node.primsOffset, node.nPrims);
+    return std::make_pair(node.bounds, (float)node.nPrims);
+  }
+
+  std::pair<Bounds3f, float> left, right;
+  auto refitLeft = [&] { left = refitBinary(nodeIndex + 1); };
+  auto refitRight = [&] { right = refitBinary(node.rightChild); };
+  if (node.rightChild - nodeIndex >= BVHBuilder::ParallelThreshold)
+    tbb::parallel_invoke(refitLeft, refitRight);
+  else {
+    refitLeft();
+    refitRight();
+  }
+
+  // same cost as statistics(), the two compare
+  node.bounds = merge(left.first, right.first);
+  return std::make_pair(node.bounds, BVHBuilder::TraversalCost +
+    (left.second * left.first.area() + right.second * right.first.area()) / node.bounds.area());
+}
+
+template <int N>
+std::pair<Bounds3f, float> BVHAccel::refitWide(
+    std::vector<WideBVHNode<N>>& wideNodes, std::uint32_t nodeIndex, int depth) {
+  auto& node = wideNodes[nodeIndex];
+  std::pair<Bounds3f, float> children[N];
+  auto refitChild = [&](int i) {
+    // unused slots refer to neither primitives nor the root
+    if (node.nPrims[i])
+      children[i] = std::make_pair(refitLeaf(node.children[i], node.nPrims[i]), (float)node.nPrims[i]);
+    else if (node.children[i])
+      children[i] = refitWide(wideNodes, node.children[i], depth + 1);
+  };
+  if (depth < RefitParallelDepth)
+    tbb::parallel_for(0, N, refitChild);
+  else
+    for (auto i = 0; i < N; ++i)
+      refitChild(i);
+
+  Bounds3f bounds;
+  auto cost = 0.0f;
+  for (auto i = 0; i < N; ++i) {
+    if (!node.nPrims[i] && !node.children[i]) continue;
+    node.setBounds(i, children[i].first);
+    bounds.merge(children[i].first);
+    cost += children[i].second * children[i].first.area();
+  }
+  return std::make_pair(bounds, BVHBuilder::TraversalCost + cost / bounds.area());
+}
+
+Bounds3f BVHAccel::refitLeaf(std::uint32_t primsOffset, std::uint32_t nPrims) {
+  Bounds3f bounds;
+  if (!useTriangleBlocks) {
+    for (std::uint32_t i = 0; i < nPrims; ++i) {
+      auto& prim = prims[primsOffset + i];
+      bounds.merge(meshes[prim.meshIndex]->getBounds(prim.triIndex));
+    }
+    return bounds;
+  }
+
+  for (std::uint32_t i = 0; i < nPrims; ++i) {
+    auto& block = triangleBlocks[primsOffset + i / TriangleBlockSize];
+    auto lane = i % TriangleBlockSize;
+    auto prim = block.prims[lane];
+    Vector3f a, b, c;
+    meshes[prim.meshIndex]->getVertices(prim.triIndex, a, b, c);
+    block.set(lane, prim, a, b, c);
+    bounds.merge(merge(Bounds3f(min(a, b), max(a, b)), c));
+  }
+  return bounds;
+}
+
+std::uint64_t BVHAccel::hashGeometry() const {
+  constexpr std::uint32_t ChunkSize = 1 << 16;
+  static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be three packed floats");
+
+  // trees of different builders get different files and do not replace each other
+  auto hash = mixBits(((std::uint64_t)builderId() << 40) ^ ((std::uint64_t)BVHCacheVersion << 32) ^ meshes.size());
+  std::vector<std::uint64_t> chunkHashes;
+  for (auto mesh : meshes) {
+    auto nPrims = mesh->getPrimitiveCount();
+    // chunks are hashed in parallel and combined in order
+    chunkHashes.assign((nPrims + ChunkSize - 1) / ChunkSize, 0);
+    tbb::parallel_for(std::size_t(0), chunkHashes.size(), [&](std::size_t chunk) {
+      auto h = mixBits(chunk);
+      auto end = (std::uint32_t)std::min<std::size_t>(nPrims, (chunk + 1) * ChunkSize);
+      for (auto i = (std::uint32_t)(chunk * ChunkSize); i < end; ++i) {
+        Vector3f v[3];
+        mesh->getVertices(i, v[0], v[1], v[2]);
+        std::uint32_t words[9];
+        std::memcpy(words, v, sizeof(words));
+        for (auto word : words)
+          h = mixBits(h ^ word);
+      }
+      chunkHashes[chunk] = h;
+    });
+    hash = mixBits(hash ^ nPrims);
+    for (auto h : chunkHashes)
+      hash = mixBits(hash ^ h);
+  }
+  return hash;
+}
+
+std::string BVHAccel::cacheFileName(std::uint64_t hash) const {
+  // relative to the directory of the scene
+  filesystem::path dir(cacheDir);
+  auto resolver = getFileResolver();
+  if (!dir.is_absolute() && resolver->size())
+    dir = *resolver->begin() / dir;
+  if (!dir.exists())
+    filesystem::create_directory(dir);
+  return (dir / tfm::format("bvh_%016x.cache", hash)).str();
+}
+
+bool BVHAccel::loadCache(const std::string& filename, std::uint64_t hash) {
+  if (!filesystem::path(filename).exists()) return false;
+
+  try {
+    MappedFile file(filename);
+    BVHCacheHeader header;
+    if (file.size() < sizeof(header)) return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    auto nPrims = getPrimitiveCount();
+    auto expected = makeCacheHeader(hash, nPrims, header.nNodes, builderId());
+    if (std::memcmp(&header, &expected, sizeof(header)) ||
+        file.size() != sizeof(header) + header.nNodes * sizeof(BVHNode) + nPrims * sizeof(std::uint32_t))
+      return false;
+
+    auto data = file.data() + sizeof(header);
+    nodes.resize(header.nNodes);
+    std::memcpy(nodes.data(), data, header.nNodes * sizeof(BVHNode));
+    data += header.nNodes * sizeof(BVHNode);
+    indices.resize(nPrims);
+    std::memcpy(indices.data(), data, nPrims * sizeof(std::uint32_t));
+    return true;
+  } catch (const std::exception& e) {
+    std::cerr << "BVHAccel: ignoring cache file \"" << filename << "\": " << e.what() << std::endl;
+    return false;
+  }
+}
+
+void BVHAccel::saveCache(const std::string& filename, std::uint64_t hash) const {
+  // written next to its final name first, a cache file is never seen half written
+  auto tmpName = filename + ".partial";
+  auto header = makeCacheHeader(hash, (std::uint32_t)indices.size(), (std::uint32_t)nodes.size(), builderId());
+  auto file = std::fopen(tmpName.c_str(), "wb");
+  auto written = file &&
+    std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+    std::fwrite(nodes.data(), sizeof(BVHNode), nodes.size(), file) == nodes.size() &&
+    std::fwrite(indices.data(), sizeof(std::uint32_t), indices.size(), file) == indices.size();
+  if (file && std::fclose(file)) written = false;
+
+  if (written) {
+    // rename does not replace an existing file on windows
+    std::remove(filename.c_str());
+    written = !std::rename(tmpName.c_str(), filename.c_str());
+  }
+  if (!written) {
+    std::remove(tmpName.c_str());
+    std::cerr << "BVHAccel: unable to write cache file \"" << filename << "\"" << std::endl;
+  }
 }
 
 std::pair<float, std::uint32_t> BVHAccel::statistics(std::uint32_t nodeIndex) const {
   auto& node = nodes[nodeIndex];
   if (node.nPrims)
     return std::make_pair((float)node.nPrims, 1u);
-  auto left = statistics(nodeIndex + 1);
-  auto right = statistics(node.rightChild);
+
+  std::pair<float, std::uint32_t> left, right;
+  auto visitLeft = [&] { left = statistics(nodeIndex + 1); };
+  auto visitRight = [&] { right = statistics(node.rightChild); };
+  // the left subtree spans the nodes up to the right child
+  if (node.rightChild - nodeIndex >= BVHBuilder::ParallelThreshold)
+    tbb::parallel_invoke(visitLeft, visitRight);
+  else {
+    visitLeft();
+    visitRight();
+  }
+
   auto totalArea = node.bounds.area();
   auto leftArea = nodes[nodeIndex + 1].bounds.area();
   auto rightArea = nodes[node.rightChild].bounds.area();
   return std::make_pair(
-    BVHBuildTask::TraversalCost + (left.first * leftArea + right.first * rightArea) / totalArea,
+    BVHBuilder::TraversalCost + (left.first * leftArea + right.first * rightArea) / totalArea,
     left.second + right.second + 1
   );
 }
 
-void BVHAccel::compactNodes(std::uint32_t nodeIndex, std::vector<BVHNode>& packedNodes) const {
-  packedNodes.push_back(nodes[nodeIndex]);
-  auto& node = packedNodes.back();
+void BVHAccel::benchmarkMeshLookup() const {
+  constexpr auto Repeats = 16;
+
+  // resolve every primitive in leaf order, like a traversal would
+  auto lookup = [&](auto&& resolve) {
+    std::uintptr_t checksum = 0;
+    Timer timer;
+    for (auto r = 0; r < Repeats; ++r)
+      for (std::uint32_t i = 0, n = (std::uint32_t)indices.size(); i < n; ++i)
+        checksum += resolve(i);
+    auto elapsed = timer.elapsed();
+    return std::make_pair(elapsed * 1e6 / ((double)Repeats * indices.size()), checksum);
+  };
+
+  std::cout << "Benchmarking mesh lookup (" << meshes.size() << " shapes) .. ";
+  auto search = lookup([&](std::uint32_t i) {
+    auto triIndex = indices[i];
+    auto mesh = findMesh(triIndex);
+    return (std::uintptr_t)mesh + triIndex;
+  });
+  auto direct = lookup([&](std::uint32_t i) {
+    auto& prim = prims[i];
+    return (std::uintptr_t)meshes[prim.meshIndex] + prim.triIndex;
+  });
+  if (search.second != direct.second)
+    throw Exception("BVHAccel: mesh lookup mismatch!");
+  std::cout << tfm::format(
+    "done (binary search: %.2f ns, direct: %.2f ns, speedup = %.2fx).",
+    search.first, direct.first, search.first / direct.first) << std::endl;
+}
+
+void BVHAccel::compactNodes(
+    const BVHNode* sparseNodes, const std::uint32_t* subtreeSizes,
+    std::uint32_t nodeIndex, std::uint32_t packedIndex) {
+  auto& node = nodes[packedIndex] = sparseNodes[nodeIndex];
   if (node.nPrims) return;
-  compactNodes(nodeIndex + 1, packedNodes);
-  auto rightChild = node.rightChild;
-  node.rightChild = packedNodes.size();
-  compactNodes(rightChild, packedNodes);
+
+  // depth first order, the right subtree follows the left one
+  auto left = nodeIndex + 1;
+  auto right = node.rightChild;
+  auto leftSize = sparseNodes[left].nPrims ? 1u : subtreeSizes[left];
+  node.rightChild = packedIndex + 1 + leftSize;
+
+  auto compactLeft = [&] { compactNodes(sparseNodes, subtreeSizes, left, packedIndex + 1); };
+  auto compactRight = [&] { compactNodes(sparseNodes, subtreeSizes, right, node.rightChild); };
+  if (subtreeSizes[nodeIndex] >= BVHBuilder::ParallelThreshold)
+    tbb::parallel_invoke(compactLeft, compactRight);
+  else {
+    compactLeft();
+    compactRight();
+  }
+}
+
+template <int N>
+void BVHAccel::collapse(std::vector<WideBVHNode<N>>& wideNodes) const {
+  wideNodes.clear();
+  wideNodes.reserve(nodes.size() / (N - 1) + 1);
+
+  auto emit = [&](auto& emit, std::uint32_t nodeIndex) -> std::uint32_t {
+    std::uint32_t slots[N];
+    auto count = 0;
+    auto& node = nodes[nodeIndex];
+    if (node.nPrims)
+      slots[count++] = nodeIndex;
+    else {
+      slots[count++] = nodeIndex + 1;
+      slots[count++] = node.rightChild;
+    }
+
+    // greedily open the interior child with the largest surface area
+    while (count < N) {
+      auto best = -1;
+      auto bestArea = -1.0f;
+      for (auto i = 0; i < count; ++i) {
+        auto& child = nodes[slots[i]];
+        if (!child.nPrims && child.bounds.area() > bestArea) {
+          bestArea = child.bounds.area();
+          best = i;
+        }
+      }
+      if (best == -1) break;
+      auto rightChild = nodes[slots[best]].rightChild;
+      ++slots[best];
+      slots[count++] = rightChild;
+    }
+
+    auto wideIndex = (std::uint32_t)wideNodes.size();
+    wideNodes.emplace_back();
+    for (auto i = 0; i < count; ++i) {
+      auto& child = nodes[slots[i]];
+      wideNodes[wideIndex].setBounds(i, child.bounds);
+      if (child.nPrims) {
+        wideNodes[wideIndex].children[i] = child.primsOffset;
+        wideNodes[wideIndex].nPrims[i] = child.nPrims;
+      } else {
+        auto childIndex = emit(emit, slots[i]);
+        wideNodes[wideIndex].children[i] = childIndex;
+      }
+    }
+
+    return wideIndex;
+  };
+
+  if (!nodes.empty())
+    emit(emit, 0u);
+}
+
+void BVHAccel::buildTriangleBlocks() {
+  std::vector<std::uint32_t> leaves;
+  std::vector<std::uint32_t> blockOffsets(1, 0u);
+  for (std::uint32_t i = 0, n = (std::uint32_t)nodes.size(); i < n; ++i)
+    if (nodes[i].nPrims) {
+      leaves.push_back(i);
+      blockOffsets.push_back(blockOffsets.back() + (nodes[i].nPrims + TriangleBlockSize - 1) / TriangleBlockSize);
+    }
+
+  // unused lanes must be empty after a rebuild too
+  triangleBlocks.clear();
+  triangleBlocks.resize(blockOffsets.back());
+  tbb::parallel_for(
+    tbb::blocked_range<std::size_t>(0, leaves.size()),
+    [&](const tbb::blocked_range<std::size_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        auto& node = nodes[leaves[i]];
+        for (std::uint32_t j = 0; j < node.nPrims; ++j) {
+          auto& prim = prims[node.primsOffset + j];
+          Vector3f a, b, c;
+          meshes[prim.meshIndex]->getVertices(prim.triIndex, a, b, c);
+          auto& block = triangleBlocks[blockOffsets[i] + j / TriangleBlockSize];
+          block.set(j % TriangleBlockSize, prim, a, b, c);
+        }
+        // leaves now refer to their first triangle block
+        node.primsOffset = blockOffsets[i];
+      }
+    }
+  );
+}
+
+bool BVHAccel::intersectLeaf(
+    std::uint32_t primsOffset, std::uint32_t nPrims,
+    const Ray& ray, const TriangleRay& triRay,
+    Interaction& isect, PrimitiveRef& prim) const {
+
+  auto hit = false;
+
+  if (useTriangleBlocks) {
+    using FloatK = FloatN<TriangleBlockSize>;
+    alignas(sizeof(FloatK)) float ts[TriangleBlockSize];
+    alignas(sizeof(FloatK)) float us[TriangleBlockSize];
+    alignas(sizeof(FloatK)) float vs[TriangleBlockSize];
+    auto nBlocks = (nPrims + TriangleBlockSize - 1) / TriangleBlockSize;
+    for (std::uint32_t i = 0; i < nBlocks; ++i) {
+      auto& block = triangleBlocks[primsOffset + i];
+      FloatK t, u, v;
+      auto mask = intersectTriangles(block, triRay, ray.tMax, t, u, v);
+      if (!mask) continue;
+      t.store(ts);
+      u.store(us);
+      v.store(vs);
+      for (auto lane = 0; lane < TriangleBlockSize; ++lane)
+        if ((mask & (1 << lane)) && ts[lane] <= ray.tMax) {
+          ray.tMax = ts[lane];
+          isect.uv = Vector2f(us[lane], vs[lane]);
+          prim = block.prims[lane];
+          hit = true;
+        }
+    }
+    return hit;
+  }
+
+  for (std::uint32_t i = 0; i < nPrims; ++i) {
+    auto& candidate = prims[primsOffset + i];
+    if (meshes[candidate.meshIndex]->intersect(candidate.triIndex, ray, isect)) {
+      prim = candidate;
+      hit = true;
+    }
+  }
+  return hit;
+}
+
+bool BVHAccel::intersectLeaf(
+    std::uint32_t primsOffset, std::uint32_t nPrims,
+    const Ray& ray, const TriangleRay& triRay) const {
+
+  if (useTriangleBlocks) {
+    using FloatK = FloatN<TriangleBlockSize>;
+    auto nBlocks = (nPrims + TriangleBlockSize - 1) / TriangleBlockSize;
+    for (std::uint32_t i = 0; i < nBlocks; ++i) {
+      FloatK t, u, v;
+      if (intersectTriangles(triangleBlocks[primsOffset + i], triRay, ray.tMax, t, u, v))
+        return true;
+    }
+    return false;
+  }
+
+  for (std::uint32_t i = 0; i < nPrims; ++i) {
+    auto& prim = prims[primsOffset + i];
+    if (meshes[prim.meshIndex]->intersect(prim.triIndex, ray))
+      return true;
+  }
+  return false;
 }
 
 bool BVHAccel::intersect(const Ray& ray, Interaction& isect) const {
+  switch (width) {
+    case 4:  return intersectWide(nodes4, ray, isect);
+    case 8:  return intersectWide(nodes8, ray, isect);
+    default: return intersectBinary(ray, isect);
+  }
+}
+
+bool BVHAccel::intersect(const Ray& ray) const {
+  switch (width) {
+    case 4:  return intersectWide(nodes4, ray);
+    case 8:  return intersectWide(nodes8, ray);
+    default: return intersectBinary(ray);
+  }
+}
+
+bool BVHAccel::intersectBinary(const Ray& ray, Interaction& isect) const {
   if (nodes.empty()) return false;
 
   Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
   const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+  TriangleRay triRay(ray);
 
   auto hit = false;
-  std::uint32_t index;
-  std::uint32_t nodesToVisit[64];
+  PrimitiveRef prim;
+  std::uint32_t nodesToVisit[StackSize];
   nodesToVisit[0] = 0u;
   std::uint32_t currentIndex;
   int toVisitOffset = 0;
@@ -318,15 +1035,8 @@ bool BVHAccel::intersect(const Ray& ray, Interaction& isect) const {
     auto& node = nodes[currentIndex];
     if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
       if (node.nPrims) {
-        for (std::uint32_t i = 0, n = (std::uint32_t)node.nPrims; i < n; ++i) {
-          auto triIndex = indices[node.primsOffset + i];
-          auto mesh = findMesh(triIndex);
-          if (mesh->intersect(triIndex, ray, isect)) {
-            index = triIndex;
-            hit = true;
-            isect.mesh = mesh;
-          }
-        }
+        if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRay, isect, prim))
+          hit = true;
       } else {
         if (dirIsNeg[node.splitAxis]) {
           nodesToVisit[++toVisitOffset] = currentIndex + 1;
@@ -340,20 +1050,22 @@ bool BVHAccel::intersect(const Ray& ray, Interaction& isect) const {
   }
 
   if (hit) {
+    isect.mesh = meshes[prim.meshIndex];
     isect.wo = -ray.d;
-    isect.mesh->computeIntersection(index, isect);
+    isect.mesh->computeIntersection(prim.triIndex, isect);
   }
 
   return hit;
 }
 
-bool BVHAccel::intersect(const Ray& ray) const {
+bool BVHAccel::intersectBinary(const Ray& ray) const {
   if (nodes.empty()) return false;
 
   Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
   const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+  TriangleRay triRay(ray);
 
-  std::uint32_t nodesToVisit[64];
+  std::uint32_t nodesToVisit[StackSize];
   nodesToVisit[0] = 0u;
   std::uint32_t currentIndex;
   int toVisitOffset = 0;
@@ -363,12 +1075,8 @@ bool BVHAccel::intersect(const Ray& ray) const {
     auto& node = nodes[currentIndex];
     if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
       if (node.nPrims) {
-        for (std::uint32_t i = 0, n = (std::uint32_t)node.nPrims; i < n; ++i) {
-          auto triIndex = indices[node.primsOffset + i];
-          auto mesh = findMesh(triIndex);
-          if (mesh->intersect(triIndex, ray))
-            return true;
-        }
+        if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRay))
+          return true;
       } else {
         if (dirIsNeg[node.splitAxis]) {
           nodesToVisit[++toVisitOffset] = currentIndex + 1;
@@ -384,4 +1092,502 @@ bool BVHAccel::intersect(const Ray& ray) const {
   return false;
 }
 
+void BVHAccel::intersect(RayBatch& rays, HitBatch& hits) const {
+  // batches run on the binary layout, wide layouts already test all
+  // children of a node at once for a single ray
+  if (width != 2) {
+    Accelerator::intersect(rays, hits);
+    return;
+  }
+
+  hits.resize(rays.size());
+  if (rays.size() >= StreamThreshold) {
+    intersectStream(rays, &hits, nullptr);
+    return;
+  }
+  for (std::size_t first = 0, n = rays.size(); first < n; first += PacketSize)
+    intersectPacket(rays, first, (int)std::min<std::size_t>(PacketSize, n - first), &hits, nullptr);
+}
+
+void BVHAccel::occluded(RayBatch& rays, bool* occluded) const {
+  if (width != 2) {
+    Accelerator::occluded(rays, occluded);
+    return;
+  }
+
+  if (rays.size() >= StreamThreshold) {
+    intersectStream(rays, nullptr, occluded);
+    return;
+  }
+  for (std::size_t first = 0, n = rays.size(); first < n; first += PacketSize)
+    intersectPacket(rays, first, (int)std::min<std::size_t>(PacketSize, n - first), nullptr, occluded);
+}
+
+/**
+ * Masked packet traversal, the bounds of a node are tested against all
+ * rays of the packet at once and the node is entered if any active ray
+ * hits it. Closest hits are searched when hits is given, otherwise the
+ * rays are tested for occlusion only.
+ */
+void BVHAccel::intersectPacket(
+    RayBatch& rays, std::size_t first, int count,
+    HitBatch* hits, bool* occluded) const {
+
+  using FloatP = FloatN<PacketSize>;
+
+  alignas(sizeof(FloatP)) float o[3][PacketSize];
+  alignas(sizeof(FloatP)) float invDir[3][PacketSize];
+  alignas(sizeof(FloatP)) float tMax[PacketSize];
+  TriangleRay triRays[PacketSize];
+  PrimitiveRef prims[PacketSize];
+
+  for (auto i = 0; i < PacketSize; ++i) {
+    // unused lanes repeat the first ray and stay inactive
+    auto index = first + (i < count ? i : 0);
+    for (auto axis = 0; axis < 3; ++axis) {
+      o[axis][i] = rays.o[axis][index];
+      invDir[axis][i] = 1 / rays.d[axis][index];
+    }
+    tMax[i] = rays.tMax[index];
+    triRays[i] = TriangleRay(rays.get(index));
+    if (i < count) {
+      if (hits) hits->hit[index] = false;
+      else occluded[index] = false;
+    }
+  }
+
+  FloatP po[3], pInvDir[3];
+  for (auto axis = 0; axis < 3; ++axis) {
+    po[axis] = FloatP::load(o[axis]);
+    pInvDir[axis] = FloatP::load(invDir[axis]);
+  }
+
+  struct PacketStackItem {
+    std::uint32_t nodeIndex;
+    int mask;
+  };
+
+  auto active = (1 << count) - 1;
+  auto hitMask = 0;
+  PacketStackItem nodesToVisit[StackSize];
+  nodesToVisit[0] = { 0u, active };
+  int toVisitOffset = 0;
+
+  while (toVisitOffset != -1 && active) {
+    auto item = nodesToVisit[toVisitOffset--];
+    auto& node = nodes[item.nodeIndex];
+
+    auto t0 = FloatP(0.0f);
+    auto t1 = FloatP::load(tMax);
+    for (auto axis = 0; axis < 3; ++axis) {
+      auto tNear = (FloatP(node.bounds.pMin[axis]) - po[axis]) * pInvDir[axis];
+      auto tFar = (FloatP(node.bounds.pMax[axis]) - po[axis]) * pInvDir[axis];
+      t0 = max(min(tNear, tFar), t0);
+      t1 = min(max(tNear, tFar), t1);
+    }
+    auto mask = movemask(t0 <= t1) & item.mask & active;
+    if (!mask) continue;
+
+    if (node.nPrims) {
+      for (auto lane = 0; lane < count; ++lane) {
+        if (!(mask & (1 << lane))) continue;
+        auto index = first + lane;
+        auto ray = rays.get(index);
+        ray.tMax = tMax[lane];
+        if (hits) {
+          if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRays[lane], hits->isects[index], prims[lane])) {
+            tMax[lane] = ray.tMax;
+            hitMask |= 1 << lane;
+          }
+        } else if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRays[lane])) {
+          occluded[index] = true;
+          active &= ~(1 << lane);
+        }
+      }
+      continue;
+    }
+
+    // visit the near child first, as seen by the first active ray
+    auto lane = 0;
+    while (!(mask & (1 << lane))) ++lane;
+    if (invDir[node.splitAxis][lane] < 0) {
+      nodesToVisit[++toVisitOffset] = { item.nodeIndex + 1, mask };
+      nodesToVisit[++toVisitOffset] = { node.rightChild, mask };
+    } else {
+      nodesToVisit[++toVisitOffset] = { node.rightChild, mask };
+      nodesToVisit[++toVisitOffset] = { item.nodeIndex + 1, mask };
+    }
+  }
+
+  if (!hits) return;
+  for (auto lane = 0; lane < count; ++lane) {
+    if (!(hitMask & (1 << lane))) continue;
+    auto index = first + lane;
+    auto& isect = hits->isects[index];
+    rays.tMax[index] = tMax[lane];
+    hits->hit[index] = true;
+    isect.mesh = meshes[prims[lane].meshIndex];
+    isect.wo = -rays.get(index).d;
+    isect.mesh->computeIntersection(prims[lane].triIndex, isect);
+  }
+}
+
+/**
+ * Stream traversal for large batches, the rays are grouped into packets
+ * and every node filters the list of packets which reached it, so that
+ * each node and leaf is fetched once for all of its rays.
+ */
+void BVHAccel::intersectStream(RayBatch& rays, HitBatch* hits, bool* occluded) const {
+  using FloatP = FloatN<PacketSize>;
+
+  struct alignas(sizeof(FloatP)) StreamPacket {
+    float o[3][PacketSize];
+    float invDir[3][PacketSize];
+    float tMax[PacketSize];
+  };
+
+  struct StreamItem {
+    std::uint32_t nodeIndex;
+    std::uint32_t begin, end;
+  };
+
+  struct StreamEntry {
+    std::uint32_t packet;
+    int mask;
+  };
+
+  auto nRays = (std::uint32_t)rays.size();
+  auto nPackets = (nRays + PacketSize - 1) / PacketSize;
+  std::vector<StreamPacket> packets(nPackets);
+  std::vector<TriangleRay> triRays(nRays);
+  std::vector<PrimitiveRef> prims(hits ? nRays : 0);
+
+  // ray lists are allocated like a stack, an item owns everything after it
+  std::vector<StreamEntry> entries(nPackets);
+  entries.reserve(nPackets * 8);
+
+  for (std::uint32_t p = 0; p < nPackets; ++p) {
+    auto count = std::min<std::uint32_t>(PacketSize, nRays - p * PacketSize);
+    for (auto i = 0; i < PacketSize; ++i) {
+      // unused lanes repeat the first ray of the packet and stay inactive
+      auto index = p * PacketSize + (i < (int)count ? i : 0);
+      for (auto axis = 0; axis < 3; ++axis) {
+        packets[p].o[axis][i] = rays.o[axis][index];
+        packets[p].invDir[axis][i] = 1 / rays.d[axis][index];
+      }
+      packets[p].tMax[i] = rays.tMax[index];
+    }
+    entries[p] = { p, (1 << count) - 1 };
+  }
+  for (std::uint32_t i = 0; i < nRays; ++i) {
+    triRays[i] = TriangleRay(rays.get(i));
+    if (hits) hits->hit[i] = false;
+    else occluded[i] = false;
+  }
+
+  std::vector<StreamItem> nodesToVisit;
+  nodesToVisit.push_back({ 0u, 0u, nPackets });
+
+  while (!nodesToVisit.empty()) {
+    auto item = nodesToVisit.back();
+    nodesToVisit.pop_back();
+    entries.resize(item.end);
+    auto& node = nodes[item.nodeIndex];
+
+    FloatP pMin[3], pMax[3];
+    for (auto axis = 0; axis < 3; ++axis) {
+      pMin[axis] = FloatP(node.bounds.pMin[axis]);
+      pMax[axis] = FloatP(node.bounds.pMax[axis]);
+    }
+
+    auto begin = (std::uint32_t)entries.size();
+    for (auto i = item.begin; i != item.end; ++i) {
+      auto entry = entries[i];
+      auto& packet = packets[entry.packet];
+      auto t0 = FloatP(0.0f);
+      auto t1 = FloatP::load(packet.tMax);
+      for (auto axis = 0; axis < 3; ++axis) {
+        auto o = FloatP::load(packet.o[axis]);
+        auto invDir = FloatP::load(packet.invDir[axis]);
+        auto tNear = (pMin[axis] - o) * invDir;
+        auto tFar = (pMax[axis] - o) * invDir;
+        t0 = max(min(tNear, tFar), t0);
+        t1 = min(max(tNear, tFar), t1);
+      }
+      auto mask = movemask(t0 <= t1) & entry.mask;
+      if (mask) entries.push_back({ entry.packet, mask });
+    }
+    auto end = (std::uint32_t)entries.size();
+    if (begin == end) continue;
+
+    if (node.nPrims) {
+      for (auto i = begin; i != end; ++i) {
+        auto entry = entries[i];
+        auto& packet = packets[entry.packet];
+        for (auto lane = 0; lane < PacketSize; ++lane) {
+          if (!(entry.mask & (1 << lane))) continue;
+          auto r = entry.packet * PacketSize + lane;
+          if (occluded && occluded[r]) continue;
+          auto ray = rays.get(r);
+          ray.tMax = packet.tMax[lane];
+          if (hits) {
+            if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRays[r], hits->isects[r], prims[r])) {
+              packet.tMax[lane] = ray.tMax;
+              hits->hit[r] = true;
+            }
+          } else if (intersectLeaf(node.primsOffset, node.nPrims, ray, triRays[r])) {
+            // occluded rays leave the stream
+            occluded[r] = true;
+            packet.tMax[lane] = -1.0f;
+          }
+        }
+      }
+      continue;
+    }
+
+    auto& first = entries[begin];
+    auto lane = 0;
+    while (!(first.mask & (1 << lane))) ++lane;
+    if (packets[first.packet].invDir[node.splitAxis][lane] < 0) {
+      nodesToVisit.push_back({ item.nodeIndex + 1, begin, end });
+      nodesToVisit.push_back({ node.rightChild, begin, end });
+    } else {
+      nodesToVisit.push_back({ node.rightChild, begin, end });
+      nodesToVisit.push_back({ item.nodeIndex + 1, begin, end });
+    }
+  }
+
+  if (!hits) return;
+  for (std::uint32_t r = 0; r < nRays; ++r) {
+    if (!hits->hit[r]) continue;
+    auto& isect = hits->isects[r];
+    rays.tMax[r] = packets[r / PacketSize].tMax[r % PacketSize];
+    isect.mesh = meshes[prims[r].meshIndex];
+    isect.wo = -rays.get(r).d;
+    isect.mesh->computeIntersection(prims[r].triIndex, isect);
+  }
+}
+
+/**
+ * Precomputed ray data for testing all children of a wide node at once
+ */
+template <int N>
+struct WideRay {
+  using FloatV = FloatN<N>;
+
+  WideRay(const Ray& ray) noexcept {
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    for (auto axis = 0; axis < 3; ++axis) {
+      o[axis] = FloatV(ray.o[axis]);
+      d[axis] = FloatV(invDir[axis]);
+      dirIsNeg[axis] = invDir[axis] < 0;
+    }
+  }
+
+  // returns the bit mask of hit children, entry distances are stored in tNear
+  int intersect(const WideBVHNode<N>& node, float tMax, float* tNear) const {
+    auto t0 = max(
+      max(
+        (FloatV::load(node.bounds[dirIsNeg[0]][0]) - o[0]) * d[0],
+        (FloatV::load(node.bounds[dirIsNeg[1]][1]) - o[1]) * d[1]),
+      max(
+        (FloatV::load(node.bounds[dirIsNeg[2]][2]) - o[2]) * d[2],
+        FloatV(0.0f)));
+    auto t1 = min(
+      min(
+        (FloatV::load(node.bounds[1 - dirIsNeg[0]][0]) - o[0]) * d[0],
+        (FloatV::load(node.bounds[1 - dirIsNeg[1]][1]) - o[1]) * d[1]),
+      min(
+        (FloatV::load(node.bounds[1 - dirIsNeg[2]][2]) - o[2]) * d[2],
+        FloatV(tMax)));
+    t0.store(tNear);
+    return movemask(t0 <= t1);
+  }
+
+  FloatV o[3];
+  FloatV d[3];
+  int dirIsNeg[3];
+};
+
+struct WideStackItem {
+  std::uint32_t index;
+  std::uint32_t nPrims;
+  float tNear;
+};
+
+template <int N>
+bool BVHAccel::intersectWide(const std::vector<WideBVHNode<N>>& wideNodes, const Ray& ray, Interaction& isect) const {
+  if (wideNodes.empty()) return false;
+
+  WideRay<N> wideRay(ray);
+  TriangleRay triRay(ray);
+
+  auto hit = false;
+  PrimitiveRef prim;
+  WideStackItem nodesToVisit[StackSize * N];
+  nodesToVisit[0] = { 0u, 0u, 0.0f };
+  int toVisitOffset = 0;
+
+  alignas(sizeof(float) * N) float tNear[N];
+  std::uint32_t hitSlots[N];
+  float hitDists[N];
+
+  while (toVisitOffset != -1) {
+    auto item = nodesToVisit[toVisitOffset--];
+    if (item.tNear > ray.tMax) continue;
+
+    if (item.nPrims) {
+      if (intersectLeaf(item.index, item.nPrims, ray, triRay, isect, prim))
+        hit = true;
+      continue;
+    }
+
+    auto& node = wideNodes[item.index];
+    auto mask = wideRay.intersect(node, ray.tMax, tNear);
+
+    // sort hit children far to near, so that the nearest one is popped first
+    auto count = 0;
+    for (auto i = 0; i < N; ++i) {
+      if (!(mask & (1 << i))) continue;
+      auto j = count++;
+      while (j > 0 && hitDists[j - 1] < tNear[i]) {
+        hitDists[j] = hitDists[j - 1];
+        hitSlots[j] = hitSlots[j - 1];
+        --j;
+      }
+      hitDists[j] = tNear[i];
+      hitSlots[j] = i;
+    }
+
+    for (auto i = 0; i < count; ++i) {
+      auto slot = hitSlots[i];
+      nodesToVisit[++toVisitOffset] = { node.children[slot], node.nPrims[slot], hitDists[i] };
+    }
+  }
+
+  if (hit) {
+    isect.mesh = meshes[prim.meshIndex];
+    isect.wo = -ray.d;
+    isect.mesh->computeIntersection(prim.triIndex, isect);
+  }
+
+  return hit;
+}
+
+template <int N>
+bool BVHAccel::intersectWide(const std::vector<WideBVHNode<N>>& wideNodes, const Ray& ray) const {
+  if (wideNodes.empty()) return false;
+
+  WideRay<N> wideRay(ray);
+  TriangleRay triRay(ray);
+
+  WideStackItem nodesToVisit[StackSize * N];
+  nodesToVisit[0] = { 0u, 0u, 0.0f };
+  int toVisitOffset = 0;
+
+  alignas(sizeof(float) * N) float tNear[N];
+
+  while (toVisitOffset != -1) {
+    auto item = nodesToVisit[toVisitOffset--];
+
+    if (item.nPrims) {
+      if (intersectLeaf(item.index, item.nPrims, ray, triRay))
+        return true;
+      continue;
+    }
+
+    auto& node = wideNodes[item.index];
+    auto mask = wideRay.intersect(node, ray.tMax, tNear);
+    for (auto i = 0; i < N; ++i)
+      if (mask & (1 << i))
+        nodesToVisit[++toVisitOffset] = { node.children[i], node.nPrims[i], tNear[i] };
+  }
+
+  return false;
+}
+
+void BVHAccel::benchmark() const {
+  constexpr auto RayCount = 1 << 18;
+
+  pcg32 random;
+  std::vector<Ray> rays;
+  rays.reserve(RayCount);
+  auto center = bounds.centroid();
+  auto radius = bounds.diag().length();
+  for (auto i = 0; i < RayCount; ++i) {
+    auto o = center + uniformSampleSphere(Vector2f(random.nextFloat(), random.nextFloat())) * radius;
+    auto target = bounds.pMin + bounds.diag() * Vector3f(random.nextFloat(), random.nextFloat(), random.nextFloat());
+    rays.emplace_back(o, normalize(target - o));
+  }
+
+  auto trace = [&](auto&& intersect) {
+    Timer timer;
+    for (auto& ray : rays) {
+      Ray r(ray);
+      Interaction isect;
+      intersect(r, isect);
+    }
+    return RayCount / (timer.elapsed() * 1000.0);
+  };
+
+  std::cout << "Benchmarking BVH traversal (" << RayCount << " incoherent rays) .. ";
+  auto binaryRate = trace([&](const Ray& r, Interaction& isect) { return intersectBinary(r, isect); });
+  auto wideRate = binaryRate;
+  if (width == 4)
+    wideRate = trace([&](const Ray& r, Interaction& isect) { return intersectWide(nodes4, r, isect); });
+  else if (width == 8)
+    wideRate = trace([&](const Ray& r, Interaction& isect) { return intersectWide(nodes8, r, isect); });
+  std::cout << tfm::format(
+    "done (binary: %.2f Mrays/s, %i-wide: %.2f Mrays/s, speedup = %.2fx).",
+    binaryRate, width, wideRate, wideRate / binaryRate) << std::endl;
+
+  // coherent rays of a pinhole camera looking at the scene, traced in tiles
+  constexpr auto Resolution = 512;
+  constexpr auto TileSize = 32;
+  std::vector<RayBatch> tiles;
+  auto eye = center + Vector3f(0.3f, 0.4f, 1.0f) * radius;
+  Frame frame(normalize(center - eye));
+  for (auto ty = 0; ty < Resolution; ty += TileSize)
+    for (auto tx = 0; tx < Resolution; tx += TileSize) {
+      RayBatch tile(TileSize * TileSize);
+      for (auto y = 0; y < TileSize; ++y)
+        for (auto x = 0; x < TileSize; ++x) {
+          auto d = frame.toWorld(Vector3f(
+            ((tx + x + 0.5f) / Resolution - 0.5f) * 0.8f,
+            ((ty + y + 0.5f) / Resolution - 0.5f) * 0.8f,
+            1.0f));
+          tile.set(y * TileSize + x, Ray(eye, normalize(d)));
+        }
+      tiles.push_back(std::move(tile));
+    }
+
+  auto traceTiles = [&](auto&& intersect) {
+    auto batches = tiles;
+    HitBatch hits;
+    hits.resize(TileSize * TileSize);
+    Timer timer;
+    for (auto& tile : batches)
+      intersect(tile, hits);
+    return Resolution * Resolution / (timer.elapsed() * 1000.0);
+  };
+
+  std::cout << "Benchmarking batched traversal (" << Resolution * Resolution << " coherent rays) .. ";
+  auto singleRate = traceTiles([&](RayBatch& tile, HitBatch& hits) {
+    for (std::size_t i = 0; i < tile.size(); ++i) {
+      auto ray = tile.get(i);
+      hits.hit[i] = intersectBinary(ray, hits.isects[i]);
+    }
+  });
+  auto packetRate = traceTiles([&](RayBatch& tile, HitBatch& hits) {
+    for (std::size_t first = 0; first < tile.size(); first += PacketSize)
+      intersectPacket(tile, first, PacketSize, &hits, nullptr);
+  });
+  auto streamRate = traceTiles([&](RayBatch& tile, HitBatch& hits) {
+    intersectStream(tile, &hits, nullptr);
+  });
+  std::cout << tfm::format(
+    "done (single: %.2f Mrays/s, %i-ray packets: %.2f Mrays/s, streams: %.2f Mrays/s).",
+    singleRate, PacketSize, packetRate, streamRate) << std::endl;
+}
+
 }
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#include <minpt/core/timer.h>
+#include <minpt/accels/instancebvh.h>
+
+namespace minpt {
+
+void InstanceBVH::build(const std::vector<Instance*>& instances) {
+  nodes.clear();
+  this->instances.clear();
+  bounds.reset();
+  if (instances.empty()) return;
+
+  std::cout << "Constructing a SAH BVH over " << instances.size() << " instances .. ";
+  Timer timer;
+
+  std::vector<Bounds3f> instanceBounds(instances.size());
+  for (std::size_t i = 0; i < instances.size(); ++i)
+    instanceBounds[i] = instances[i]->getBoundingBox();
+
+  std::vector<std::uint32_t> order(instances.size());
+  std::iota(order.begin(), order.end(), 0u);
+  nodes.reserve(2 * instances.size());
+  buildRecursive(order, 0, (std::uint32_t)order.size(), instanceBounds, 0);
+  bounds = nodes[0].bounds;
+
+  // leaves refer to ranges of instances in the order of the build
+  this->instances.reserve(instances.size());
+  for (auto i : order)
+    this->instances.push_back(instances[i]);
+
+  std::cout
+    << "done (took " << timer.elapsedString() << " and "
+    << memString(sizeof(BVHNode) * nodes.size() + sizeof(Instance*) * instances.size())
+    << ", node count = " << nodes.size() << ")." << std::endl;
+}
+
+std::uint32_t InstanceBVH::buildRecursive(
+    std::vector<std::uint32_t>& order, std::uint32_t begin, std::uint32_t end,
+    const std::vector<Bounds3f>& instanceBounds, int depth) {
+  auto nodeIndex = (std::uint32_t)nodes.size();
+  nodes.emplace_back();
+
+  Bounds3f nodeBounds, centroidBounds;
+  for (auto i = begin; i < end; ++i) {
+    nodeBounds.merge(instanceBounds[order[i]]);
+    centroidBounds.merge(instanceBounds[order[i]].centroid());
+  }
+
+  auto count = end - begin;
+  if (count == 1) {
+    nodes[nodeIndex] = BVHNode(nodeBounds, begin, (std::uint16_t)count);
+    return nodeIndex;
+  }
+
+  auto axis = centroidBounds.majorAxis();
+  auto extent = centroidBounds.pMax[axis] - centroidBounds.pMin[axis];
+  // instances on top of each other are split in the middle of the range
+  auto mid = begin + count / 2;
+
+  // median splits from here on still end in leaves of one instance at MaxDepth
+  auto balancedDepth = 0;
+  while (((std::uint64_t)1 << balancedDepth) < count) ++balancedDepth;
+
+  if (depth + balancedDepth >= MaxDepth) {
+    std::nth_element(
+      order.begin() + begin, order.begin() + mid, order.begin() + end,
+      [&](std::uint32_t a, std::uint32_t b) {
+        return instanceBounds[a].centroid()[axis] < instanceBounds[b].centroid()[axis];
+      });
+  } else if (extent > 0) {
+    auto binIndex = [&](std::uint32_t i) {
+      auto bin = (int)(BinCount * (instanceBounds[i].centroid()[axis] - centroidBounds.pMin[axis]) / extent);
+      return std::min(bin, BinCount - 1);
+    };
+
+    std::uint32_t counts[BinCount] = {};
+    Bounds3f binBounds[BinCount];
+    for (auto i = begin; i < end; ++i) {
+      auto bin = binIndex(order[i]);
+      ++counts[bin];
+      binBounds[bin].merge(instanceBounds[order[i]]);
+    }
+
+    // sweeps the bins from the right, then evaluates the splits from the left
+    float rightArea[BinCount];
+    std::uint32_t rightCount[BinCount];
+    Bounds3f sweep;
+    std::uint32_t n = 0;
+    for (auto bin = BinCount - 1; bin > 0; --bin) {
+      sweep.merge(binBounds[bin]);
+      n += counts[bin];
+      rightArea[bin] = sweep.area();
+      rightCount[bin] = n;
+    }
+
+    auto invArea = 1 / std::max(nodeBounds.area(), std::numeric_limits<float>::min());
+    auto bestCost = std::numeric_limits<float>::infinity();
+    auto bestSplit = 1;
+    sweep.reset();
+    n = 0;
+    for (auto bin = 1; bin < BinCount; ++bin) {
+      sweep.merge(binBounds[bin - 1]);
+      n += counts[bin - 1];
+      if (!n || !rightCount[bin]) continue;
+      auto cost = TraversalCost + (n * sweep.area() + rightCount[bin] * rightArea[bin]) * invArea;
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = bin;
+      }
+    }
+
+    if (count <= MaxLeafSize && bestCost >= count) {
+      nodes[nodeIndex] = BVHNode(nodeBounds, begin, (std::uint16_t)count);
+      return nodeIndex;
+    }
+
+    mid = (std::uint32_t)(std::partition(
+      order.begin() + begin, order.begin() + end,
+      [&](std::uint32_t i) { return binIndex(i) < bestSplit; }
+    ) - order.begin());
+  } else if (count <= MaxLeafSize) {
+    nodes[nodeIndex] = BVHNode(nodeBounds, begin, (std::uint16_t)count);
+    return nodeIndex;
+  }
+
+  buildRecursive(order, begin, mid, instanceBounds, depth + 1);
+  auto rightChild = buildRecursive(order, mid, end, instanceBounds, depth + 1);
+  nodes[nodeIndex] = BVHNode(nodeBounds, (std::uint16_t)axis, rightChild);
+  return nodeIndex;
+}
+
+bool InstanceBVH::intersect(const Ray& ray, Interaction& isect) const {
+  if (nodes.empty()) return false;
+
+  Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+  const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+  auto hit = false;
+  std::uint32_t nodesToVisit[StackSize];
+  nodesToVisit[0] = 0u;
+  std::uint32_t currentIndex;
+  int toVisitOffset = 0;
+
+  while (toVisitOffset != -1) {
+    currentIndex = nodesToVisit[toVisitOffset--];
+    auto& node = nodes[currentIndex];
+    if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
+      if (node.nPrims) {
+        // a hit shortens ray.tMax, later instances only report closer hits
+        for (std::uint32_t i = 0; i < node.nPrims; ++i)
+          if (instances[node.primsOffset + i]->intersect(ray, isect))
+            hit = true;
+      } else {
+        if (dirIsNeg[node.splitAxis]) {
+          nodesToVisit[++toVisitOffset] = currentIndex + 1;
+          nodesToVisit[++toVisitOffset] = node.rightChild;
+        } else {
+          nodesToVisit[++toVisitOffset] = node.rightChild;
+          nodesToVisit[++toVisitOffset] = currentIndex + 1;
+        }
+      }
+    }
+  }
+
+  return hit;
+}
+
+bool InstanceBVH::intersect(const Ray& ray) const {
+  if (nodes.empty()) return false;
+
+  Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+  const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+  std::uint32_t nodesToVisit[StackSize];
+  nodesToVisit[0] = 0u;
+  std::uint32_t currentIndex;
+  int toVisitOffset = 0;
+
+  while (toVisitOffset != -1) {
+    currentIndex = nodesToVisit[toVisitOffset--];
+    auto& node = nodes[currentIndex];
+    if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
+      if (node.nPrims) {
+        for (std::uint32_t i = 0; i < node.nPrims; ++i)
+          if (instances[node.primsOffset + i]->intersect(ray))
+            return true;
+      } else {
+        nodesToVisit[++toVisitOffset] = node.rightChild;
+        nodesToVisit[++toVisitOffset] = currentIndex + 1;
+      }
+    }
+  }
+
+  return false;
+}
+
+}
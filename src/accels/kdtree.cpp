@@ -0,0 +1,451 @@
+#include <iostream>
+#include <memory>
+#include <tbb/tbb.h>
+
+#include <minpt/core/timer.h>
+#include <minpt/accels/kdtree.h>
+
+namespace minpt {
+
+/**
+ * \brief Split candidate of the sorted-event builder
+ *
+ * Events are kept sorted by axis, position and type so that a node finds
+ * its best split with one linear sweep, and classifying primitives to the
+ * children preserves the order.
+ * ref http://www.eng.utah.edu/~cs6965/papers/kdtree.pdf
+ */
+struct KdEvent {
+  enum EType : std::uint8_t {
+    EEnd = 0,
+    EPlanar,
+    EStart
+  };
+
+  float pos;
+  std::uint32_t prim;
+  std::uint8_t axis;
+  std::uint8_t type;
+
+  bool operator<(const KdEvent& e) const {
+    if (axis != e.axis) return axis < e.axis;
+    if (pos != e.pos) return pos < e.pos;
+    return type < e.type;
+  }
+};
+
+struct KdBuildNode {
+  int axis = -1;
+  float split;
+  std::unique_ptr<KdBuildNode> children[2];
+  std::vector<std::uint32_t> prims;
+};
+
+class KdTreeBuilder {
+public:
+  enum ESide : std::uint8_t {
+    EBoth = 0,
+    ELeft,
+    ERight
+  };
+
+  struct Split {
+    int axis = -1;
+    float pos;
+    float cost = std::numeric_limits<float>::infinity();
+    bool planarLeft;
+  };
+
+  KdTreeBuilder(
+      const Bounds3f* primBounds,
+      float intersectCost, float traversalCost,
+      float emptyBonus, std::uint32_t maxPrims)
+    : primBounds(primBounds)
+    , intersectCost(intersectCost)
+    , traversalCost(traversalCost)
+    , emptyBonus(emptyBonus)
+    , maxPrims(maxPrims)
+  { }
+
+  static void addEvents(std::vector<KdEvent>& events, const Bounds3f& b, std::uint32_t prim) {
+    for (std::uint8_t axis = 0; axis < 3; ++axis) {
+      if (b.pMin[axis] == b.pMax[axis])
+        events.push_back({ b.pMin[axis], prim, axis, KdEvent::EPlanar });
+      else {
+        events.push_back({ b.pMin[axis], prim, axis, KdEvent::EStart });
+        events.push_back({ b.pMax[axis], prim, axis, KdEvent::EEnd });
+      }
+    }
+  }
+
+  Split findSplit(const Bounds3f& bounds, std::uint32_t nPrims, const std::vector<KdEvent>& events) const {
+    Split best;
+    auto d = bounds.diag();
+    auto totalAreaInv = 1 / bounds.area();
+
+    auto evaluate = [&](int axis, float pos, std::uint32_t nLeft, std::uint32_t nRight, bool planarLeft) {
+      auto o0 = (axis + 1) % 3, o1 = (axis + 2) % 3;
+      auto leftArea = 2 * (d[o0] * d[o1] + (pos - bounds.pMin[axis]) * (d[o0] + d[o1]));
+      auto rightArea = 2 * (d[o0] * d[o1] + (bounds.pMax[axis] - pos) * (d[o0] + d[o1]));
+      auto bonus = (nLeft == 0 || nRight == 0) ? emptyBonus : 0.0f;
+      auto cost = traversalCost + intersectCost * (1 - bonus) *
+        (leftArea * nLeft + rightArea * nRight) * totalAreaInv;
+      if (cost < best.cost) {
+        best.axis = axis;
+        best.pos = pos;
+        best.cost = cost;
+        best.planarLeft = planarLeft;
+      }
+    };
+
+    std::uint32_t nLeft[3] = { 0, 0, 0 };
+    std::uint32_t nRight[3] = { nPrims, nPrims, nPrims };
+
+    for (std::size_t i = 0, n = events.size(); i < n;) {
+      auto axis = events[i].axis;
+      auto pos = events[i].pos;
+      std::uint32_t nEnd = 0, nPlanar = 0, nStart = 0;
+      while (i < n && events[i].axis == axis && events[i].pos == pos && events[i].type == KdEvent::EEnd)
+        ++nEnd, ++i;
+      while (i < n && events[i].axis == axis && events[i].pos == pos && events[i].type == KdEvent::EPlanar)
+        ++nPlanar, ++i;
+      while (i < n && events[i].axis == axis && events[i].pos == pos && events[i].type == KdEvent::EStart)
+        ++nStart, ++i;
+
+      nRight[axis] -= nPlanar + nEnd;
+      // splits on the node boundary would create an empty child of zero volume
+      if (pos > bounds.pMin[axis] && pos < bounds.pMax[axis]) {
+        evaluate(axis, pos, nLeft[axis] + nPlanar, nRight[axis], true);
+        evaluate(axis, pos, nLeft[axis], nRight[axis] + nPlanar, false);
+      }
+      nLeft[axis] += nStart + nPlanar;
+    }
+
+    return best;
+  }
+
+  void build(
+      KdBuildNode& node, const Bounds3f& bounds,
+      std::vector<std::uint32_t> prims, std::vector<KdEvent> events,
+      int depth, int badRefines) const {
+
+    auto nPrims = (std::uint32_t)prims.size();
+    if (nPrims <= maxPrims || depth == 0) {
+      node.prims = std::move(prims);
+      return;
+    }
+
+    auto split = findSplit(bounds, nPrims, events);
+    auto leafCost = intersectCost * nPrims;
+    if (split.cost > leafCost) ++badRefines;
+    if (split.axis == -1 || (split.cost > 4 * leafCost && nPrims < 16) || badRefines == 3) {
+      node.prims = std::move(prims);
+      return;
+    }
+
+    // classify primitives to the children by the events of the split axis
+    std::vector<std::uint8_t> sides(nPrims, EBoth);
+    for (auto& e : events) {
+      if (e.axis != split.axis) continue;
+      if (e.type == KdEvent::EEnd && e.pos <= split.pos)
+        sides[e.prim] = ELeft;
+      else if (e.type == KdEvent::EStart && e.pos >= split.pos)
+        sides[e.prim] = ERight;
+      else if (e.type == KdEvent::EPlanar) {
+        if (e.pos < split.pos || (e.pos == split.pos && split.planarLeft))
+          sides[e.prim] = ELeft;
+        else
+          sides[e.prim] = ERight;
+      }
+    }
+
+    std::vector<std::uint32_t> leftPrims, rightPrims;
+    std::vector<std::uint32_t> leftIndices(nPrims), rightIndices(nPrims);
+    for (std::uint32_t i = 0; i < nPrims; ++i) {
+      if (sides[i] != ERight) {
+        leftIndices[i] = (std::uint32_t)leftPrims.size();
+        leftPrims.push_back(prims[i]);
+      }
+      if (sides[i] != ELeft) {
+        rightIndices[i] = (std::uint32_t)rightPrims.size();
+        rightPrims.push_back(prims[i]);
+      }
+    }
+
+    auto leftBounds = bounds, rightBounds = bounds;
+    leftBounds.pMax[split.axis] = split.pos;
+    rightBounds.pMin[split.axis] = split.pos;
+
+    // events of one sided primitives keep their order, straddling primitives
+    // are clipped to the child bounds and need to be sorted again
+    std::vector<KdEvent> leftOnly, rightOnly, leftBoth, rightBoth;
+    for (auto e : events) {
+      if (sides[e.prim] == ELeft) {
+        e.prim = leftIndices[e.prim];
+        leftOnly.push_back(e);
+      } else if (sides[e.prim] == ERight) {
+        e.prim = rightIndices[e.prim];
+        rightOnly.push_back(e);
+      }
+    }
+    events.clear();
+    events.shrink_to_fit();
+
+    for (std::uint32_t i = 0; i < nPrims; ++i) {
+      if (sides[i] != EBoth) continue;
+      auto& b = primBounds[prims[i]];
+      addEvents(leftBoth, Bounds3f(max(b.pMin, leftBounds.pMin), min(b.pMax, leftBounds.pMax)), leftIndices[i]);
+      addEvents(rightBoth, Bounds3f(max(b.pMin, rightBounds.pMin), min(b.pMax, rightBounds.pMax)), rightIndices[i]);
+    }
+    std::sort(leftBoth.begin(), leftBoth.end());
+    std::sort(rightBoth.begin(), rightBoth.end());
+
+    std::vector<KdEvent> leftEvents, rightEvents;
+    leftEvents.reserve(leftOnly.size() + leftBoth.size());
+    rightEvents.reserve(rightOnly.size() + rightBoth.size());
+    std::merge(leftOnly.begin(), leftOnly.end(), leftBoth.begin(), leftBoth.end(), std::back_inserter(leftEvents));
+    std::merge(rightOnly.begin(), rightOnly.end(), rightBoth.begin(), rightBoth.end(), std::back_inserter(rightEvents));
+    leftOnly = std::vector<KdEvent>();
+    rightOnly = std::vector<KdEvent>();
+    leftBoth = std::vector<KdEvent>();
+    rightBoth = std::vector<KdEvent>();
+    prims = std::vector<std::uint32_t>();
+    sides = std::vector<std::uint8_t>();
+    leftIndices = std::vector<std::uint32_t>();
+    rightIndices = std::vector<std::uint32_t>();
+
+    node.axis = split.axis;
+    node.split = split.pos;
+    node.children[0] = std::make_unique<KdBuildNode>();
+    node.children[1] = std::make_unique<KdBuildNode>();
+
+    auto buildLeft = [&]() {
+      build(*node.children[0], leftBounds, std::move(leftPrims), std::move(leftEvents), depth - 1, badRefines);
+    };
+    auto buildRight = [&]() {
+      build(*node.children[1], rightBounds, std::move(rightPrims), std::move(rightEvents), depth - 1, badRefines);
+    };
+
+    if (nPrims > ParallelThreshold)
+      tbb::parallel_invoke(buildLeft, buildRight);
+    else {
+      buildLeft();
+      buildRight();
+    }
+  }
+
+public:
+  static constexpr std::uint32_t ParallelThreshold = 4096;
+
+private:
+  const Bounds3f* primBounds;
+  float intersectCost;
+  float traversalCost;
+  float emptyBonus;
+  std::uint32_t maxPrims;
+};
+
+KdTreeAccel::KdTreeAccel(const PropertyList& props)
+    : intersectCost(props.getFloat("intersectCost", 80.0f))
+    , traversalCost(props.getFloat("traversalCost", 1.0f))
+    , emptyBonus(props.getFloat("emptyBonus", 0.5f))
+    , maxPrims(props.getInteger("maxPrims", 1))
+    , maxDepth(props.getInteger("maxDepth", -1)) {
+  if (maxPrims < 1)
+    throw Exception("KdTreeAccel: maxPrims must be at least 1!");
+}
+
+void KdTreeAccel::build() {
+  auto nPrims = getPrimitiveCount();
+  if (!nPrims) return;
+
+  // the traversal stack holds at most one entry per level
+  if (maxDepth <= 0)
+    maxDepth = (int)std::round(8 + 1.3f * std::log2((float)nPrims));
+  maxDepth = std::min(maxDepth, 64);
+
+  std::cout
+    << "Constructing a SAH k-d tree (" << meshes.size()
+    << (meshes.size() == 1 ? " shape, " : " shapes, ")
+    << nPrims << " primitives) .. ";
+
+  Timer timer;
+
+  auto primBounds = std::make_unique<Bounds3f[]>(nPrims);
+  std::vector<std::uint32_t> rootPrims(nPrims);
+  auto primIndex = 0u;
+  for (auto mesh : meshes)
+    for (std::uint32_t i = 0, n = mesh->getPrimitiveCount(); i < n; ++i) {
+      primBounds[primIndex] = mesh->getBounds(i);
+      rootPrims[primIndex] = primIndex;
+      ++primIndex;
+    }
+
+  // the events are sorted once, children inherit the order
+  std::vector<KdEvent> events;
+  events.reserve(nPrims * 6);
+  for (std::uint32_t i = 0; i < nPrims; ++i)
+    KdTreeBuilder::addEvents(events, primBounds[i], i);
+  tbb::parallel_sort(events.begin(), events.end());
+
+  KdTreeBuilder builder(primBounds.get(), intersectCost, traversalCost, emptyBonus, maxPrims);
+  KdBuildNode root;
+  builder.build(root, bounds, std::move(rootPrims), std::move(events), maxDepth, 0);
+
+  // flatten depth first, so that left children follow their parents
+  std::uint32_t nLeaves = 0;
+  auto flatten = [&](auto& flatten, const KdBuildNode& node) -> void {
+    auto index = (std::uint32_t)nodes.size();
+    nodes.emplace_back();
+    if (node.axis == -1) {
+      nodes[index] = KdTreeNode((std::uint32_t)prims.size(), (std::uint32_t)node.prims.size());
+      for (auto prim : node.prims)
+        prims.push_back(findPrimitive(prim));
+      ++nLeaves;
+      return;
+    }
+    flatten(flatten, *node.children[0]);
+    nodes[index] = KdTreeNode((std::uint32_t)nodes.size(), node.axis, node.split);
+    flatten(flatten, *node.children[1]);
+  };
+  nodes.clear();
+  prims.clear();
+  flatten(flatten, root);
+
+  std::cout
+    << "done (took " << timer.elapsedString() << " and "
+    << memString(sizeof(KdTreeNode) * nodes.size() + sizeof(PrimitiveRef) * prims.size())
+    << ", node count = " << nodes.size()
+    << ", leaf count = " << nLeaves
+    << ", primitive references = " << prims.size() << ")." << std::endl;
+}
+
+struct KdToVisit {
+  const KdTreeNode* node;
+  float tMin, tMax;
+};
+
+bool KdTreeAccel::intersect(const Ray& ray, Interaction& isect) const {
+  float tMin, tMax;
+  if (nodes.empty() || !bounds.intersect(ray, tMin, tMax)) return false;
+
+  Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+
+  auto hit = false;
+  PrimitiveRef prim;
+  KdToVisit nodesToVisit[64];
+  auto toVisitOffset = 0;
+  auto node = &nodes[0];
+
+  while (node) {
+    // a closer hit was found already
+    if (ray.tMax < tMin) break;
+
+    if (!node->isLeaf()) {
+      auto axis = node->getSplitAxis();
+      auto tPlane = (node->split - ray.o[axis]) * invDir[axis];
+
+      const KdTreeNode* first;
+      const KdTreeNode* second;
+      auto belowFirst =
+        ray.o[axis] < node->split ||
+        (ray.o[axis] == node->split && ray.d[axis] <= 0);
+      if (belowFirst) {
+        first = node + 1;
+        second = &nodes[node->getRightChild()];
+      } else {
+        first = &nodes[node->getRightChild()];
+        second = node + 1;
+      }
+
+      if (tPlane > tMax || tPlane <= 0)
+        node = first;
+      else if (tPlane < tMin)
+        node = second;
+      else {
+        nodesToVisit[toVisitOffset++] = { second, tPlane, tMax };
+        node = first;
+        tMax = tPlane;
+      }
+    } else {
+      for (std::uint32_t i = 0, n = node->getPrimCount(); i < n; ++i) {
+        auto& candidate = prims[node->primsOffset + i];
+        if (meshes[candidate.meshIndex]->intersect(candidate.triIndex, ray, isect)) {
+          prim = candidate;
+          hit = true;
+        }
+      }
+
+      if (toVisitOffset == 0) break;
+      --toVisitOffset;
+      node = nodesToVisit[toVisitOffset].node;
+      tMin = nodesToVisit[toVisitOffset].tMin;
+      tMax = nodesToVisit[toVisitOffset].tMax;
+    }
+  }
+
+  if (hit) {
+    isect.mesh = meshes[prim.meshIndex];
+    isect.wo = -ray.d;
+    isect.mesh->computeIntersection(prim.triIndex, isect);
+  }
+
+  return hit;
+}
+
+bool KdTreeAccel::intersect(const Ray& ray) const {
+  float tMin, tMax;
+  if (nodes.empty() || !bounds.intersect(ray, tMin, tMax)) return false;
+
+  Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+
+  KdToVisit nodesToVisit[64];
+  auto toVisitOffset = 0;
+  auto node = &nodes[0];
+
+  while (node) {
+    if (!node->isLeaf()) {
+      auto axis = node->getSplitAxis();
+      auto tPlane = (node->split - ray.o[axis]) * invDir[axis];
+
+      const KdTreeNode* first;
+      const KdTreeNode* second;
+      auto belowFirst =
+        ray.o[axis] < node->split ||
+        (ray.o[axis] == node->split && ray.d[axis] <= 0);
+      if (belowFirst) {
+        first = node + 1;
+        second = &nodes[node->getRightChild()];
+      } else {
+        first = &nodes[node->getRightChild()];
+        second = node + 1;
+      }
+
+      if (tPlane > tMax || tPlane <= 0)
+        node = first;
+      else if (tPlane < tMin)
+        node = second;
+      else {
+        nodesToVisit[toVisitOffset++] = { second, tPlane, tMax };
+        node = first;
+        tMax = tPlane;
+      }
+    } else {
+      for (std::uint32_t i = 0, n = node->getPrimCount(); i < n; ++i) {
+        auto& prim = prims[node->primsOffset + i];
+        if (meshes[prim.meshIndex]->intersect(prim.triIndex, ray))
+          return true;
+      }
+
+      if (toVisitOffset == 0) break;
+      --toVisitOffset;
+      node = nodesToVisit[toVisitOffset].node;
+      tMin = nodesToVisit[toVisitOffset].tMin;
+      tMax = nodesToVisit[toVisitOffset].tMax;
+    }
+  }
+
+  return false;
+}
+
+}
@@ -0,0 +1,435 @@
+#include <bit>
+#include <tbb/tbb.h>
+
+#include <minpt/accels/lbvh.h>
+
+namespace minpt {
+
+// spreads the low 10 bits of v to every third bit
+static std::uint32_t expandBits(std::uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// spreads the low 21 bits of v to every third bit
+static std::uint64_t expandBits(std::uint64_t v) {
+  v &= 0x1FFFFFull;
+  v = (v | v << 32) & 0x1F00000000FFFFull;
+  v = (v | v << 16) & 0x1F0000FF0000FFull;
+  v = (v | v << 8) & 0x100F00F00F00F00Full;
+  v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+template <typename Key>
+struct MortonPrim {
+  Key code;
+  std::uint32_t prim;
+};
+
+/**
+ * \brief Stable LSD radix sort of Morton codes, eight bits per pass
+ *
+ * Every pass counts the digits of fixed blocks in parallel, turns the
+ * counts into per block offsets and scatters the blocks in parallel.
+ * Passes over a digit all codes share are skipped.
+ */
+template <typename Key>
+static void radixSort(std::vector<MortonPrim<Key>>& items, int nBits, std::size_t blockSize) {
+  constexpr int DigitBits = 8;
+  constexpr std::size_t DigitCount = 1 << DigitBits;
+
+  auto n = items.size();
+  auto nBlocks = (n + blockSize - 1) / blockSize;
+  std::vector<MortonPrim<Key>> buffer(n);
+  std::vector<std::size_t> offsets(nBlocks * DigitCount);
+
+  for (auto shift = 0; shift < nBits; shift += DigitBits) {
+    tbb::parallel_for(std::size_t(0), nBlocks, [&](std::size_t block) {
+      auto counts = &offsets[block * DigitCount];
+      std::fill(counts, counts + DigitCount, 0);
+      auto end = std::min(n, (block + 1) * blockSize);
+      for (auto i = block * blockSize; i < end; ++i)
+        ++counts[(items[i].code >> shift) & (DigitCount - 1)];
+    });
+
+    // digit major prefix sum, the blocks keep their order within a digit
+    std::size_t sum = 0;
+    auto skip = false;
+    for (std::size_t digit = 0; digit < DigitCount && !skip; ++digit) {
+      auto digitStart = sum;
+      for (std::size_t block = 0; block < nBlocks; ++block) {
+        auto count = offsets[block * DigitCount + digit];
+        offsets[block * DigitCount + digit] = sum;
+        sum += count;
+      }
+      skip = sum - digitStart == n;
+    }
+    if (skip) continue;
+
+    tbb::parallel_for(std::size_t(0), nBlocks, [&](std::size_t block) {
+      auto blockOffsets = &offsets[block * DigitCount];
+      auto end = std::min(n, (block + 1) * blockSize);
+      for (auto i = block * blockSize; i < end; ++i)
+        buffer[blockOffsets[(items[i].code >> shift) & (DigitCount - 1)]++] = items[i];
+    });
+    items.swap(buffer);
+  }
+}
+
+LBVHBuilder::LBVHBuilder(
+    const PrimInfo* primInfos, std::uint32_t nPrims,
+    const Bounds3f& centroidBounds, int mortonBits, bool restructure)
+  : primInfos(primInfos)
+  , nPrims(nPrims)
+  , centroidBounds(centroidBounds)
+  , mortonBits(mortonBits)
+  , restructure(restructure)
+{ }
+
+void LBVHBuilder::build(std::vector<BVHNode>& nodes, std::vector<std::uint32_t>& indices) {
+  order.resize(nPrims);
+  children.resize(2 * (std::size_t)(nPrims - 1));
+  parents.resize(2 * (std::size_t)nPrims - 1);
+  if (mortonBits == 30)
+    buildRadixTree<std::uint32_t>();
+  else
+    buildRadixTree<std::uint64_t>();
+
+  computeBounds();
+  limitDepth(0u, 0);
+
+  nodes.resize(nodeCounts[0]);
+  indices.resize(nPrims);
+  emit(nodes, indices, 0u, 0u, 0u);
+}
+
+template <typename Key>
+void LBVHBuilder::buildRadixTree() {
+  constexpr int KeyBits = sizeof(Key) * 8;
+  const auto axisBits = mortonBits / 3;
+  const auto maxCell = (float)((1u << axisBits) - 1);
+
+  Vector3f scale;
+  for (auto axis = 0; axis < 3; ++axis) {
+    auto extent = centroidBounds.pMax[axis] - centroidBounds.pMin[axis];
+    scale[axis] = extent > 0 ? maxCell / extent : 0.0f;
+  }
+
+  std::vector<MortonPrim<Key>> items(nPrims);
+  tbb::parallel_for(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims),
+    [&](const tbb::blocked_range<std::uint32_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        Key cell[3];
+        for (auto axis = 0; axis < 3; ++axis) {
+          auto x = (primInfos[i].center[axis] - centroidBounds.pMin[axis]) * scale[axis];
+          cell[axis] = (Key)std::min(std::max(x, 0.0f), maxCell);
+        }
+        items[i].code = expandBits(cell[0]) << 2 | expandBits(cell[1]) << 1 | expandBits(cell[2]);
+        items[i].prim = i;
+      }
+    }
+  );
+
+  radixSort(items, mortonBits, GrainSize);
+
+  tbb::parallel_for(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims),
+    [&](const tbb::blocked_range<std::uint32_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i)
+        order[i] = items[i].prim;
+    }
+  );
+
+  // length of the common prefix of two codes, equal codes are told apart by their position
+  const auto n = (std::int64_t)nPrims;
+  auto delta = [&](std::int64_t i, std::int64_t j) {
+    if (j < 0 || j >= n) return -1;
+    auto a = items[i].code, b = items[j].code;
+    if (a == b)
+      return KeyBits + std::countl_zero((std::uint32_t)(i ^ j));
+    return std::countl_zero((Key)(a ^ b));
+  };
+
+  // every internal node finds the range of leaves it covers and its split on its own
+  tbb::parallel_for(
+    tbb::blocked_range<std::int64_t>(0, n - 1),
+    [&](const tbb::blocked_range<std::int64_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        auto d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+
+        // the other end of the range, found by exponential and then binary search
+        auto deltaMin = delta(i, i - d);
+        std::int64_t lMax = 2;
+        while (delta(i, i + lMax * d) > deltaMin)
+          lMax *= 2;
+        std::int64_t l = 0;
+        for (auto t = lMax / 2; t >= 1; t /= 2)
+          if (delta(i, i + (l + t) * d) > deltaMin)
+            l += t;
+        auto j = i + l * d;
+
+        // the split is the last leaf sharing more than the common prefix of the range with i
+        auto deltaNode = delta(i, j);
+        std::int64_t s = 0, t = l;
+        do {
+          t = (t + 1) / 2;
+          if (delta(i, i + (s + t) * d) > deltaNode)
+            s += t;
+        } while (t > 1);
+        auto split = i + s * d + std::min(d, 0);
+
+        auto left = (std::uint32_t)(std::min(i, j) == split ? n - 1 + split : split);
+        auto right = (std::uint32_t)(std::max(i, j) == split + 1 ? n + split : split + 1);
+        children[2 * i] = left;
+        children[2 * i + 1] = right;
+        parents[left] = (std::uint32_t)i;
+        parents[right] = (std::uint32_t)i;
+      }
+    }
+  );
+}
+
+void LBVHBuilder::computeBounds() {
+  auto nNodes = 2 * (std::size_t)nPrims - 1;
+  bounds.resize(nNodes);
+  costs.resize(nNodes);
+  primCounts.resize(nNodes);
+  nodeCounts.resize(nNodes);
+  visits.reset(new std::atomic<std::uint32_t>[nPrims]());
+
+  tbb::parallel_for(
+    tbb::blocked_range<std::uint32_t>(0u, nPrims),
+    [&](const tbb::blocked_range<std::uint32_t>& range) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        auto node = nPrims - 1 + i;
+        bounds[node] = primInfos[order[i]].bounds;
+        costs[node] = bounds[node].area();
+        primCounts[node] = 1;
+        nodeCounts[node] = 1;
+
+        // the first child to arrive stops, the second one sees both children done
+        while (node) {
+          node = parents[node];
+          if (!visits[node].fetch_add(1, std::memory_order_acq_rel))
+            break;
+          refresh(node);
+          if (restructure && primCounts[node] >= TreeletSize)
+            restructureTreelet(node);
+        }
+      }
+    }
+  );
+}
+
+void LBVHBuilder::refresh(std::uint32_t node) {
+  auto left = children[2 * node], right = children[2 * node + 1];
+  bounds[node] = merge(bounds[left], bounds[right]);
+  primCounts[node] = primCounts[left] + primCounts[right];
+
+  // small subtrees collapse into a leaf when that is cheaper
+  auto area = bounds[node].area();
+  auto splitCost = TraversalCost * area + costs[left] + costs[right];
+  auto leafCost = area * primCounts[node];
+  if (primCounts[node] <= MaxLeafSize && leafCost <= splitCost) {
+    costs[node] = leafCost;
+    nodeCounts[node] = 1;
+  } else {
+    costs[node] = splitCost;
+    nodeCounts[node] = 1 + nodeCounts[left] + nodeCounts[right];
+  }
+}
+
+void LBVHBuilder::restructureTreelet(std::uint32_t root) {
+  constexpr std::uint32_t SubsetCount = 1 << TreeletSize;
+
+  // grows the treelet by expanding the treelet leaf of largest area
+  std::uint32_t leaves[TreeletSize], internals[TreeletSize - 1];
+  int nLeaves = 2, nInternals = 1;
+  internals[0] = root;
+  leaves[0] = children[2 * root];
+  leaves[1] = children[2 * root + 1];
+  while (nLeaves < TreeletSize) {
+    auto best = -1;
+    auto bestArea = -1.0f;
+    for (auto i = 0; i < nLeaves; ++i)
+      if (!isLeaf(leaves[i]) && bounds[leaves[i]].area() > bestArea) {
+        best = i;
+        bestArea = bounds[leaves[i]].area();
+      }
+    if (best == -1) break;
+
+    auto node = leaves[best];
+    internals[nInternals++] = node;
+    leaves[best] = children[2 * node];
+    leaves[nLeaves++] = children[2 * node + 1];
+  }
+
+  // optimal topology of every subset of the treelet leaves, smaller subsets first
+  Bounds3f subsetBounds[SubsetCount];
+  float subsetCosts[SubsetCount];
+  std::uint32_t subsetPrims[SubsetCount];
+  std::uint8_t partitions[SubsetCount];
+  auto fullSet = (1u << nLeaves) - 1;
+  for (std::uint32_t s = 1; s <= fullSet; ++s) {
+    auto first = std::countr_zero(s);
+    auto rest = s & (s - 1);
+    if (!rest) {
+      subsetBounds[s] = bounds[leaves[first]];
+      subsetCosts[s] = costs[leaves[first]];
+      subsetPrims[s] = primCounts[leaves[first]];
+      continue;
+    }
+    subsetBounds[s] = merge(subsetBounds[rest], bounds[leaves[first]]);
+    subsetPrims[s] = subsetPrims[rest] + primCounts[leaves[first]];
+
+    // the first leaf stays on the left, which visits every partition once
+    auto low = s & ~rest;
+    auto bestCost = std::numeric_limits<float>::infinity();
+    std::uint32_t bestPartition = low;
+    for (auto q = (rest - 1) & rest;; q = (q - 1) & rest) {
+      auto p = low | q;
+      auto cost = subsetCosts[p] + subsetCosts[s ^ p];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestPartition = p;
+      }
+      if (!q) break;
+    }
+
+    auto area = subsetBounds[s].area();
+    auto splitCost = TraversalCost * area + bestCost;
+    auto leafCost = area * subsetPrims[s];
+    subsetCosts[s] = subsetPrims[s] <= MaxLeafSize ? std::min(splitCost, leafCost) : splitCost;
+    partitions[s] = (std::uint8_t)bestPartition;
+  }
+
+  // keeps the treelet unless the new topology is clearly better
+  if (subsetCosts[fullSet] >= 0.999f * costs[root])
+    return;
+
+  // reuses the internal nodes of the old topology, the root keeps its id and parent
+  auto nextInternal = 0;
+  auto rebuild = [&](auto& rebuild, std::uint32_t s, std::uint32_t node) -> void {
+    std::uint32_t sides[2] = { partitions[s], s ^ partitions[s] };
+    for (auto k = 0; k < 2; ++k) {
+      std::uint32_t child;
+      if (std::popcount(sides[k]) == 1)
+        child = leaves[std::countr_zero(sides[k])];
+      else {
+        child = internals[++nextInternal];
+        rebuild(rebuild, sides[k], child);
+      }
+      children[2 * node + k] = child;
+      parents[child] = node;
+    }
+    refresh(node);
+  };
+  rebuild(rebuild, fullSet, root);
+}
+
+bool LBVHBuilder::limitDepth(std::uint32_t node, int depth) {
+  // no leaf below is deeper than the count of internal nodes of the subtree
+  if (isLeaf(node) || (nodeCounts[node] - 1) / 2 <= (std::uint32_t)(MaxDepth - depth))
+    return false;
+
+  // a balanced subtree still fits once the radix tree would not
+  if (depth + (int)std::bit_width(primCounts[node] - 1) >= MaxDepth) {
+    rebalance(node);
+    return true;
+  }
+
+  auto left = children[2 * node], right = children[2 * node + 1];
+  auto leftChanged = false, rightChanged = false;
+  auto limitLeft = [&] { leftChanged = limitDepth(left, depth + 1); };
+  auto limitRight = [&] { rightChanged = limitDepth(right, depth + 1); };
+  if (primCounts[node] >= ParallelThreshold)
+    tbb::parallel_invoke(limitLeft, limitRight);
+  else {
+    limitLeft();
+    limitRight();
+  }
+  if (leftChanged || rightChanged)
+    refresh(node);
+  return leftChanged || rightChanged;
+}
+
+void LBVHBuilder::rebalance(std::uint32_t root) {
+  // the internal nodes of the subtree are reused, root comes first
+  std::vector<std::uint32_t> leaves, internals;
+  auto collect = [&](auto& self, std::uint32_t node) -> void {
+    if (isLeaf(node)) {
+      leaves.push_back(node);
+      return;
+    }
+    internals.push_back(node);
+    self(self, children[2 * node]);
+    self(self, children[2 * node + 1]);
+  };
+  collect(collect, root);
+
+  std::size_t nextInternal = 0;
+  auto split = [&](auto& self, std::size_t begin, std::size_t end) -> std::uint32_t {
+    if (end - begin == 1) return leaves[begin];
+    auto node = internals[nextInternal++];
+    auto mid = (begin + end) / 2;
+    auto left = self(self, begin, mid);
+    auto right = self(self, mid, end);
+    children[2 * node] = left;
+    children[2 * node + 1] = right;
+    parents[left] = parents[right] = node;
+    refresh(node);
+    return node;
+  };
+  split(split, 0, leaves.size());
+}
+
+void LBVHBuilder::emit(
+    std::vector<BVHNode>& nodes, std::vector<std::uint32_t>& indices,
+    std::uint32_t node, std::uint32_t packedIndex, std::uint32_t primsOffset) const {
+  if (isLeaf(node) || nodeCounts[node] == 1) {
+    auto offset = primsOffset;
+    gatherPrimitives(indices, node, offset);
+    nodes[packedIndex] = BVHNode(bounds[node], primsOffset, (std::uint16_t)primCounts[node]);
+    return;
+  }
+
+  // the split axis separates the child centers most, the lower child goes left
+  auto left = children[2 * node], right = children[2 * node + 1];
+  auto separation = bounds[right].centroid() - bounds[left].centroid();
+  auto axis = 0;
+  for (auto a = 1; a < 3; ++a)
+    if (std::abs(separation[a]) > std::abs(separation[axis]))
+      axis = a;
+  if (separation[axis] < 0)
+    std::swap(left, right);
+
+  auto rightIndex = packedIndex + 1 + nodeCounts[left];
+  nodes[packedIndex] = BVHNode(bounds[node], (std::uint16_t)axis, rightIndex);
+
+  auto emitLeft = [&] { emit(nodes, indices, left, packedIndex + 1, primsOffset); };
+  auto emitRight = [&] { emit(nodes, indices, right, rightIndex, primsOffset + primCounts[left]); };
+  if (primCounts[node] >= ParallelThreshold)
+    tbb::parallel_invoke(emitLeft, emitRight);
+  else {
+    emitLeft();
+    emitRight();
+  }
+}
+
+void LBVHBuilder::gatherPrimitives(
+    std::vector<std::uint32_t>& indices, std::uint32_t node, std::uint32_t& primsOffset) const {
+  if (isLeaf(node)) {
+    indices[primsOffset++] = primInfos[order[node - (nPrims - 1)]].index;
+    return;
+  }
+  gatherPrimitives(indices, children[2 * node], primsOffset);
+  gatherPrimitives(indices, children[2 * node + 1], primsOffset);
+}
+
+}
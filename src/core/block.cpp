@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <minpt/math/math.h>
+#include <minpt/math/simd.h>
 #include <minpt/core/block.h>
 
 namespace minpt {
@@ -6,7 +8,6 @@ namespace minpt {
 ImageBlock::ImageBlock(const Vector2i& size, const Filter* filter)
     : offset(0, 0), size(size) {
   if (filter) {
-    static constexpr auto FilterResolution = 16;
     filterRadius = filter->radius;
     borderSize = (int)std::ceil(filterRadius - 0.5f);
     filters = new float[FilterResolution + 1];
@@ -14,6 +15,10 @@ ImageBlock::ImageBlock(const Vector2i& size, const Filter* filter)
     for (auto i = 0; i < FilterResolution; ++i)
       filters[i] = filter->eval(filterRadius * i / FilterResolution);
     lookupFactor = FilterResolution / filterRadius;
+    // a constant filter covering a single pixel needs no weights at all
+    isBox = filterRadius <= 0.5f && std::all_of(filters, filters + FilterResolution, [&](auto w) {
+      return w == filters[0];
+    });
     auto weightSize = (int)std::ceil(2 * filterRadius) + 1;
     weightsX = new float[weightSize];
     weightsY = new float[weightSize];
@@ -21,31 +26,140 @@ ImageBlock::ImageBlock(const Vector2i& size, const Filter* filter)
   resize(size.y + 2 * borderSize, size.x + 2 * borderSize);
 }
 
-void ImageBlock::put(const Vector2f& pos, const Spectrum& value) {
+void ImageBlock::put(const Vector2f& pos, const Spectrum& value, const float* channels) {
   if (!value.isValid()) {
     std::cerr << "Integrator: computed a invalid radiance value: " << value.toString() << std::endl;
     return;
   }
   Vector2f p(pos.x - 0.5f - offset.x + borderSize, pos.y - 0.5f - offset.y + borderSize);
+
+  if (isBox) {
+    // the other pixel in range when p is a pixel corner has weight zero
+    Vector2i pixel(std::ceil(p.x - filterRadius), std::ceil(p.y - filterRadius));
+    if (pixel.x < 0 || pixel.y < 0 || pixel.x >= cols() || pixel.y >= rows()) return;
+    coeffRef(pixel.y, pixel.x) += Color4f(value) * filters[0];
+    if (channels && !channelNames.empty()) {
+      auto nChannels = channelNames.size();
+      auto index = (std::size_t)pixel.y * cols() + pixel.x;
+      auto dst = &channelData[index * nChannels];
+      for (std::size_t c = 0; c < nChannels - unfilteredCount; ++c)
+        dst[c] += channels[c] * filters[0];
+      if (unfilteredCount > 0)
+        putUnfiltered(index, (pixel.x - p.x) * (pixel.x - p.x) + (pixel.y - p.y) * (pixel.y - p.y), channels);
+    }
+    return;
+  }
+
   Bounds2i bounds(
     Vector2i( std::ceil(p.x - filterRadius),  std::ceil(p.y - filterRadius)),
     Vector2i(std::floor(p.x + filterRadius), std::floor(p.y + filterRadius))
   );
   bounds.pMin = minpt::max(bounds.pMin, Vector2i(0));
   bounds.pMax = minpt::min(bounds.pMax, Vector2i(cols() - 1, rows() - 1));
+  auto width = bounds.pMax.x - bounds.pMin.x + 1;
   for (auto x = bounds.pMin.x, idx = 0; x <= bounds.pMax.x; ++x)
     weightsX[idx++] = filters[(int)(std::abs(x - p.x) * lookupFactor)];
   for (auto y = bounds.pMin.y, idy = 0; y <= bounds.pMax.y; ++y)
     weightsY[idy++] = filters[(int)(std::abs(y - p.y) * lookupFactor)];
-  for (auto y = bounds.pMin.y, yr = 0; y <= bounds.pMax.y; ++y, ++yr)
-    for (auto x = bounds.pMin.x, xr = 0; x <= bounds.pMax.x; ++x, ++xr)
-      coeffRef(y, x) += Color4f(value) * (weightsX[xr] * weightsY[yr]);
+
+  // one RGBA packet per tap, scaled by the row weight once per row
+  static_assert(sizeof(Color4f) == sizeof(float) * 4, "Color4f must be four packed floats");
+  Color4f color(value);
+  auto rgba = Float4::loadUnaligned(&color[0]);
+  for (auto y = bounds.pMin.y, yr = 0; y <= bounds.pMax.y; ++y, ++yr) {
+    auto row = rgba * Float4(weightsY[yr]);
+    auto pixels = &coeffRef(y, bounds.pMin.x)[0];
+    for (auto xr = 0; xr < width; ++xr, pixels += 4)
+      (Float4::loadUnaligned(pixels) + row * Float4(weightsX[xr])).storeUnaligned(pixels);
+  }
+
+  if (!channels || channelNames.empty()) return;
+  auto nChannels = channelNames.size();
+  auto nFiltered = nChannels - unfilteredCount;
+  for (auto y = bounds.pMin.y, yr = 0; y <= bounds.pMax.y; ++y, ++yr) {
+    auto index = (std::size_t)y * cols() + bounds.pMin.x;
+    auto dst = &channelData[index * nChannels];
+    for (auto xr = 0; xr < width; ++xr, ++index, dst += nChannels) {
+      auto weight = weightsY[yr] * weightsX[xr];
+      for (std::size_t c = 0; c < nFiltered; ++c)
+        dst[c] += channels[c] * weight;
+      if (unfilteredCount > 0) {
+        auto dx = bounds.pMin.x + xr - p.x;
+        putUnfiltered(index, dx * dx + (y - p.y) * (y - p.y), channels);
+      }
+    }
+  }
 }
 
 void ImageBlock::put(const ImageBlock& b) {
   auto size = b.size + Vector2i(2 * b.borderSize);
-  tbb::mutex::scoped_lock lock(mutex);
   block(b.offset.y, b.offset.x, size.y, size.x) += b.topLeftCorner(size.y, size.x);
+
+  // the channels of b are the same as ours, or it has none
+  if (b.channelNames.empty() || channelNames.empty()) return;
+  auto nChannels = channelNames.size();
+  auto nFiltered = nChannels - unfilteredCount;
+  for (auto y = 0; y < size.y; ++y) {
+    auto srcIndex = (std::size_t)y * b.cols();
+    auto dstIndex = (std::size_t)(b.offset.y + y) * cols() + b.offset.x;
+    auto src = &b.channelData[srcIndex * nChannels];
+    auto dst = &channelData[dstIndex * nChannels];
+    for (auto x = 0; x < size.x; ++x, src += nChannels, dst += nChannels) {
+      for (std::size_t c = 0; c < nFiltered; ++c)
+        dst[c] += src[c];
+      // the sample nearest to the pixel center of either wins
+      if (unfilteredCount > 0)
+        putUnfiltered(dstIndex + x, b.nearestDistances[srcIndex + x], src);
+    }
+  }
+}
+
+float ImageBlock::estimateError(const ImageBlock& half, const Vector2i& offset, const Vector2i& size) const {
+  auto error = 0.0f;
+  for (auto y = offset.y; y < offset.y + size.y; ++y)
+    for (auto x = offset.x; x < offset.x + size.x; ++x) {
+      auto& all = coeff(y + borderSize, x + borderSize);
+      auto& even = half.coeff(y + borderSize, x + borderSize);
+      Color4f odd(all[0] - even[0], all[1] - even[1], all[2] - even[2], all[3] - even[3]);
+      // not enough samples yet to tell
+      if (even[3] <= 0.0f || odd[3] <= 0.0f) return Infinity;
+      auto a = even.eval();
+      auto b = odd.eval();
+      auto value = all.eval();
+      auto diff = std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]);
+      error = std::max(error, diff / (1e-4f + std::sqrt(value[0] + value[1] + value[2])));
+    }
+  return error;
+}
+
+Bitmap::Channel ImageBlock::estimateVariance(const ImageBlock& half) const {
+  Bitmap::Channel variance(size.y, size.x);
+  for (auto y = 0; y < size.y; ++y)
+    for (auto x = 0; x < size.x; ++x) {
+      auto& all = coeff(y + borderSize, x + borderSize);
+      auto& even = half.coeff(y + borderSize, x + borderSize);
+      Color4f odd(all[0] - even[0], all[1] - even[1], all[2] - even[2], all[3] - even[3]);
+      if (even[3] <= 0.0f || odd[3] <= 0.0f) {
+        variance(y, x) = 0.0f;
+        continue;
+      }
+      // each half has twice the variance of the mean, their difference four times
+      auto a = even.eval();
+      auto b = odd.eval();
+      auto sum = 0.0f;
+      for (auto c = 0; c < 3; ++c)
+        sum += (a[c] - b[c]) * (a[c] - b[c]);
+      variance(y, x) = sum / 12;
+    }
+  return variance;
+}
+
+void ImageSnapshot::publish(const ImageBlock& block) {
+  auto pixels = buffers[back].data();
+  for (auto y = 0; y < size.y; ++y)
+    for (auto x = 0; x < size.x; ++x)
+      pixels[y * size.x + x] = block.coeff(y + block.borderSize, x + block.borderSize);
+  back = middle.exchange(back | Fresh, std::memory_order_acq_rel) & ~Fresh;
 }
 
 }
@@ -0,0 +1,200 @@
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range2d.h>
+#include <minpt/math/simd.h>
+#include <minpt/core/exception.h>
+#include <minpt/core/denoiser.h>
+
+namespace minpt {
+
+// guide planes of the filter, padded so that windows never leave them
+enum EPlane {
+  EColorR = 0,
+  EColorG,
+  EColorB,
+  EAlbedoR,
+  EAlbedoG,
+  EAlbedoB,
+  ENormalX,
+  ENormalY,
+  ENormalZ,
+  EDepth,
+  EVariance,
+  EValid,
+  EPlaneCount
+};
+
+// added to the albedo before dividing it out, keeps black surfaces and the background finite
+static constexpr float AlbedoEpsilon = 0.01f;
+
+static const Bitmap::Channel& findChannel(const Bitmap& image, const std::string& name) {
+  auto channel = image.getChannel(name);
+  if (!channel)
+    throw Exception("Denoising needs the \"%s\" AOV, render with it first!", name);
+  return *channel;
+}
+
+Bitmap Denoiser::denoise(const Bitmap& image, const Bitmap::Channel& variance) const {
+  const Bitmap::Channel* albedo[3] = {
+    &findChannel(image, "albedo.R"), &findChannel(image, "albedo.G"), &findChannel(image, "albedo.B")
+  };
+  const Bitmap::Channel* normal[3] = {
+    &findChannel(image, "N.X"), &findChannel(image, "N.Y"), &findChannel(image, "N.Z")
+  };
+  auto& depth = findChannel(image, "Z");
+
+  auto width = (int)image.cols();
+  auto height = (int)image.rows();
+  if (variance.cols() != width || variance.rows() != height)
+    throw Exception("Invalid variance dimensions!");
+
+  auto radius = params.radius;
+  auto windowSize = 2 * radius + 1;
+  auto nPackets = (windowSize + Float8::Width - 1) / Float8::Width;
+  // the last packet of a window may read up to a packet past it
+  auto stride = width + 2 * radius + Float8::Width;
+  std::vector<float> planes[EPlaneCount];
+  for (auto& plane : planes)
+    plane.assign((std::size_t)stride * (height + 2 * radius), 0.0f);
+
+  // the two sample variance estimate is noisy itself, smooth it over 3x3 pixels
+  tbb::parallel_for(0, height, [&](int y) {
+    for (auto x = 0; x < width; ++x) {
+      auto sum = 0.0f;
+      auto count = 0;
+      for (auto sy = std::max(0, y - 1); sy <= std::min(height - 1, y + 1); ++sy)
+        for (auto sx = std::max(0, x - 1); sx <= std::min(width - 1, x + 1); ++sx, ++count)
+          sum += variance(sy, sx);
+
+      auto index = (std::size_t)(y + radius) * stride + x + radius;
+      auto meanAlbedo = 0.0f;
+      for (auto c = 0; c < 3; ++c) {
+        auto a = (*albedo[c])(y, x) + AlbedoEpsilon;
+        planes[EColorR + c][index] = image(y, x)[c] / a;
+        planes[EAlbedoR + c][index] = a;
+        planes[ENormalX + c][index] = (*normal[c])(y, x);
+        meanAlbedo += a / 3;
+      }
+      planes[EDepth][index] = depth(y, x);
+      planes[EVariance][index] = sum / count / (meanAlbedo * meanAlbedo);
+      planes[EValid][index] = 1.0f;
+    }
+  });
+
+  // spatial distances of a window, lanes past its end get a distance with zero weight
+  std::vector<float> spatial((std::size_t)windowSize * nPackets * Float8::Width);
+  auto spatialFactor = 1.0f / (2 * params.sigmaSpatial * params.sigmaSpatial);
+  for (auto dy = -radius; dy <= radius; ++dy)
+    for (auto i = 0; i < nPackets * Float8::Width; ++i) {
+      auto dx = i - radius;
+      spatial[(dy + radius) * nPackets * Float8::Width + i] = dx <= radius
+        ? (dx * dx + dy * dy) * spatialFactor
+        : 1e30f;
+    }
+
+  auto albedoFactor = Float8(1.0f / (2 * params.sigmaAlbedo * params.sigmaAlbedo));
+  auto normalFactor = Float8(1.0f / (2 * params.sigmaNormal * params.sigmaNormal));
+  auto depthScale = Float8(2 * params.sigmaDepth * params.sigmaDepth);
+  auto colorScale = Float8(params.sigmaColor * params.sigmaColor);
+  auto zero = Float8(0.0f);
+  auto one = Float8(1.0f);
+  auto oneThird = Float8(1.0f / 3.0f);
+  auto oneEighth = Float8(1.0f / 8.0f);
+
+  Bitmap result(Vector2i(width, height));
+  tbb::parallel_for(tbb::blocked_range2d<int>(0, height, 32, 0, width, 32), [&](auto& range) {
+    for (auto y = range.rows().begin(); y < range.rows().end(); ++y)
+      for (auto x = range.cols().begin(); x < range.cols().end(); ++x) {
+        auto center = (std::size_t)(y + radius) * stride + x + radius;
+        Float8 p[EValid];
+        for (auto i = 0; i < EValid; ++i)
+          p[i] = Float8(planes[i][center]);
+        auto pDepth2 = p[EDepth] * p[EDepth];
+
+        Float8 sumWeight(0.0f), sumR(0.0f), sumG(0.0f), sumB(0.0f);
+        for (auto dy = 0; dy < windowSize; ++dy) {
+          auto row = (std::size_t)(y + dy) * stride + x;
+          auto spatialRow = &spatial[(std::size_t)dy * nPackets * Float8::Width];
+          for (auto k = 0; k < nPackets; ++k) {
+            auto offset = row + k * Float8::Width;
+            auto load = [&](int plane) {
+              return Float8::loadUnaligned(&planes[plane][offset]);
+            };
+
+            auto d = Float8::loadUnaligned(spatialRow + k * Float8::Width);
+            auto diff = load(EAlbedoR) - p[EAlbedoR];
+            auto sum = diff * diff;
+            diff = load(EAlbedoG) - p[EAlbedoG];
+            sum = sum + diff * diff;
+            diff = load(EAlbedoB) - p[EAlbedoB];
+            d = d + (sum + diff * diff) * albedoFactor;
+
+            diff = load(ENormalX) - p[ENormalX];
+            sum = diff * diff;
+            diff = load(ENormalY) - p[ENormalY];
+            sum = sum + diff * diff;
+            diff = load(ENormalZ) - p[ENormalZ];
+            d = d + (sum + diff * diff) * normalFactor;
+
+            auto qDepth = load(EDepth);
+            diff = qDepth - p[EDepth];
+            d = d + diff * diff / (depthScale * (pDepth2 + qDepth * qDepth) + Float8(1e-8f));
+
+            // color difference beyond what the noise explains, Rousselle et al. 2012
+            auto r = load(EColorR), g = load(EColorG), b = load(EColorB);
+            diff = r - p[EColorR];
+            sum = diff * diff;
+            diff = g - p[EColorG];
+            sum = sum + diff * diff;
+            diff = b - p[EColorB];
+            sum = (sum + diff * diff) * oneThird;
+            auto v = load(EVariance) + p[EVariance];
+            d = d + max(zero, sum - v) / (colorScale * v + Float8(1e-4f));
+
+            // exp(-d) approximated by (1 - d / 8)^8, which is zero past d = 8
+            auto w = max(zero, one - d * oneEighth);
+            w = w * w;
+            w = w * w;
+            w = w * w * load(EValid);
+            sumWeight = sumWeight + w;
+            sumR = sumR + w * r;
+            sumG = sumG + w * g;
+            sumB = sumB + w * b;
+          }
+        }
+
+        // the center pixel has weight one, the sum is never zero
+        auto weight = 0.0f;
+        Spectrum color(0.0f);
+        for (auto i = 0; i < Float8::Width; ++i) {
+          weight += sumWeight[i];
+          color[0] += sumR[i];
+          color[1] += sumG[i];
+          color[2] += sumB[i];
+        }
+        for (auto c = 0; c < 3; ++c)
+          color[c] *= planes[EAlbedoR + c][center] / weight;
+        result(y, x) = color;
+      }
+  });
+
+  return result;
+}
+
+double Denoiser::relMSE(const Bitmap& image, const Bitmap& reference) {
+  if (image.cols() != reference.cols() || image.rows() != reference.rows())
+    throw Exception(
+      "Reference image is %ix%i, the image is %ix%i!",
+      reference.cols(), reference.rows(), image.cols(), image.rows()
+    );
+  auto error = 0.0;
+  for (auto y = 0; y < image.rows(); ++y)
+    for (auto x = 0; x < image.cols(); ++x)
+      for (auto c = 0; c < 3; ++c) {
+        double a = image(y, x)[c], b = reference(y, x)[c];
+        error += (a - b) * (a - b) / (b * b + 1e-2);
+      }
+  return error / (3.0 * image.rows() * image.cols());
+}
+
+}
@@ -0,0 +1,67 @@
+#include <minpt/core/instance.h>
+
+namespace minpt {
+
+ShapeGroup::ShapeGroup(const PropertyList& props) {
+  auto object = ObjectFactory::createInstance(props.getString("accel", "bvh"), props);
+  if (object->getClassType() != EAccel) {
+    delete object;
+    throw Exception("ShapeGroup: \"%s\" is not an accelerator!", props.getString("accel"));
+  }
+  accel = static_cast<Accelerator*>(object);
+}
+
+void ShapeGroup::addChild(Object* child) {
+  if (child->getClassType() != EMesh)
+    throw Exception("ShapeGroup::addChild(<%s>) is not supported!", classTypeName(child->getClassType()));
+
+  auto mesh = static_cast<Mesh*>(child);
+  // light sampling works on the meshes of the scene, which do not include shape groups
+  if (mesh->light)
+    throw Exception("Shape group \"%s\": emitters inside shape groups are not supported!", name);
+  accel->addMesh(mesh);
+  ++nMeshes;
+}
+
+void ShapeGroup::activate() {
+  if (name.empty())
+    throw Exception("A shape group needs a name to be referred to by instances!");
+  if (!nMeshes)
+    throw Exception("Shape group \"%s\" is empty!", name);
+  accel->build();
+}
+
+std::string ShapeGroup::toString() const {
+  return tfm::format(
+    "ShapeGroup[\n"
+    "  name = \"%s\",\n"
+    "  meshCount = %i,\n"
+    "  triangleCount = %i,\n"
+    "  accelerator = %s\n"
+    "]",
+    name, nMeshes, getPrimitiveCount(), indent(accel->toString())
+  );
+}
+
+Instance::Instance(const PropertyList& props)
+  : groupName(props.getString("shapegroup"))
+  , toWorld(props.getTransform("toWorld", Matrix4f::identity()))
+  , toLocal(toWorld) {
+  toLocal.inverse();
+}
+
+void Instance::setShapeGroup(const ShapeGroup* group) {
+  this->group = group;
+
+  // world bounds of the eight corners of the group bounds
+  auto& b = group->getBoundingBox();
+  bounds.reset();
+  for (auto corner = 0; corner < 8; ++corner)
+    bounds.merge(toWorld.fastApplyP(Vector3f(
+      b[corner & 1].x,
+      b[(corner >> 1) & 1].y,
+      b[corner >> 2].z
+    )));
+}
+
+}
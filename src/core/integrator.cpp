@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <minpt/core/scene.h>
+#include <minpt/core/integrator.h>
+
+namespace minpt {
+
+void Integrator::liBatch(
+    RayBatch& rays, const Vector2i* pixels, const Scene& scene, Sampler& sampler,
+    Spectrum* result, float* aovs) const {
+  // the query clips tMax to the hits, li() expects the camera rays. The
+  // buffers are kept per thread, batches of a render mostly have one size
+  static thread_local std::vector<float> tMax;
+  static thread_local HitBatch hits;
+  tMax.assign(rays.tMax.begin(), rays.tMax.end());
+  scene.intersect(rays, hits);
+  for (std::size_t i = 0, n = rays.size(); i < n; ++i) {
+    auto ray = rays.get(i);
+    ray.tMax = tMax[i];
+    auto isect = hits.hit[i] ? &hits.isects[i] : nullptr;
+    if (aovs) writeAOVs(ray, isect, aovs + i * EAOVChannelCount);
+    sampler.startPixelSample(pixels[i], Sampler::CameraDimensions);
+    result[i] = liPrimary(ray, isect, scene, sampler);
+  }
+}
+
+std::vector<std::string> Integrator::aovChannelNames() {
+  return {
+    "albedo.R", "albedo.G", "albedo.B",
+    "N.X", "N.Y", "N.Z",
+    "P.X", "P.Y", "P.Z",
+    "Z",
+    "meshId"
+  };
+}
+
+void Integrator::writeAOVs(const Ray& ray, const Interaction* isect, float* aov) {
+  std::fill(aov, aov + EAOVChannelCount, 0.0f);
+  if (!isect) {
+    aov[EAOVMeshId] = -1.0f;
+    return;
+  }
+
+  // lights have no BSDF, they are their own albedo
+  auto mesh = isect->mesh;
+  auto albedo = mesh->bsdf ? mesh->bsdf->getAlbedo(isect->uv) : Spectrum(1.0f);
+  for (auto c = 0; c < 3; ++c) {
+    aov[EAOVAlbedoR + c] = albedo[c];
+    aov[EAOVNormalX + c] = isect->shFrame.n[c];
+    aov[EAOVPositionX + c] = isect->p[c];
+  }
+  aov[EAOVDepth] = distance(ray.o, isect->p);
+  aov[EAOVMeshId] = (float)mesh->index;
+}
+
+}
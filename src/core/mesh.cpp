@@ -4,6 +4,34 @@
 
 namespace minpt {
 
+// octahedral map of the unit sphere, two 16 bit snorm coordinates, ref
+// Cigolle et al. 2014, "A Survey of Efficient Representations for Independent Unit Vectors"
+static std::uint32_t encodeOctahedral(const Vector3f& n) {
+  auto l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  auto u = n.x / l1, v = n.y / l1;
+  if (n.z < 0) {
+    auto su = u >= 0 ? 1.0f : -1.0f, sv = v >= 0 ? 1.0f : -1.0f;
+    auto fu = (1 - std::abs(v)) * su;
+    v = (1 - std::abs(u)) * sv;
+    u = fu;
+  }
+  auto quantize = [](float x) {
+    return (std::uint32_t)(std::uint16_t)(std::int16_t)std::round(clamp(x, -1.0f, 1.0f) * 32767);
+  };
+  return quantize(u) | quantize(v) << 16;
+}
+
+static Vector3f decodeOctahedral(std::uint32_t encoded) {
+  auto u = (std::int16_t)(encoded & 0xffff) / 32767.0f;
+  auto v = (std::int16_t)(encoded >> 16) / 32767.0f;
+  // folds the lower hemisphere back without branches, ref Rune Stubbe
+  Vector3f n(u, v, 1 - std::abs(u) - std::abs(v));
+  auto t = std::max(-n.z, 0.0f);
+  n.x += std::copysign(t, -n.x);
+  n.y += std::copysign(t, -n.y);
+  return normalize(n);
+}
+
 Mesh::~Mesh() {
   delete bsdf;
 }
@@ -28,9 +56,9 @@ void Mesh::addChild(Object* object) {
 
 bool Mesh::intersect(uint32_t index, const Ray& ray) const {
   auto offset = 3 * index;
-  auto& a = p[f[offset]];
-  auto& b = p[f[offset + 1]];
-  auto& c = p[f[offset + 2]];
+  auto& a = p[vertexIndex(offset)];
+  auto& b = p[vertexIndex(offset + 1)];
+  auto& c = p[vertexIndex(offset + 2)];
 
   auto e1 = b - a;
   auto e2 = c - a;
@@ -56,9 +84,9 @@ bool Mesh::intersect(uint32_t index, const Ray& ray) const {
 // ref https://cadxfem.org/inf/Fast%20MinimumStorage%20RayTriangle%20Intersection.pdf
 bool Mesh::intersect(uint32_t index, const Ray& ray, Interaction& isect) const {
   auto offset = 3 * index;
-  auto& a = p[f[offset]];
-  auto& b = p[f[offset + 1]];
-  auto& c = p[f[offset + 2]];
+  auto& a = p[vertexIndex(offset)];
+  auto& b = p[vertexIndex(offset + 1)];
+  auto& c = p[vertexIndex(offset + 2)];
 
   auto e1 = b - a;
   auto e2 = c - a;
@@ -86,9 +114,9 @@ bool Mesh::intersect(uint32_t index, const Ray& ray, Interaction& isect) const {
 
 void Mesh::computeIntersection(std::uint32_t index, Interaction& isect) const {
   auto offset = 3 * index;
-  auto ia = f[offset];
-  auto ib = f[offset + 1];
-  auto ic = f[offset + 2];
+  auto ia = vertexIndex(offset);
+  auto ib = vertexIndex(offset + 1);
+  auto ic = vertexIndex(offset + 2);
 
   auto& a = p[ia];
   auto& b = p[ib];
@@ -96,8 +124,11 @@ void Mesh::computeIntersection(std::uint32_t index, Interaction& isect) const {
   isect.p = barycentric(a, b, c, isect.uv);
   isect.n = normalize(cross(b - a, c - a));
 
-  if (n) {
-    auto ns = normalize(barycentric(n[ia], n[ib], n[ic], isect.uv));
+  if (n || nOctahedral) {
+    auto ns = n
+      ? barycentric(n[ia], n[ib], n[ic], isect.uv)
+      : barycentric(decodeOctahedral(nOctahedral[ia]), decodeOctahedral(nOctahedral[ib]), decodeOctahedral(nOctahedral[ic]), isect.uv);
+    ns = normalize(ns);
     isect.shFrame = Frame(ns);
     isect.n = faceForward(isect.n, isect.shFrame.n);
   } else {
@@ -108,9 +139,77 @@ void Mesh::computeIntersection(std::uint32_t index, Interaction& isect) const {
 
   if (uv) {
     isect.uv = barycentric(uv[ia], uv[ib], uv[ic], isect.uv);
+  } else if (uvQuantized) {
+    auto decode = [&](std::uint32_t i) {
+      return uvOffset + Vector2f(uvScale.x * uvQuantized[2 * i], uvScale.y * uvQuantized[2 * i + 1]);
+    };
+    isect.uv = barycentric(decode(ia), decode(ib), decode(ic), isect.uv);
+  }
+}
+
+void Mesh::compress() {
+  if (n) {
+    nOctahedral.reset(new std::uint32_t[nVertices]);
+    for (std::uint32_t i = 0; i < nVertices; ++i)
+      nOctahedral[i] = encodeOctahedral(n[i]);
+    n.reset();
+  }
+
+  if (uv && nVertices) {
+    Vector2f uvMin(Infinity), uvMax(-Infinity);
+    for (std::uint32_t i = 0; i < nVertices; ++i) {
+      uvMin = min(uvMin, uv[i]);
+      uvMax = max(uvMax, uv[i]);
+    }
+    uvOffset = uvMin;
+    uvScale = (uvMax - uvMin) / 65535.0f;
+    uvQuantized.reset(new std::uint16_t[2 * (std::size_t)nVertices]);
+    for (std::uint32_t i = 0; i < nVertices; ++i)
+      for (auto k = 0; k < 2; ++k) {
+        auto t = uvScale[k] > 0 ? (uv[i][k] - uvOffset[k]) / uvScale[k] : 0.0f;
+        uvQuantized[2 * i + k] = (std::uint16_t)clamp(std::round(t), 0.0f, 65535.0f);
+      }
+    uv.reset();
+  }
+
+  if (f && nVertices <= 65536) {
+    f16.reset(new std::uint16_t[3 * (std::size_t)nTriangles]);
+    std::copy(f.get(), f.get() + 3 * (std::size_t)nTriangles, f16.get());
+    f.reset();
   }
 }
 
+void Mesh::updateVertices(Mesh& other) {
+  if (other.nVertices != nVertices || other.nTriangles != nTriangles)
+    throw Exception(
+      "Mesh \"%s\": \"%s\" has %i vertices and %i triangles instead of %i and %i!",
+      name, other.name, other.nVertices, other.nTriangles, nVertices, nTriangles
+    );
+  if (other.compact != compact || !other.n != !n || !other.nOctahedral != !nOctahedral)
+    throw Exception("Mesh \"%s\": the normals of \"%s\" are stored differently!", name, other.name);
+  for (std::uint32_t i = 0; i < 3 * nTriangles; ++i)
+    if (other.vertexIndex(i) != vertexIndex(i))
+      throw Exception("Mesh \"%s\": the triangles of \"%s\" differ!", name, other.name);
+
+  std::swap(p, other.p);
+  std::swap(n, other.n);
+  std::swap(nOctahedral, other.nOctahedral);
+  std::swap(pdf, other.pdf);
+  totalArea = other.totalArea;
+  totalAreaInv = other.totalAreaInv;
+  bounds = other.bounds;
+}
+
+std::size_t Mesh::getMemoryUsage() const {
+  return
+    nVertices * sizeof(Vector3f) +
+    (n ? nVertices * sizeof(Vector3f) : 0) +
+    (uv ? nVertices * sizeof(Vector2f) : 0) +
+    (nOctahedral ? nVertices * sizeof(std::uint32_t) : 0) +
+    (uvQuantized ? nVertices * 2 * sizeof(std::uint16_t) : 0) +
+    nTriangles * 3 * (f16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t));
+}
+
 std::string Mesh::toString() const {
   return tfm::format(
     "Mesh[\n"
@@ -119,6 +218,8 @@ std::string Mesh::toString() const {
     "  transformSwapsHandedness = %s,\n"
     "  vertexCount = %i,\n"
     "  triangleCount = %i,\n"
+    "  compact = %s,\n"
+    "  memory = %s,\n"
     "  bsdf = %s,\n"
     "  light = %s\n"
     "]",
@@ -127,6 +228,8 @@ std::string Mesh::toString() const {
     transformSwapsHandedness ? "true" : "false",
     nVertices,
     nTriangles,
+    compact ? "true" : "false",
+    memString(getMemoryUsage()),
     bsdf ? indent(bsdf->toString()) : std::string("null"),
     light ? indent(light->toString()) : std::string("null")
   );
@@ -1,5 +1,7 @@
 #include <minpt/accels/bvh.h>
+#include <minpt/accels/kdtree.h>
 #include <minpt/cameras/perspective.h>
+#include <minpt/core/instance.h>
 
 #include <minpt/bsdfs/diffuse.h>
 #include <minpt/bsdfs/glass.h>
@@ -17,6 +19,7 @@
 #include <minpt/integrators/direct.h>
 #include <minpt/integrators/path.h>
 #include <minpt/integrators/path_simple.h>
+#include <minpt/integrators/wavefront.h>
 
 #include <minpt/lights/area.h>
 #include <minpt/lights/point.h>
@@ -26,6 +29,9 @@
 #include <minpt/meshes/obj.h>
 #include <minpt/meshes/ply.h>
 #include <minpt/samplers/random.h>
+#include <minpt/samplers/sobol.h>
+#include <minpt/samplers/stratified.h>
+#include <minpt/samplers/pmj02.h>
 
 #include <minpt/textures/constant.h>
 #include <minpt/textures/checkerboard.h>
@@ -37,7 +43,13 @@ std::map<std::string, ObjectFactory::Constructor> *ObjectFactory::constructors =
 
 MINPT_REGISTER_CLASS(Scene, "scene");
 MINPT_REGISTER_CLASS(RandomSampler, "random");
+MINPT_REGISTER_CLASS(SobolSampler, "sobol");
+MINPT_REGISTER_CLASS(StratifiedSampler, "stratified");
+MINPT_REGISTER_CLASS(PMJ02Sampler, "pmj02");
 MINPT_REGISTER_CLASS(BVHAccel, "bvh");
+MINPT_REGISTER_CLASS(KdTreeAccel, "kdtree");
+MINPT_REGISTER_CLASS(ShapeGroup, "shapegroup");
+MINPT_REGISTER_CLASS(Instance, "instance");
 MINPT_REGISTER_CLASS(PerspectiveCamera, "perspective");
 
 MINPT_REGISTER_CLASS(PLY, "ply");
@@ -59,6 +71,7 @@ MINPT_REGISTER_CLASS(NormalIntegrator, "normals");
 MINPT_REGISTER_CLASS(DirectIntegrator, "direct");
 MINPT_REGISTER_CLASS(PathIntegrator, "path");
 MINPT_REGISTER_CLASS(PathSimpleIntegrator, "path_simple");
+MINPT_REGISTER_CLASS(WavefrontIntegrator, "wavefront");
 
 MINPT_REGISTER_CLASS(PointLight, "point");
 MINPT_REGISTER_CLASS(AreaLight, "area");
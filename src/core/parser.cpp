@@ -21,6 +21,8 @@ enum ETag {
   ELight,
   EFilter,
   ETexture,
+  EShapeGroup,
+  EInstance,
 
   // Properties
   EBoolean = Object::EClassTypeCount,
@@ -53,6 +55,8 @@ static std::map<std::string, ETag> tags = {
   { "light",      ELight },
   { "filter",     EFilter },
   { "texture",    ETexture },
+  { "shapegroup", EShapeGroup },
+  { "instance",   EInstance },
   { "boolean",    EBoolean },
   { "integer",    EInteger },
   { "float",      EFloat },
@@ -149,6 +153,10 @@ Object* loadFromXML(const Options& options) {
 
     if (tag == EScene)
       node.append_attribute("type") = "scene";
+    else if (tag == EShapeGroup)
+      node.append_attribute("type") = "shapegroup";
+    else if (tag == EInstance)
+      node.append_attribute("type") = "instance";
     else if (tag == ETransform)
       transform = Matrix4f::identity();
 
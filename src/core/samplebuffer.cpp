@@ -0,0 +1,88 @@
+#include <tbb/parallel_for.h>
+#include <minpt/core/samplebuffer.h>
+
+namespace minpt {
+
+// offsets past 2GB in the spill file
+static int seek(std::FILE* file, std::int64_t offset) {
+#if defined(_WIN32)
+  return _fseeki64(file, offset, SEEK_SET);
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+SampleBuffer::SampleBuffer(const Vector2i& size, int blockSize, const std::string& spillFile)
+    : blockSize(blockSize)
+    , generator(size, blockSize)
+    , blocks(generator.getBlockCount())
+    , chunks(generator.getBlockCount())
+    , spillFile(spillFile) {
+  if (!spillFile.empty()) {
+    file = std::fopen(spillFile.c_str(), "w+b");
+    if (!file)
+      throw Exception("Unable to create sample file \"%s\"!", spillFile);
+  }
+}
+
+SampleBuffer::~SampleBuffer() {
+  if (file) {
+    std::fclose(file);
+    std::remove(spillFile.c_str());
+  }
+}
+
+void SampleBuffer::append(int blockIndex, const std::vector<SampleRecord>& records) {
+  count += records.size();
+  if (!file) {
+    auto& block = blocks[blockIndex];
+    block.insert(block.end(), records.begin(), records.end());
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(fileMutex);
+  if (seek(file, fileSize) ||
+      std::fwrite(records.data(), sizeof(SampleRecord), records.size(), file) != records.size())
+    throw Exception("Unable to write to sample file \"%s\"!", spillFile);
+  chunks[blockIndex].push_back({ fileSize, records.size() });
+  fileSize += (std::int64_t)(records.size() * sizeof(SampleRecord));
+}
+
+void SampleBuffer::read(int blockIndex, std::vector<SampleRecord>& records) const {
+  std::lock_guard<std::mutex> lock(fileMutex);
+  records.clear();
+  for (auto& chunk : chunks[blockIndex]) {
+    auto first = records.size();
+    records.resize(first + chunk.count);
+    if (seek(file, chunk.offset) ||
+        std::fread(records.data() + first, sizeof(SampleRecord), chunk.count, file) != chunk.count)
+      throw Exception("Unable to read from sample file \"%s\"!", spillFile);
+  }
+}
+
+void SampleBuffer::reconstruct(const Filter* filter, ImageBlock& image) const {
+  image.clear();
+
+  std::vector<int> indices(blocks.size());
+  for (auto i = 0; i < (int)indices.size(); ++i)
+    indices[i] = i;
+  std::vector<int> colors[4];
+  generator.splitCheckerboard(indices, colors);
+
+  for (auto& colored : colors)
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, colored.size()), [&](auto& range) {
+      ImageBlock block(Vector2i(blockSize), filter);
+      std::vector<SampleRecord> spilled;
+      for (auto i = range.begin(); i < range.end(); ++i) {
+        auto index = colored[i];
+        generator.getBlock(index, block.offset, block.size);
+        block.clear();
+        if (file) read(index, spilled);
+        for (auto& record : file ? spilled : blocks[index])
+          block.put(record.pFilm, record.value);
+        image.put(block);
+      }
+    });
+}
+
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <tbb/parallel_for.h>
 #include <minpt/utils/bitmap.h>
 #include <minpt/core/timer.h>
@@ -41,11 +42,50 @@ void Scene::addChild(Object* child) {
     case ELight:
       lights.push_back(static_cast<Light*>(child));
       break;
+    case EShapeGroup: {
+        auto group = static_cast<ShapeGroup*>(child);
+        for (auto other : shapeGroups)
+          if (other->getName() == group->getName())
+            throw Exception("Duplicate shape group \"%s\"!", group->getName());
+        shapeGroups.push_back(group);
+      }
+      break;
+    case EInstance: {
+        auto instance = static_cast<Instance*>(child);
+        auto& groupName = instance->getShapeGroupName();
+        auto itr = std::find_if(shapeGroups.begin(), shapeGroups.end(),
+          [&](const ShapeGroup* group) { return group->getName() == groupName; });
+        if (itr == shapeGroups.end())
+          throw Exception("Shape group \"%s\" must be declared before its instances!", groupName);
+        instance->setShapeGroup(*itr);
+        instances.push_back(instance);
+      }
+      break;
     default:
       throw Exception("Scene::addChild(<%s>) is not supported!", classTypeName(child->getClassType()));
   }
 }
 
+void Scene::intersect(RayBatch& rays, HitBatch& hits) const {
+  accel->intersect(rays, hits);
+  if (instanceAccel.empty()) return;
+  for (std::size_t i = 0, n = rays.size(); i < n; ++i) {
+    auto ray = rays.get(i);
+    if (instanceAccel.intersect(ray, hits.isects[i])) {
+      hits.hit[i] = true;
+      rays.tMax[i] = ray.tMax;
+    }
+  }
+}
+
+void Scene::occluded(RayBatch& rays, bool* occluded) const {
+  accel->occluded(rays, occluded);
+  if (instanceAccel.empty()) return;
+  for (std::size_t i = 0, n = rays.size(); i < n; ++i)
+    if (!occluded[i])
+      occluded[i] = instanceAccel.intersect(rays.get(i));
+}
+
 std::string Scene::toString() const {
   std::string meshStr;
   if (meshes.empty())
@@ -86,6 +126,8 @@ std::string Scene::toString() const {
     "  sampler = %s,\n"
     "  camera = %s,\n"
     "  meshes = %s,\n"
+    "  shapeGroups = %i,\n"
+    "  instances = %i,\n"
     "  lights = %s,\n"
     "  outputName = \"%s\"\n"
     "]",
@@ -94,6 +136,8 @@ std::string Scene::toString() const {
     indent(sampler->toString()),
     indent(camera->toString()),
     indent(meshStr),
+    shapeGroups.size(),
+    instances.size(),
     indent(lightStr),
     indent(outputName)
   );
@@ -7,4 +7,16 @@ bool VisibilityTester::unoccluded(const Scene& scene) const {
   return !scene.intersect(ref->spawnRayTo(target));
 }
 
+void VisibilityTester::unoccluded(
+    const Scene& scene, const VisibilityTester* testers,
+    std::size_t count, bool* unoccluded) {
+
+  RayBatch rays(count);
+  for (std::size_t i = 0; i < count; ++i)
+    rays.set(i, testers[i].ref->spawnRayTo(testers[i].target));
+  scene.occluded(rays, unoccluded);
+  for (std::size_t i = 0; i < count; ++i)
+    unoccluded[i] = !unoccluded[i];
+}
+
 }
@@ -4,9 +4,9 @@ using namespace nanogui;
 
 namespace minpt {
 
-Screen::Screen(const ImageBlock& block)
-    : nanogui::Screen(Eigen::Vector2i(block.size.x, block.size.y), "minpt", false)
-    , block(block) {
+Screen::Screen(ImageSnapshot& snapshot)
+    : nanogui::Screen(Eigen::Vector2i(snapshot.size.x, snapshot.size.y), "minpt", false)
+    , snapshot(snapshot) {
 
   shader.init(
     "Tonemapper",
@@ -59,15 +59,10 @@ Screen::Screen(const ImageBlock& block)
 }
 
 void Screen::drawContents() {
-  auto& size = block.size;
-  auto borderSize = block.borderSize;
+  auto& size = snapshot.size;
   glBindTexture(GL_TEXTURE_2D, texture);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLuint)block.cols());
-  block.lock();
-  glTexImage2D(
-    GL_TEXTURE_2D, 0, GL_RGBA32F, size.x, size.y, 0, GL_RGBA, GL_FLOAT,
-    (uint8_t*)block.data() + (borderSize * block.cols() + borderSize) * sizeof(Color4f));
-  block.unlock();
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLuint)size.x);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x, size.y, 0, GL_RGBA, GL_FLOAT, snapshot.acquire());
 
   glDisable(GL_DEPTH_TEST);
   glActiveTexture(GL_TEXTURE0);
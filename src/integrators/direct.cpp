@@ -4,9 +4,16 @@ namespace minpt {
 
 Spectrum DirectIntegrator::li(const Ray& ray, const Scene& scene, Sampler& sampler) const {
   Interaction isect;
-  if (!scene.intersect(ray, isect))
+  auto hit = scene.intersect(ray, isect);
+  return liPrimary(ray, hit ? &isect : nullptr, scene, sampler);
+}
+
+Spectrum DirectIntegrator::liPrimary(const Ray& ray, const Interaction* primary, const Scene& scene, Sampler& sampler) const {
+  if (!primary)
     return Spectrum(0.0f);
 
+  auto& isect = *primary;
+
   if (isect.isLight())
     return isect.le(-ray.d);
 
@@ -3,6 +3,12 @@
 namespace minpt {
 
 Spectrum PathIntegrator::li(const Ray& ray, const Scene& scene, Sampler& sampler) const {
+  Interaction isect;
+  auto hit = scene.intersect(ray, isect);
+  return liPrimary(ray, hit ? &isect : nullptr, scene, sampler);
+}
+
+Spectrum PathIntegrator::liPrimary(const Ray& ray, const Interaction* primary, const Scene& scene, Sampler& sampler) const {
   Ray r(ray);
   auto etaScaleFix = 1.0f;
   Spectrum l(0.0f), t(1.0f), albedo(1.0f);
@@ -16,7 +22,10 @@ Spectrum PathIntegrator::li(const Ray& ray, const Scene& scene, Sampler& sampler
 
   for (auto bounce = 0; bounce < maxDepth; ++bounce) {
     auto ref = isect.p;
-    if (!scene.intersect(r, isect)) {
+    // the camera ray was traced by the caller
+    auto hit = bounce == 0 ? primary != nullptr : scene.intersect(r, isect);
+    if (bounce == 0 && primary) isect = *primary;
+    if (!hit) {
       if (!envLight || isDeltaLight) break;
       if (isDeltaBSDF || bounce == 0) return l + albedo * envLight->le(r);
       auto lightPdf = envLight->pdf(r.d);
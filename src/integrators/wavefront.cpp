@@ -0,0 +1,257 @@
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <minpt/integrators/wavefront.h>
+
+namespace minpt {
+
+struct PathState {
+  Spectrum l;
+  Spectrum albedo;
+  Vector3f ref;
+  float etaScaleFix;
+  float scatteringPdf;
+  bool isDeltaBSDF;
+  bool isDeltaLight;
+  // sampler position, the stages interleave the samples of many paths
+  Vector2i pixel;
+  int dimension;
+};
+
+/// Adds the time since the last call to the given stage
+class StageTimer {
+public:
+  StageTimer(std::atomic<std::int64_t>* times, std::atomic<std::int64_t>* items)
+    : times(times), items(items), start(std::chrono::steady_clock::now())
+  { }
+
+  void stop(int stage, std::size_t nItems) {
+    auto now = std::chrono::steady_clock::now();
+    times[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    items[stage] += (std::int64_t)nItems;
+    start = now;
+  }
+
+private:
+  std::atomic<std::int64_t>* times;
+  std::atomic<std::int64_t>* items;
+  std::chrono::steady_clock::time_point start;
+};
+
+WavefrontIntegrator::WavefrontIntegrator(const PropertyList& props)
+    : maxDepth(props.getInteger("maxDepth", 3)) {
+  for (auto i = 0; i < EStageCount; ++i) {
+    stageTimes[i] = 0;
+    stageItems[i] = 0;
+  }
+}
+
+Spectrum WavefrontIntegrator::li(const Ray& ray, const Scene& scene, Sampler& sampler) const {
+  RayBatch rays(1);
+  rays.set(0, ray);
+  Spectrum result;
+  liBatch(rays, &sampler.getPixel(), scene, sampler, &result);
+  return result;
+}
+
+void WavefrontIntegrator::liBatch(
+    RayBatch& cameraRays, const Vector2i* pixels, const Scene& scene, Sampler& sampler,
+    Spectrum* result, float* aovs) const {
+  StageTimer timer(stageTimes, stageItems);
+  auto envLight = scene.envLight;
+
+  // generate: one path per camera ray, queue[k] is the path of rays[k]
+  auto nPaths = cameraRays.size();
+  std::vector<PathState> paths(nPaths);
+  for (std::size_t i = 0; i < nPaths; ++i) {
+    auto& path = paths[i];
+    path.l = Spectrum(0.0f);
+    path.albedo = Spectrum(1.0f);
+    path.ref = Vector3f(0.0f);
+    path.etaScaleFix = 1.0f;
+    path.scatteringPdf = 0.0f;
+    path.isDeltaBSDF = false;
+    path.isDeltaLight = false;
+    path.pixel = pixels[i];
+    path.dimension = Sampler::CameraDimensions;
+  }
+  std::vector<std::uint32_t> queue(nPaths);
+  std::iota(queue.begin(), queue.end(), 0u);
+  auto rays = cameraRays;
+  timer.stop(EGenerate, nPaths);
+
+  HitBatch hits;
+  std::vector<std::uint32_t> shading;
+  std::vector<VisibilityTester> testers;
+  std::vector<Spectrum> contributions;
+  std::vector<std::uint32_t> contributionPaths;
+  std::vector<std::uint32_t> nextQueue;
+  RayBatch nextRays;
+
+  for (auto bounce = 0; bounce < maxDepth && !queue.empty(); ++bounce) {
+    // intersect: closest hits of all live paths
+    scene.intersect(rays, hits);
+    timer.stop(EIntersect, queue.size());
+
+    // the first bounce still has all paths in camera ray order
+    if (bounce == 0 && aovs)
+      for (std::size_t k = 0; k < nPaths; ++k)
+        writeAOVs(cameraRays.get(k), hits.hit[k] ? &hits.isects[k] : nullptr, aovs + k * EAOVChannelCount);
+
+    // shade: escaped paths and paths hitting a light end here, the others
+    // pass russian roulette and are grouped by BSDF
+    shading.clear();
+    for (std::uint32_t k = 0; k < queue.size(); ++k) {
+      auto& path = paths[queue[k]];
+      auto ray = rays.get(k);
+
+      if (!hits.hit[k]) {
+        if (!envLight || path.isDeltaLight) continue;
+        if (path.isDeltaBSDF || bounce == 0)
+          path.l += path.albedo * envLight->le(ray);
+        else {
+          auto lightPdf = envLight->pdf(ray.d);
+          path.l += path.albedo * envLight->le(ray) * weight(path.scatteringPdf, lightPdf);
+        }
+        continue;
+      }
+
+      auto& isect = hits.isects[k];
+      if (isect.isLight() && !path.isDeltaLight) {
+        if (path.isDeltaBSDF || bounce == 0)
+          path.l += path.albedo * isect.le(-ray.d);
+        else {
+          auto lightPdf = isect.lightPdf(path.ref);
+          path.l += path.albedo * isect.le(-ray.d) * weight(path.scatteringPdf, lightPdf);
+        }
+        continue;
+      }
+
+      auto t = path.albedo * path.etaScaleFix;
+      if (bounce >= 3 && t.maxComponent() < 1.0f) {
+        auto q = std::max(0.05f, 1.0f - t.maxComponent());
+        sampler.startPixelSample(path.pixel, path.dimension);
+        auto u = sampler.get1D();
+        path.dimension = sampler.getDimension();
+        if (u < q) continue;
+        path.albedo /= 1 - q;
+      }
+
+      shading.push_back(k);
+    }
+
+    std::stable_sort(shading.begin(), shading.end(), [&](auto a, auto b) {
+      return hits.isects[a].mesh->bsdf < hits.isects[b].mesh->bsdf;
+    });
+    timer.stop(EShade, queue.size());
+
+    // light sample: one light sample per non delta surface, the shadow
+    // rays are queued together with their pending contribution
+    testers.clear();
+    contributions.clear();
+    contributionPaths.clear();
+    for (auto k : shading) {
+      auto& path = paths[queue[k]];
+      auto& isect = hits.isects[k];
+      path.isDeltaBSDF = isect.mesh->bsdf->isDelta();
+      if (path.isDeltaBSDF) continue;
+
+      sampler.startPixelSample(path.pixel, path.dimension);
+      float pdf;
+      auto& light = scene.sampleOneLight(sampler, pdf);
+      path.isDeltaLight = light.isDelta();
+
+      float lightPdf;
+      Vector3f wi;
+      VisibilityTester tester;
+      auto li = light.sample(isect, sampler.get2D(), wi, lightPdf, tester) / pdf;
+      path.dimension = sampler.getDimension();
+      if (li.isBlack()) continue;
+
+      BSDFQueryRecord bRec(isect.toLocal(isect.wo), isect.toLocal(wi));
+      bRec.p = isect.p;
+      bRec.uv = isect.uv;
+      bRec.sampler = &sampler;
+      auto f = isect.f(bRec);
+      path.dimension = sampler.getDimension();
+      if (f.isBlack()) continue;
+
+      Spectrum contribution;
+      if (path.isDeltaLight)
+        contribution = path.albedo * f * absCosTheta(bRec.wi) / lightPdf;
+      else {
+        auto scatteringPdf = isect.scatteringPdf(bRec);
+        contribution = path.albedo * f * li * absCosTheta(bRec.wi) / lightPdf * weight(lightPdf, scatteringPdf);
+      }
+      testers.push_back(tester);
+      contributions.push_back(contribution);
+      contributionPaths.push_back(queue[k]);
+    }
+    timer.stop(ELightSample, shading.size());
+
+    // shade: sample the BSDFs for the continuation rays
+    nextQueue.clear();
+    nextRays.resize(shading.size());
+    for (auto k : shading) {
+      auto& path = paths[queue[k]];
+      auto& isect = hits.isects[k];
+
+      BSDFQueryRecord bRec(isect.toLocal(isect.wo));
+      bRec.p = isect.p;
+      bRec.uv = isect.uv;
+      bRec.sampler = &sampler;
+      sampler.startPixelSample(path.pixel, path.dimension);
+      auto f = isect.sample(bRec, sampler.get2D(), path.scatteringPdf);
+      path.dimension = sampler.getDimension();
+
+      path.albedo *= f;
+      if (path.albedo.isBlack()) continue;
+      path.etaScaleFix *= bRec.etaScale;
+      path.ref = isect.p;
+
+      nextRays.set(nextQueue.size(), isect.spawnRay(isect.toWorld(bRec.wi)));
+      nextQueue.push_back(queue[k]);
+    }
+    nextRays.resize(nextQueue.size());
+    timer.stop(EShade, 0);
+
+    // shadow: test all shadow rays of the bounce at once
+    auto unoccluded = std::make_unique<bool[]>(testers.size());
+    VisibilityTester::unoccluded(scene, testers.data(), testers.size(), unoccluded.get());
+    timer.stop(EShadow, testers.size());
+
+    // accumulate: add the unoccluded light samples to their paths
+    for (std::size_t i = 0; i < testers.size(); ++i)
+      if (unoccluded[i])
+        paths[contributionPaths[i]].l += contributions[i];
+    std::swap(queue, nextQueue);
+    std::swap(rays, nextRays);
+    timer.stop(EAccumulate, testers.size());
+  }
+
+  for (std::size_t i = 0; i < nPaths; ++i)
+    result[i] = paths[i].l;
+  timer.stop(EAccumulate, 0);
+}
+
+void WavefrontIntegrator::printStatistics() const {
+  static const char* stageNames[EStageCount] = {
+    "generate", "intersect", "shade", "light sample", "shadow", "accumulate"
+  };
+
+  std::int64_t total = 0;
+  for (auto i = 0; i < EStageCount; ++i)
+    total += stageTimes[i];
+  if (!total) return;
+
+  // stage times are summed over all threads
+  std::cout << "Wavefront stage timings (summed over threads):" << std::endl;
+  for (auto i = 0; i < EStageCount; ++i)
+    std::cout << tfm::format(
+      "  %-12s %10s (%5.1f%%, %i items)",
+      stageNames[i], timeString(stageTimes[i] / 1e6),
+      100.0 * stageTimes[i] / total, (std::int64_t)stageItems[i]) << std::endl;
+}
+
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <pcg32.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <minpt/core/block.h>
+#include <minpt/core/timer.h>
+#include <minpt/filters/box.h>
+#include <minpt/filters/gaussian.h>
+
+using namespace minpt;
+
+/**
+ * Scaling benchmark of the film accumulation from 1 to N threads. Blocks
+ * are splatted with cheap random samples, like a cheap integrator such as
+ * normals or ao would produce, and merged into the film either under one
+ * global mutex, as the renderer used to, or lock free in the checkerboard
+ * order of the renderer.
+ */
+
+constexpr auto BlockSize = 32;
+const Vector2i FilmSize(1920, 1080);
+
+static double run(const Filter& filter, int nThreads, int samplesPerPixel, bool globalLock) {
+  ImageBlock film(FilmSize, &filter);
+  film.clear();
+  BlockGenerator generator(FilmSize, BlockSize);
+  std::mutex mutex;
+
+  std::vector<int> all(generator.getBlockCount());
+  std::iota(all.begin(), all.end(), 0);
+  std::vector<int> colors[4];
+  generator.splitCheckerboard(all, colors);
+
+  auto renderBlocks = [&](const std::vector<int>& blocks) {
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, blocks.size()), [&](auto& range) {
+      ImageBlock block(Vector2i(BlockSize), &filter);
+      pcg32 random;
+      for (auto i = range.begin(); i < range.end(); ++i) {
+        generator.getBlock(blocks[i], block.offset, block.size);
+        random.seed(blocks[i]);
+        block.clear();
+        for (auto s = 0; s < samplesPerPixel; ++s)
+          for (auto y = 0; y < block.size.y; ++y)
+            for (auto x = 0; x < block.size.x; ++x) {
+              Vector2f pFilm(block.offset.x + x + random.nextFloat(), block.offset.y + y + random.nextFloat());
+              block.put(pFilm, Spectrum(random.nextFloat()));
+            }
+        if (globalLock) {
+          std::lock_guard<std::mutex> lock(mutex);
+          film.put(block);
+        } else
+          film.put(block);
+      }
+    });
+  };
+
+  Timer timer;
+  tbb::task_arena arena(nThreads);
+  arena.execute([&] {
+    if (globalLock)
+      renderBlocks(all);
+    else
+      for (auto& colored : colors)
+        renderBlocks(colored);
+  });
+  return timer.elapsed();
+}
+
+int main() {
+  PropertyList props;
+  BoxFilter box(props);
+  GaussianFilter gaussian(props);
+  const Filter* filters[] = { &box, &gaussian };
+  auto maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  for (auto filter : filters)
+    for (auto spp : { 1, 4 }) {
+      printf("%s, %i spp, %ix%i film\n", filter->toString().c_str(), spp, FilmSize.x, FilmSize.y);
+      printf("%8s %14s %14s %10s %10s\n", "threads", "global lock", "lock free", "speedup", "scaling");
+      double base = 0;
+      for (auto nThreads = 1; ; nThreads = std::min(nThreads * 2, maxThreads)) {
+        auto locked = run(*filter, nThreads, spp, true);
+        auto lockFree = run(*filter, nThreads, spp, false);
+        if (nThreads == 1) base = lockFree;
+        printf("%8i %12.1fms %12.1fms %9.2fx %9.2fx\n",
+          nThreads, locked, lockFree, locked / lockFree, base / lockFree);
+        if (nThreads == maxThreads) break;
+      }
+      printf("\n");
+    }
+
+  return 0;
+}
@@ -1,12 +1,24 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <numeric>
 #include <thread>
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <filesystem/resolver.h>
 
+#if defined(MINPT_GUI)
 #include <minpt/gui/screen.h>
+#endif
 #include <minpt/core/timer.h>
 #include <minpt/core/scene.h>
 #include <minpt/core/parser.h>
+#include <minpt/core/samplebuffer.h>
+#include <minpt/core/denoiser.h>
 
 using namespace minpt;
 
@@ -18,58 +30,567 @@ Rendering options:
     --help                        Print this help text.
     --outfile <filename>          Write the final image to the given filename.
     --transform <global|local>    Specify transform globally or locally, default globally.
+    --headless                    Render without the preview window, no display or OpenGL needed.
+                                  Always the case when minpt was built without the GUI.
+    --progressive                 Render passes of increasing sample count over the whole image.
+    --time-budget <time>          Stop progressive rendering after the given time, e.g. 300s, 5m or 1h.
+    --spp-target <count>          Stop progressive rendering at the given samples per pixel.
+    --adaptive <threshold>        Render progressively, stop sampling blocks whose relative error is below the threshold,
+                                  e.g. 0.01, and write the samples taken per pixel to <outfile>_spp.
+    --adaptive-min-spp <count>    Samples per pixel of the first adaptive pass, default 16.
+    --snapshot-interval <time>    Write the current image at most every given time while rendering progressively.
+    --snapshot-passes <count>     Write the current image every given number of progressive passes.
+    --sample-buffer               Store the raw samples and filter the image after rendering.
+    --sample-file <filename>      Store the raw samples in the given file instead of in memory.
+    --sample-filters <names>      Also filter the samples with the given filters, e.g. box,gaussian,
+                                  into <outfile>_<name>.
+    --aovs                        Also write the albedo, normal, position, depth, mesh index and sample count
+                                  of every pixel as layers of the EXR output.
+    --denoise                     Denoise the image guided by the AOVs, the noisy image is kept as <outfile>_noisy.
+    --denoise-reference <file>    Denoise and print the error of both images against the given reference.
+    --frames <filename>           Render a batch of frames of the scene, loaded once, headless. Every line of the
+                                  file is an output file, optionally followed by the camera origin, target and up,
+                                  e.g. "frame001.exr 0,1,5 0,0,0 0,1,0". Meshes of the scene take the vertices of
+                                  another file with the same triangles given as <mesh filename>=<filename>,
+                                  e.g. "frame002.exr hand.ply=hand_002.ply", and the BVH is refitted.
+    --verify-determinism          Render twice with different thread counts without the GUI and compare the images.
 )");
   exit(msg ? 1 : 0);
 }
 
-static void render(const Scene& scene, const std::string& outputName) {
+/// Parses a time like 300, 300s, 5m or 1.5h into seconds
+static double parseTime(const char* arg, const char* option) {
+  char* end;
+  auto time = std::strtod(arg, &end);
+  if (end == arg || time < 0)
+    usage(tfm::format("invalid time \"%s\" for %s", arg, option).c_str());
+  if (!strcmp(end, "m")) time *= 60;
+  else if (!strcmp(end, "h")) time *= 3600;
+  else if (*end && strcmp(end, "s"))
+    usage(tfm::format("invalid time unit \"%s\" for %s, expected s, m or h", end, option).c_str());
+  return time;
+}
+
+static std::int64_t parseCount(const char* arg, const char* option) {
+  char* end;
+  auto count = std::strtoll(arg, &end, 10);
+  if (end == arg || *end || count <= 0)
+    usage(tfm::format("invalid count \"%s\" for %s", arg, option).c_str());
+  return count;
+}
+
+static constexpr auto BlockSize = 32;
+
+/**
+ * Adds the samples [sampleBegin, sampleEnd) of every pixel of the given
+ * blocks to result, the samples with even index are added to half as well.
+ * The image does not depend on the number of threads: samples depend on
+ * the pixel and the sample index only, and the blocks are merged in an
+ * order fixed by the block indices. The film is published to display
+ * whenever no block is being merged into it. With a sample buffer the
+ * samples are only stored, result is left for its reconstruction. If
+ * result has extra channels they receive the AOVs of the integrator.
+ */
+static void renderPass(
+    const Scene& scene, const std::vector<int>& blocks,
+    std::int64_t sampleBegin, std::int64_t sampleEnd,
+    ImageBlock& result, ImageBlock* half = nullptr, ImageSnapshot* display = nullptr,
+    SampleBuffer* samples = nullptr) {
+
   auto camera = scene.camera;
   auto integrator = scene.integrator;
   auto filter = camera->filter;
-  auto outputSize = camera->outputSize;
+  auto withAOVs = result.getChannelCount() > 0;
+  BlockGenerator generator(camera->outputSize, BlockSize);
 
-  printf("Configuration: %s\n", scene.toString().c_str());
+  // blocks of the same color of a 2x2 checkerboard never overlap, so merging
+  // the colors one after another adds to every pixel in a fixed order
+  std::vector<int> colors[4];
+  generator.splitCheckerboard(blocks, colors);
 
-  constexpr auto BlockSize = 32;
-  BlockGenerator generator(outputSize, BlockSize);
+  auto renderBlocks = [&, camera, integrator, filter](const std::vector<int>& colored, const tbb::blocked_range<std::size_t>& range) {
+    ImageBlock block(Vector2i(BlockSize), filter);
+    ImageBlock halfBlock(Vector2i(BlockSize), filter);
+    if (withAOVs) block.setChannels(result.getChannelNames(), result.getUnfilteredCount());
+    auto sampler = scene.sampler->clone();
+    sampler->setSampleRange(sampleBegin, sampleEnd);
+    RayBatch rays;
+    std::vector<Vector2f> pFilms;
+    std::vector<Vector2i> pixels;
+    std::vector<Spectrum> values;
+    std::vector<float> aovs;
+    std::vector<SampleRecord> records;
+    for (auto i = range.begin(); i < range.end(); ++i) {
+      generator.getBlock(colored[i], block.offset, block.size);
+      halfBlock.offset = block.offset;
+      halfBlock.size = block.size;
+      sampler->prepare(block.offset);
+      block.clear();
+      if (half) halfBlock.clear();
 
-  ImageBlock result(outputSize, filter);
-  result.clear();
-
-  nanogui::init();
-  auto screen = new Screen(result);
-
-  std::thread renderThread([&] {
-    printf("Rendering ..");
-    fflush(stdout);
-    Timer timer;
-    tbb::parallel_for(tbb::blocked_range<int>(0, generator.getBlockCount()), [&, camera, integrator, filter](auto& range) {
-      ImageBlock block(Vector2i(BlockSize), filter);
-      auto sampler = scene.sampler->clone();
-      for (auto i = range.begin(); i < range.end(); ++i) {
-        generator.next(block);
-        sampler->prepare(block.offset);
-        block.clear();
+      // one sample of every pixel of the block per pass, so that the
+      // primary rays are traced together as a coherent batch
+      auto nPixels = (std::size_t)block.size.x * block.size.y;
+      rays.resize(nPixels);
+      pFilms.resize(nPixels);
+      pixels.resize(nPixels);
+      values.resize(nPixels);
+      if (withAOVs) aovs.resize(nPixels * EAOVChannelCount);
+      auto sampleIndex = sampleBegin;
+      records.clear();
+      sampler->startPixel();
+      do {
         for (auto y = 0; y < block.size.y; ++y)
           for (auto x = 0; x < block.size.x; ++x) {
-            sampler->startPixel();
-            do {
-              auto cameraSample = sampler->getCameraSample(Vector2i(x, y) + block.offset);
-              auto ray = camera->generateRay(cameraSample);
-              block.put(cameraSample.pFilm, integrator->li(ray, scene, *sampler));
-            } while (sampler->startNextSample());
+            auto pixel = Vector2i(x, y) + block.offset;
+            auto cameraSample = sampler->getCameraSample(pixel);
+            pixels[y * block.size.x + x] = pixel;
+            pFilms[y * block.size.x + x] = cameraSample.pFilm;
+            rays.set(y * block.size.x + x, camera->generateRay(cameraSample));
           }
-        result.put(block);
+        integrator->liBatch(rays, pixels.data(), scene, *sampler, values.data(), withAOVs ? aovs.data() : nullptr);
+        if (samples)
+          for (std::size_t j = 0; j < nPixels; ++j)
+            records.push_back({ pFilms[j], values[j] });
+        else
+          for (std::size_t j = 0; j < nPixels; ++j)
+            block.put(pFilms[j], values[j], withAOVs ? &aovs[j * EAOVChannelCount] : nullptr);
+        if (half && sampleIndex % 2 == 0)
+          for (std::size_t j = 0; j < nPixels; ++j)
+            halfBlock.put(pFilms[j], values[j]);
+        ++sampleIndex;
+      } while (sampler->startNextSample());
+
+      if (samples) {
+        samples->append(colored[i], records);
+        continue;
       }
+      result.put(block);
+      if (half) half->put(halfBlock);
+    }
+  };
+
+  // with a display the colors are merged in waves of blocks, to show the
+  // progress more often than four times a pass
+  auto waveSize = display
+    ? 8 * std::max<std::size_t>(8, std::thread::hardware_concurrency())
+    : blocks.size();
+
+  for (auto& colored : colors)
+    for (std::size_t first = 0; first < colored.size(); first += waveSize) {
+      tbb::blocked_range<std::size_t> wave(first, std::min(colored.size(), first + waveSize));
+      tbb::parallel_for(wave, [&](auto& range) {
+        renderBlocks(colored, range);
+      });
+      if (display && !samples) display->publish(result);
+    }
+}
+
+static std::vector<int> allBlocks(const Vector2i& outputSize) {
+  std::vector<int> blocks(BlockGenerator(outputSize, BlockSize).getBlockCount());
+  std::iota(blocks.begin(), blocks.end(), 0);
+  return blocks;
+}
+
+/**
+ * Writes the image next to the output file first and renames it, so that
+ * a snapshot is never seen half written, even if the render gets killed
+ */
+static void saveImage(Bitmap bitmap, const std::string& outputName) {
+  auto extension = filesystem::path(outputName).extension();
+  auto tmpName = outputName.substr(0, outputName.size() - extension.size()) + "partial." + extension;
+  bitmap.save(tmpName);
+  if (std::rename(tmpName.c_str(), outputName.c_str())) {
+    // rename does not replace an existing file on windows
+    std::remove(outputName.c_str());
+    if (std::rename(tmpName.c_str(), outputName.c_str()))
+      throw Exception("Unable to move snapshot \"%s\" to \"%s\"!", tmpName, outputName);
+  }
+}
+
+/// Appends a suffix to the file name of outputName, keeping the extension
+static std::string auxiliaryName(const std::string& outputName, const std::string& suffix) {
+  auto extension = filesystem::path(outputName).extension();
+  return outputName.substr(0, outputName.size() - extension.size() - 1) + suffix + "." + extension;
+}
+
+/// Image of every second sample, for adaptive sampling and the variance of the denoiser
+static std::unique_ptr<ImageBlock> createHalf(const Scene& scene, const Options& options) {
+  if (!options.adaptive && !options.denoise) return nullptr;
+  auto half = std::make_unique<ImageBlock>(scene.camera->outputSize, scene.camera->filter);
+  half->clear();
+  return half;
+}
+
+/**
+ * Renders passes of doubling sample count over the whole image until the
+ * sample target or the time budget is reached, a pass is shortened when
+ * the previous passes predict that it would exceed the budget.
+ *
+ * In adaptive mode the first pass takes adaptiveMinSpp samples, after
+ * that only the blocks whose error is above the threshold get more passes.
+ * blockSpp receives the final sample count of every block.
+ */
+static void renderProgressive(
+    const Scene& scene, ImageBlock& result, ImageBlock* half, const Options& options,
+    const std::string& outputName, std::vector<std::int64_t>& blockSpp,
+    ImageSnapshot* display) {
+
+  auto outputSize = scene.camera->outputSize;
+  auto sppTarget = options.sppTarget;
+  if (!sppTarget)
+    sppTarget = options.timeBudget > 0 ? std::numeric_limits<std::int64_t>::max() : scene.sampler->samplesPerPixel;
+  auto budget = options.timeBudget * 1000;
+
+  BlockGenerator generator(outputSize, BlockSize);
+  auto blocks = allBlocks(outputSize);
+  blockSpp.assign(blocks.size(), 0);
+
+  Timer timer, snapshotTimer;
+  std::int64_t spp = 0, passSpp = options.adaptive ? options.adaptiveMinSpp : 1;
+  double blockSamples = 0;
+  for (auto pass = 1; spp < sppTarget; ++pass) {
+    Timer passTimer;
+    auto sampleEnd = spp + std::min(passSpp, sppTarget - spp);
+    renderPass(scene, blocks, spp, sampleEnd, result, half, display);
+    blockSamples += (double)blocks.size() * (sampleEnd - spp);
+    spp = sampleEnd;
+    for (auto block : blocks)
+      blockSpp[block] = spp;
+
+    auto elapsed = timer.elapsed();
+    printf("Pass %i: %lld spp in %zu blocks (took %s, total %s)\n", pass, (long long)spp,
+      blocks.size(), passTimer.elapsedString().c_str(), timeString(elapsed).c_str());
+    fflush(stdout);
+    if (spp == sppTarget || (budget > 0 && elapsed >= budget)) break;
+
+    if (options.adaptive) {
+      // blocks leaving the active set never come back, so all the active
+      // blocks always have the same sample count
+      blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](auto block) {
+        Vector2i offset, size;
+        generator.getBlock(block, offset, size);
+        return result.estimateError(*half, offset, size) <= options.adaptiveThreshold;
+      }), blocks.end());
+      if (blocks.empty()) break;
+    }
+
+    if ((options.snapshotPasses && pass % options.snapshotPasses == 0) ||
+        (options.snapshotInterval > 0 && snapshotTimer.elapsed() >= options.snapshotInterval * 1000)) {
+      saveImage(result.toBitmap(), outputName);
+      snapshotTimer.reset();
+    }
+
+    passSpp = spp;
+    if (budget > 0) {
+      auto samplesLeft = (budget - elapsed) / std::max(elapsed, 1.0) * blockSamples / blocks.size();
+      passSpp = std::max((std::int64_t)1, (std::int64_t)std::min((double)passSpp, samplesLeft));
+    }
+  }
+}
+
+/// Sets every pixel of counts to the sample count of its block
+static void fillSampleCounts(Bitmap::Channel& counts, const std::vector<std::int64_t>& blockSpp) {
+  BlockGenerator generator(Vector2i((int)counts.cols(), (int)counts.rows()), BlockSize);
+  for (auto i = 0; i < (int)blockSpp.size(); ++i) {
+    Vector2i offset, size;
+    generator.getBlock(i, offset, size);
+    counts.block(offset.y, offset.x, size.y, size.x).setConstant((float)blockSpp[i]);
+  }
+}
+
+/// Writes the sample count of every pixel, as taken by adaptive sampling
+static void saveSampleCounts(const Vector2i& outputSize, const std::vector<std::int64_t>& blockSpp, const std::string& outputName) {
+  BlockGenerator generator(outputSize, BlockSize);
+  Bitmap bitmap(outputSize);
+  std::int64_t total = 0;
+  for (auto i = 0; i < (int)blockSpp.size(); ++i) {
+    Vector2i offset, size;
+    generator.getBlock(i, offset, size);
+    bitmap.block(offset.y, offset.x, size.y, size.x).setConstant(Spectrum((float)blockSpp[i]));
+    total += blockSpp[i] * size.x * size.y;
+  }
+  auto maxSpp = *std::max_element(blockSpp.begin(), blockSpp.end());
+  printf("Adaptive sampling: %.1f spp on average, %.1fx less samples than %lld spp everywhere\n",
+    (double)total / ((double)outputSize.x * outputSize.y),
+    (double)maxSpp * outputSize.x * outputSize.y / total, (long long)maxSpp);
+  saveImage(bitmap, auxiliaryName(outputName, "_spp"));
+}
+
+/**
+ * Renders the image into result, progressively if asked to. half receives
+ * every second sample, it is needed for adaptive sampling.
+ */
+static void renderImage(
+    const Scene& scene, const Options& options, const std::string& outputName,
+    ImageBlock& result, ImageBlock* half, std::vector<std::int64_t>& blockSpp,
+    ImageSnapshot* display = nullptr) {
+
+  Timer timer;
+  if (options.progressive) {
+    printf("Rendering progressively ..\n");
+    renderProgressive(scene, result, half, options, outputName, blockSpp, display);
+    printf("Done. (took %s)\n", timer.elapsedString().c_str());
+    return;
+  }
+
+  auto outputSize = scene.camera->outputSize;
+  std::unique_ptr<SampleBuffer> samples;
+  if (options.sampleBuffer)
+    samples = std::make_unique<SampleBuffer>(outputSize, BlockSize, options.sampleFile);
+
+  printf("Rendering ..");
+  fflush(stdout);
+  auto blocks = allBlocks(outputSize);
+  blockSpp.assign(blocks.size(), scene.sampler->samplesPerPixel);
+  renderPass(scene, blocks, 0, scene.sampler->samplesPerPixel, result, half, display, samples.get());
+  printf(" done. (took %s)\n", timer.elapsedString().c_str());
+  if (!samples) return;
+
+  printf("Reconstructing %s ..", samples->toString().c_str());
+  fflush(stdout);
+  timer.reset();
+  samples->reconstruct(scene.camera->filter, result);
+  if (display) display->publish(result);
+  printf(" done. (took %s)\n", timer.elapsedString().c_str());
+
+  // the same samples filtered differently, for free
+  for (auto& name : options.sampleFilters) {
+    std::unique_ptr<Object> filter(ObjectFactory::createInstance(name, PropertyList()));
+    if (filter->getClassType() != Object::EFilter)
+      throw Exception("\"%s\" is not a filter!", name);
+    ImageBlock image(outputSize, static_cast<Filter*>(filter.get()));
+    samples->reconstruct(static_cast<Filter*>(filter.get()), image);
+    saveImage(image.toBitmap(), auxiliaryName(outputName, "_" + name));
+  }
+}
+
+/**
+ * Saves the final image, with the sample count layer next to the AOVs if
+ * they were asked for. When denoising, the denoised image is saved under
+ * outputName and the noisy one next to it.
+ */
+static void saveResult(
+    const ImageBlock& result, const ImageBlock* half, const std::vector<std::int64_t>& blockSpp,
+    const Options& options, const std::string& outputName) {
+
+  auto image = result.toBitmap();
+  if (options.aovs)
+    fillSampleCounts(image.addChannel("sampleCount"), blockSpp);
+  if (!options.denoise) {
+    saveImage(image, outputName);
+    return;
+  }
+
+  Denoiser denoiser;
+  printf("Denoising with %s ..", denoiser.toString().c_str());
+  fflush(stdout);
+  Timer timer;
+  auto denoised = denoiser.denoise(image, result.estimateVariance(*half));
+  printf(" done. (took %s)\n", timer.elapsedString().c_str());
+
+  if (!options.denoiseReference.empty()) {
+    Bitmap reference(options.denoiseReference);
+    auto noisyError = Denoiser::relMSE(image, reference);
+    auto denoisedError = Denoiser::relMSE(denoised, reference);
+    printf("relMSE against \"%s\": noisy %.4e, denoised %.4e (%.1fx lower)\n",
+      options.denoiseReference.c_str(), noisyError, denoisedError, noisyError / denoisedError);
+  }
+
+  // the AOVs were only rendered for the denoiser
+  if (options.aovs) {
+    denoised.channelNames = image.channelNames;
+    denoised.channels = image.channels;
+  } else {
+    image.channelNames.clear();
+    image.channels.clear();
+  }
+  saveImage(image, auxiliaryName(outputName, "_noisy"));
+  saveImage(denoised, outputName);
+}
+
+static void render(const Scene& scene, const Options& options, const std::string& outputName) {
+  auto integrator = scene.integrator;
+  auto outputSize = scene.camera->outputSize;
+
+  ImageBlock result(outputSize, scene.camera->filter);
+  result.clear();
+  if (options.aovs || options.denoise) result.setChannels(Integrator::aovChannelNames(), EAOVUnfilteredCount);
+  auto half = createHalf(scene, options);
+
+  auto renderAndSave = [&](ImageSnapshot* display) {
+    std::vector<std::int64_t> blockSpp;
+    renderImage(scene, options, outputName, result, half.get(), blockSpp, display);
+    integrator->printStatistics();
+    saveResult(result, half.get(), blockSpp, options, outputName);
+    if (options.adaptive)
+      saveSampleCounts(outputSize, blockSpp, outputName);
+  };
+
+#if defined(MINPT_GUI)
+  if (!options.headless) {
+    ImageSnapshot snapshot(outputSize);
+    nanogui::init();
+    auto screen = new Screen(snapshot);
+
+    std::thread renderThread([&] {
+      renderAndSave(&snapshot);
     });
-    printf(" done. (took %s)\n", timer.elapsedString().c_str());
-    result.toBitmap().save(outputName);
-  });
 
-  nanogui::mainloop();
-  renderThread.join();
-  delete screen;
-  nanogui::shutdown();
+    nanogui::mainloop();
+    renderThread.join();
+    delete screen;
+    nanogui::shutdown();
+    return;
+  }
+#endif
+
+  renderAndSave(nullptr);
+}
+
+/**
+ * Renders the image twice with different numbers of threads and compares
+ * the results bit by bit, returns whether they are identical
+ */
+static bool verifyDeterminism(const Scene& scene, const Options& options, const std::string& outputName) {
+  auto outputSize = scene.camera->outputSize;
+
+  auto nThreads = std::max(1, (int)std::thread::hardware_concurrency());
+  int threadCounts[2] = { nThreads, nThreads > 1 ? nThreads / 2 : 2 };
+  std::unique_ptr<ImageBlock> images[2];
+  for (auto i = 0; i < 2; ++i) {
+    images[i] = std::make_unique<ImageBlock>(outputSize, scene.camera->filter);
+    images[i]->clear();
+    printf("Verifying determinism, render %i of 2 with %i threads\n", i + 1, threadCounts[i]);
+    std::vector<std::int64_t> blockSpp;
+    auto half = createHalf(scene, options);
+    tbb::task_arena arena(threadCounts[i]);
+    arena.execute([&] {
+      renderImage(scene, options, outputName, *images[i], half.get(), blockSpp);
+    });
+  }
+
+  auto& a = *images[0];
+  auto& b = *images[1];
+  auto nDiffering = 0;
+  auto maxDiff = 0.0f;
+  for (auto y = 0; y < a.rows(); ++y)
+    for (auto x = 0; x < a.cols(); ++x) {
+      // bitwise, so that differing NaNs and signed zeros are found too
+      if (!std::memcmp(&a.coeff(y, x), &b.coeff(y, x), sizeof(Color4f))) continue;
+      ++nDiffering;
+      for (auto c = 0; c < 4; ++c)
+        maxDiff = std::max(maxDiff, std::abs(a.coeff(y, x)[c] - b.coeff(y, x)[c]));
+    }
+
+  saveImage(a.toBitmap(), outputName);
+  if (nDiffering) {
+    printf("Renders differ in %i pixels, largest difference %g\n", nDiffering, maxDiff);
+    return false;
+  }
+  printf("Renders are bit identical\n");
+  return true;
+}
+
+/// Camera of one frame of a batch, the camera of the scene if it has no look at
+struct BatchFrame {
+  std::string outputName;
+  bool hasLookAt = false;
+  Vector3f origin, target, up;
+  // filename of a mesh of the scene and the file of its vertices in this frame
+  std::vector<std::pair<std::string, std::string>> meshFiles;
+};
+
+/// Reads a frames file, empty lines and lines starting with # are skipped
+static std::vector<BatchFrame> loadFrames(const std::string& filename) {
+  std::ifstream file(filename);
+  if (!file)
+    throw Exception("Unable to open frames file \"%s\"!", filename);
+
+  std::vector<BatchFrame> frames;
+  std::string line;
+  for (auto lineNumber = 1; std::getline(file, line); ++lineNumber) {
+    auto tokens = tokenize(line, " \t\r");
+    if (tokens.empty() || tokens[0][0] == '#') continue;
+
+    BatchFrame frame;
+    auto isMeshFile = [](const std::string& token) { return token.find('=') != std::string::npos; };
+    for (auto& token : tokens)
+      if (isMeshFile(token)) {
+        auto split = token.find('=');
+        frame.meshFiles.emplace_back(token.substr(0, split), token.substr(split + 1));
+      }
+    tokens.erase(std::remove_if(tokens.begin(), tokens.end(), isMeshFile), tokens.end());
+    if (tokens.size() != 1 && tokens.size() != 4)
+      throw Exception(
+        "Invalid frame at %s:%i, expected an output file optionally followed by origin, target and up!",
+        filename, lineNumber
+      );
+    frame.outputName = tokens[0];
+    if (tokens.size() == 4) {
+      frame.hasLookAt = true;
+      frame.origin = toVector3f(tokens[1]);
+      frame.target = toVector3f(tokens[2]);
+      frame.up = toVector3f(tokens[3]);
+    }
+    frames.push_back(frame);
+  }
+  if (frames.empty())
+    throw Exception("Frames file \"%s\" has no frames!", filename);
+  return frames;
+}
+
+/// Loads the vertices of a frame into every mesh of the scene loaded from meshName
+static void updateMesh(Scene& scene, const std::string& meshName, const std::string& filename) {
+  auto type = filesystem::path(filename).extension();
+  if (type != "obj" && type != "ply")
+    throw Exception("Unable to load the vertices of \"%s\", expected an OBJ or PLY file!", filename);
+
+  auto found = false;
+  for (auto mesh : scene.meshes) {
+    if (mesh->name != meshName) continue;
+    found = true;
+
+    // the frame is loaded like the mesh, only from another file
+    auto props = mesh->properties;
+    props.remove("filename");
+    props.setString("filename", filename);
+    std::unique_ptr<Mesh> frameMesh(static_cast<Mesh*>(ObjectFactory::createInstance(type, props)));
+    frameMesh->activate();
+    mesh->updateVertices(*frameMesh);
+  }
+  if (!found)
+    throw Exception("The scene has no mesh loaded from \"%s\"!", meshName);
+}
+
+/**
+ * Renders every frame of a batch with the already built scene. The camera
+ * changes between frames, moved vertices are followed by a refit of the
+ * accelerator instead of a rebuild
+ */
+static void renderBatch(Scene& scene, const Options& options, const std::vector<BatchFrame>& frames) {
+  auto camera = scene.camera;
+  auto sceneFrame = camera->frame;
+  // the camera frame of a frame is a lookat, a mirrored camera stays mirrored
+  auto mirror = sceneFrame.swapsHandedness() ? Matrix4f::scale(-1.0f, 1.0f, 1.0f) : Matrix4f::identity();
+
+  Timer timer;
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    auto& frame = frames[i];
+    camera->frame = frame.hasLookAt
+      ? Matrix4f::lookAt(frame.origin, frame.target, frame.up) * mirror
+      : sceneFrame;
+    printf("Frame %zu of %zu: %s\n", i + 1, frames.size(), frame.outputName.c_str());
+    if (!frame.meshFiles.empty()) {
+      for (auto& meshFile : frame.meshFiles)
+        updateMesh(scene, meshFile.first, meshFile.second);
+      scene.refit();
+    }
+    render(scene, options, frame.outputName);
+  }
+  camera->frame = sceneFrame;
+  printf("Rendered %zu frames (took %s, %s per frame)\n", frames.size(),
+    timer.elapsedString().c_str(), timeString(timer.elapsed() / frames.size()).c_str());
 }
 
 int main(int argc, char** argv) {
@@ -87,12 +608,83 @@ int main(int argc, char** argv) {
       if (i + 1 == argc)
         usage("missing value after --transform argument");
       options.transformType = !strcmp(argv[++i], "global") ? TransformType::Global : TransformType::Local;
+    } else if (!strcmp(argv[i], "--headless")) {
+      options.headless = true;
+    } else if (!strcmp(argv[i], "--progressive")) {
+      options.progressive = true;
+    } else if (!strcmp(argv[i], "--time-budget")) {
+      if (i + 1 == argc)
+        usage("missing value after --time-budget argument");
+      options.timeBudget = parseTime(argv[++i], "--time-budget");
+      options.progressive = true;
+    } else if (!strcmp(argv[i], "--spp-target")) {
+      if (i + 1 == argc)
+        usage("missing value after --spp-target argument");
+      options.sppTarget = parseCount(argv[++i], "--spp-target");
+      options.progressive = true;
+    } else if (!strcmp(argv[i], "--adaptive")) {
+      if (i + 1 == argc)
+        usage("missing value after --adaptive argument");
+      options.adaptiveThreshold = std::strtof(argv[++i], nullptr);
+      if (options.adaptiveThreshold <= 0)
+        usage("--adaptive expects a positive error threshold");
+      options.adaptive = true;
+      options.progressive = true;
+    } else if (!strcmp(argv[i], "--adaptive-min-spp")) {
+      if (i + 1 == argc)
+        usage("missing value after --adaptive-min-spp argument");
+      options.adaptiveMinSpp = parseCount(argv[++i], "--adaptive-min-spp");
+    } else if (!strcmp(argv[i], "--snapshot-interval")) {
+      if (i + 1 == argc)
+        usage("missing value after --snapshot-interval argument");
+      options.snapshotInterval = parseTime(argv[++i], "--snapshot-interval");
+    } else if (!strcmp(argv[i], "--snapshot-passes")) {
+      if (i + 1 == argc)
+        usage("missing value after --snapshot-passes argument");
+      options.snapshotPasses = (int)parseCount(argv[++i], "--snapshot-passes");
+    } else if (!strcmp(argv[i], "--sample-buffer")) {
+      options.sampleBuffer = true;
+    } else if (!strcmp(argv[i], "--sample-file")) {
+      if (i + 1 == argc)
+        usage("missing value after --sample-file argument");
+      options.sampleFile = argv[++i];
+      options.sampleBuffer = true;
+    } else if (!strcmp(argv[i], "--sample-filters")) {
+      if (i + 1 == argc)
+        usage("missing value after --sample-filters argument");
+      options.sampleFilters = tokenize(argv[++i], ",");
+      options.sampleBuffer = true;
+    } else if (!strcmp(argv[i], "--aovs")) {
+      options.aovs = true;
+    } else if (!strcmp(argv[i], "--denoise")) {
+      options.denoise = true;
+    } else if (!strcmp(argv[i], "--denoise-reference")) {
+      if (i + 1 == argc)
+        usage("missing value after --denoise-reference argument");
+      options.denoiseReference = argv[++i];
+      options.denoise = true;
+    } else if (!strcmp(argv[i], "--frames")) {
+      if (i + 1 == argc)
+        usage("missing value after --frames argument");
+      options.framesFile = argv[++i];
+      options.headless = true;
+    } else if (!strcmp(argv[i], "--verify-determinism")) {
+      options.verifyDeterminism = true;
     } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
       usage();
     } else
       options.filename = argv[i];
   }
 
+  if (options.verifyDeterminism && !options.framesFile.empty())
+    usage("--verify-determinism cannot be combined with --frames");
+  if (options.verifyDeterminism && options.timeBudget > 0)
+    usage("--verify-determinism cannot be combined with --time-budget");
+  if (options.sampleBuffer && options.progressive)
+    usage("the sample buffer cannot be combined with progressive or adaptive rendering");
+  if ((options.aovs || options.denoise) && options.sampleBuffer)
+    usage("--aovs and --denoise cannot be combined with the sample buffer");
+
   try {
     filesystem::path path(options.filename);
     if (path.extension() == "xml") {
@@ -101,6 +693,12 @@ int main(int argc, char** argv) {
         resources (OBJ files, textures) using relative paths */
       getFileResolver()->prepend(path.parent_path());
 
+      // frames are checked before paying for the scene
+      std::vector<BatchFrame> frames;
+      if (!options.framesFile.empty())
+        frames = loadFrames(options.framesFile);
+
+      Timer loadTimer;
       std::unique_ptr<Object> root(loadFromXML(options));
       if (root->getClassType() != Object::EScene)
         throw Exception(
@@ -118,17 +716,39 @@ int main(int argc, char** argv) {
           outputName.erase(lastDot, std::string::npos);
         outputName += ".exr";
       }
+      if (frames.empty()) {
+        BatchFrame frame;
+        frame.outputName = outputName;
+        frames.push_back(frame);
+      }
+      for (auto& frame : frames)
+        if (options.aovs && filesystem::path(frame.outputName).extension() != "exr")
+          throw Exception("AOVs can only be written to EXR files, not to \"%s\"!", frame.outputName);
 
-      render(*scene, outputName);
+      printf("Configuration: %s\n", scene->toString().c_str());
+      printf("Scene loaded. (took %s)\n", loadTimer.elapsedString().c_str());
+      if (!options.framesFile.empty()) {
+        renderBatch(*scene, options, frames);
+        return 0;
+      }
+      if (options.verifyDeterminism)
+        return verifyDeterminism(*scene, options, outputName) ? 0 : 1;
+      render(*scene, options, outputName);
     } else if (path.extension() == "exr") {
+#if defined(MINPT_GUI)
       Bitmap bitmap(argv[1]);
       ImageBlock block(Vector2i(bitmap.cols(), bitmap.rows()), nullptr);
       block.fromBitmap(bitmap);
+      ImageSnapshot snapshot(block.size);
+      snapshot.publish(block);
       nanogui::init();
-      auto screen = new Screen(block);
+      auto screen = new Screen(snapshot);
       nanogui::mainloop();
       delete screen;
       nanogui::shutdown();
+#else
+      throw Exception("Unable to show \"%s\", minpt was built without the GUI!", options.filename);
+#endif
     } else {
       usage(tfm::format("unknow file \"%s\", expected an extension of type .xml", options.filename).c_str());
     }
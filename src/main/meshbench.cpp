@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <functional>
+
+#include <pcg32.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+
+#include <minpt/core/mesh.h>
+#include <minpt/core/timer.h>
+
+using namespace minpt;
+
+/**
+ * Benchmark of the compact mesh storage. Hits on random triangles of a
+ * bumpy grid are shaded with computeIntersection() on all threads, the way
+ * incoherent rays of a path tracer touch a mesh, at full precision and
+ * compact. The small grid fits in cache and shows the cost of decoding,
+ * the large one is bound by memory like a scanned asset. Also
+ * reports the memory of both and the largest error of the decoded normals
+ * and texture coordinates.
+ */
+
+class GridMesh : public Mesh {
+public:
+  GridMesh(int size, bool compact) {
+    nVertices = (size + 1) * (size + 1);
+    nTriangles = 2 * size * size;
+    p.reset(new Vector3f[nVertices]);
+    n.reset(new Vector3f[nVertices]);
+    uv.reset(new Vector2f[nVertices]);
+    f.reset(new std::uint32_t[3 * (std::size_t)nTriangles]);
+
+    for (auto y = 0; y <= size; ++y)
+      for (auto x = 0; x <= size; ++x) {
+        auto i = y * (size + 1) + x;
+        auto s = 8 * Pi * x / size, t = 8 * Pi * y / size;
+        p[i] = Vector3f((float)x / size, (float)y / size, 0.02f * std::sin(s) * std::cos(t));
+        n[i] = normalize(Vector3f(-0.02f * std::cos(s), 0.02f * std::sin(s) * std::sin(t), 1.0f / (8 * Pi)));
+        uv[i] = Vector2f(4.0f * x / size, 4.0f * y / size);
+      }
+    for (auto y = 0; y < size; ++y)
+      for (auto x = 0; x < size; ++x) {
+        std::uint32_t v0 = y * (size + 1) + x, v1 = v0 + 1, v2 = v0 + size + 2, v3 = v0 + size + 1;
+        auto face = &f[6 * ((std::size_t)y * size + x)];
+        face[0] = v0; face[1] = v1; face[2] = v2;
+        face[3] = v0; face[4] = v2; face[5] = v3;
+      }
+
+    reverseOrientation = transformSwapsHandedness = false;
+    if (compact) compress();
+  }
+};
+
+constexpr auto QueryCount = 1 << 24;
+constexpr auto BlockSize = 1 << 14;
+
+/// Shades QueryCount random hits on all threads, returns the time in ms
+static double shade(const Mesh& mesh, float& checksum) {
+  auto nTriangles = mesh.getPrimitiveCount();
+  Timer timer;
+  checksum = tbb::parallel_reduce(
+    tbb::blocked_range<int>(0, QueryCount / BlockSize), 0.0f,
+    [&](auto& range, float sum) {
+      for (auto block = range.begin(); block < range.end(); ++block) {
+        pcg32 random(block);
+        for (auto i = 0; i < BlockSize; ++i) {
+          Interaction isect;
+          auto triangle = random.nextUInt(nTriangles);
+          isect.uv = Vector2f(random.nextFloat(), random.nextFloat());
+          if (isect.uv.x + isect.uv.y > 1)
+            isect.uv = Vector2f(1 - isect.uv.x, 1 - isect.uv.y);
+          mesh.computeIntersection(triangle, isect);
+          sum += isect.shFrame.n.x + isect.uv.x;
+        }
+      }
+      return sum;
+    },
+    std::plus<float>()
+  );
+  return timer.elapsed();
+}
+
+int main() {
+  printf("%10s %10s %12s %12s %10s %14s %12s\n",
+    "triangles", "storage", "memory", "time", "Mhits/s", "normal error", "uv error");
+
+  for (auto size : { 180, 2000 }) {
+    GridMesh full(size, false), compact(size, true);
+    auto nTriangles = full.getPrimitiveCount();
+
+    // alternates between both meshes, the best of each counts
+    double elapsed[2] = { 1e30, 1e30 };
+    float checksum[2];
+    for (auto run = 0; run < 5; ++run) {
+      elapsed[0] = std::min(elapsed[0], shade(full, checksum[0]));
+      elapsed[1] = std::min(elapsed[1], shade(compact, checksum[1]));
+    }
+
+    auto maxNormalError = 0.0f, maxUVError = 0.0f;
+    pcg32 random;
+    for (auto i = 0; i < QueryCount / 16; ++i) {
+      Interaction a, b;
+      auto triangle = random.nextUInt(nTriangles);
+      a.uv = b.uv = Vector2f(random.nextFloat() / 2, random.nextFloat() / 2);
+      full.computeIntersection(triangle, a);
+      compact.computeIntersection(triangle, b);
+      maxNormalError = std::max(maxNormalError, 2 * std::asin((a.shFrame.n - b.shFrame.n).length() / 2) * 180 / Pi);
+      maxUVError = std::max(maxUVError, std::max(std::abs(a.uv.x - b.uv.x), std::abs(a.uv.y - b.uv.y)));
+    }
+
+    const Mesh* meshes[] = { &full, &compact };
+    for (auto i = 0; i < 2; ++i) {
+      printf("%10u %10s %12s %10.1fms %10.1f", nTriangles, i ? "compact" : "full",
+        memString(meshes[i]->getMemoryUsage()).c_str(), elapsed[i], QueryCount / elapsed[i] / 1000);
+      if (i)
+        printf(" %12.4fdeg %12.2e", maxNormalError, maxUVError);
+      printf(" (checksum %f)\n", checksum[i]);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include <tbb/task_arena.h>
+
+#include <minpt/core/timer.h>
+#include <minpt/meshes/obj.h>
+
+using namespace minpt;
+
+/**
+ * Throughput benchmark of the OBJ loader from 1 to N threads. Grids with
+ * positions, texture coordinates and a normal per vertex are written to a
+ * temporary file, in the format common exporters write, and loaded again
+ * and again. The page cache holds the file, so only parsing is measured.
+ */
+
+static const char* FileName = "objbench.obj";
+
+/// Writes a grid of size x size quads, returns the size of the file in bytes
+static long writeGrid(int size) {
+  auto file = fopen(FileName, "wb");
+  if (!file)
+    throw Exception("Unable to write \"%s\"!", FileName);
+  for (auto y = 0; y <= size; ++y)
+    for (auto x = 0; x <= size; ++x)
+      fprintf(file, "v %.6f %.6f %.6f\n", (float)x / size, (float)y / size, std::sin(x * 0.1f) * std::cos(y * 0.1f));
+  for (auto y = 0; y <= size; ++y)
+    for (auto x = 0; x <= size; ++x)
+      fprintf(file, "vt %.6f %.6f\n", (float)x / size, (float)y / size);
+  for (auto y = 0; y <= size; ++y)
+    for (auto x = 0; x <= size; ++x)
+      fprintf(file, "vn %.6f %.6f %.6f\n", 0.0f, std::sin(y * 0.1f), std::cos(y * 0.1f));
+  for (auto y = 0; y < size; ++y)
+    for (auto x = 0; x < size; ++x) {
+      auto v0 = y * (size + 1) + x + 1;
+      auto v1 = v0 + 1, v2 = v0 + size + 2, v3 = v0 + size + 1;
+      fprintf(file, "f %i/%i/%i %i/%i/%i %i/%i/%i %i/%i/%i\n", v0, v0, v0, v1, v1, v1, v2, v2, v2, v3, v3, v3);
+    }
+  auto bytes = ftell(file);
+  fclose(file);
+  return bytes;
+}
+
+int main() {
+  auto maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+  PropertyList props;
+  props.setString("filename", FileName);
+
+  for (auto size : { 500, 2000 }) {
+    auto bytes = writeGrid(size);
+    printf("%ix%i grid, %.1f MB\n", size, size, bytes / 1048576.0);
+    printf("%8s %12s %12s %10s\n", "threads", "time", "MB/s", "scaling");
+    // warms up the page cache
+    WavefrontOBJ warmup(props);
+
+    double base = 0;
+    for (auto nThreads = 1; ; nThreads = std::min(nThreads * 2, maxThreads)) {
+      auto best = 1e30;
+      for (auto i = 0; i < 3; ++i) {
+        Timer timer;
+        tbb::task_arena arena(nThreads);
+        arena.execute([&] { WavefrontOBJ mesh(props); });
+        best = std::min(best, timer.elapsed());
+      }
+      if (nThreads == 1) base = best;
+      printf("%8i %10.1fms %12.1f %9.2fx\n", nThreads, best, bytes / 1048576.0 / (best / 1000), base / best);
+      if (nThreads == maxThreads) break;
+    }
+    printf("\n");
+  }
+
+  std::remove(FileName);
+  return 0;
+}
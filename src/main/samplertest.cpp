@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <minpt/math/math.h>
+#include <minpt/core/timer.h>
+#include <minpt/samplers/random.h>
+#include <minpt/samplers/sobol.h>
+#include <minpt/samplers/stratified.h>
+#include <minpt/samplers/pmj02.h>
+
+using namespace minpt;
+
+/**
+ * Convergence benchmark of the samplers: every pixel of a small image is an
+ * independent estimate of a few integrals over the unit square and the unit
+ * hypercube, the RMS error over the pixels is reported for sample counts
+ * of increasing power of two, relative to RandomSampler as well.
+ */
+
+struct Integrand {
+  const char* name;
+  float reference;
+  // estimate of one sample, takes the dimensions it needs from the sampler
+  float (*eval)(Sampler& sampler);
+};
+
+static const Integrand integrands[] = {
+  // discontinuous, the quarter disk
+  { "disk", Pi / 4, [](Sampler& sampler) {
+    auto u = sampler.get2D();
+    return u.x * u.x + u.y * u.y < 1.0f ? 1.0f : 0.0f;
+  }},
+  // smooth
+  { "sin2D", 4 / (Pi * Pi), [](Sampler& sampler) {
+    auto u = sampler.get2D();
+    return std::sin(Pi * u.x) * std::sin(Pi * u.y);
+  }},
+  // smooth, spread over dimensions like a path of two bounces
+  { "sin6D", 1.0f, [](Sampler& sampler) {
+    auto result = 1.0f;
+    for (auto i = 0; i < 3; ++i) {
+      auto u = sampler.get2D();
+      result *= PiOver2 * std::sin(Pi * u.x) * PiOver2 * std::sin(Pi * u.y);
+    }
+    return result;
+  }},
+};
+
+constexpr auto ImageSize = 64;
+constexpr auto MaxSampleCount = 1024;
+
+static std::unique_ptr<Sampler> createSampler(const std::string& name, int sampleCount) {
+  PropertyList props;
+  props.setInteger("sampleCount", sampleCount);
+  if (name == "random") return std::make_unique<RandomSampler>(props);
+  if (name == "stratified") return std::make_unique<StratifiedSampler>(props);
+  if (name == "pmj02") return std::make_unique<PMJ02Sampler>(props);
+  return std::make_unique<SobolSampler>(props);
+}
+
+/// RMS error of the estimates of all pixels
+static double rmsError(const std::string& samplerName, const Integrand& integrand, int sampleCount) {
+  auto sampler = createSampler(samplerName, sampleCount);
+  sampler->prepare(Vector2i(0));
+  std::vector<double> sums(ImageSize * ImageSize, 0.0);
+
+  // samples in the same order as the renderer, all pixels of a sample index at once
+  sampler->startPixel();
+  do {
+    for (auto y = 0; y < ImageSize; ++y)
+      for (auto x = 0; x < ImageSize; ++x) {
+        sampler->startPixelSample(Vector2i(x, y));
+        sums[y * ImageSize + x] += integrand.eval(*sampler);
+      }
+  } while (sampler->startNextSample());
+
+  auto error = 0.0;
+  for (auto sum : sums) {
+    auto diff = sum / sampleCount - integrand.reference;
+    error += diff * diff;
+  }
+  return std::sqrt(error / sums.size());
+}
+
+int main() {
+  const char* samplers[] = { "random", "stratified", "pmj02", "sobol" };
+
+  for (auto& integrand : integrands) {
+    printf("%s: RMS error over %ix%i pixels (ratio to random)\n", integrand.name, ImageSize, ImageSize);
+    printf("%8s", "spp");
+    for (auto name : samplers)
+      printf(" %22s", name);
+    printf("\n");
+
+    for (auto spp = 1; spp <= MaxSampleCount; spp *= 4) {
+      printf("%8i", spp);
+      auto randomError = 0.0;
+      for (auto name : samplers) {
+        auto error = rmsError(name, integrand, spp);
+        if (!strcmp(name, "random")) randomError = error;
+        printf("    %.3e (%6.2fx)", error, randomError / error);
+      }
+      printf("\n");
+    }
+    printf("\n");
+  }
+
+  // cost of drawing samples, the renderer asks for a lot of them
+  printf("Time for %i samples of 64 dimensions of %ix%i pixels:\n", MaxSampleCount / 16, ImageSize, ImageSize);
+  for (auto name : samplers) {
+    auto sampler = createSampler(name, MaxSampleCount / 16);
+    sampler->prepare(Vector2i(0));
+    auto sum = 0.0f;
+    Timer timer;
+    sampler->startPixel();
+    do {
+      for (auto y = 0; y < ImageSize; ++y)
+        for (auto x = 0; x < ImageSize; ++x) {
+          sampler->startPixelSample(Vector2i(x, y));
+          for (auto i = 0; i < 32; ++i)
+            sum += sampler->get2D().x;
+        }
+    } while (sampler->startNextSample());
+    printf("  %-10s %s (checksum %f)\n", name, timer.elapsedString(true).c_str(), sum);
+  }
+
+  return 0;
+}
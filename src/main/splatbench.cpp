@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <pcg32.h>
+
+#include <minpt/core/block.h>
+#include <minpt/core/timer.h>
+#include <minpt/filters/box.h>
+#include <minpt/filters/gaussian.h>
+
+using namespace minpt;
+
+/**
+ * Splats per second of ImageBlock::put() for every reconstruction filter,
+ * with the samples of a 32x32 block in the order the renderer takes them
+ */
+
+constexpr auto BlockSize = 32;
+constexpr auto PassCount = 256;
+
+static void benchmark(const Filter& filter) {
+  ImageBlock block(Vector2i(BlockSize), &filter);
+  block.offset = Vector2i(64, 32);
+  block.clear();
+
+  // positions and values are drawn up front, to time the splats only
+  pcg32 random;
+  std::vector<Vector2f> positions(BlockSize * BlockSize);
+  std::vector<Spectrum> values(BlockSize * BlockSize);
+  for (auto y = 0; y < BlockSize; ++y)
+    for (auto x = 0; x < BlockSize; ++x) {
+      auto i = y * BlockSize + x;
+      positions[i] = Vector2f(block.offset.x + x + random.nextFloat(), block.offset.y + y + random.nextFloat());
+      values[i] = Spectrum(random.nextFloat(), random.nextFloat(), random.nextFloat());
+    }
+
+  Timer timer;
+  for (auto pass = 0; pass < PassCount; ++pass)
+    for (std::size_t i = 0; i < positions.size(); ++i)
+      block.put(positions[i], values[i]);
+  auto elapsed = std::max(timer.elapsed(), 1.0);
+
+  auto splats = (double)PassCount * positions.size();
+  printf("  %-40s %8.2f M splats/s (checksum %f)\n",
+    filter.toString().c_str(), splats / elapsed / 1000, block.coeff(BlockSize / 2, BlockSize / 2)[0]);
+}
+
+int main() {
+  PropertyList props;
+  PropertyList wide;
+  wide.setFloat("radius", 3.0f);
+  std::unique_ptr<Filter> filters[] = {
+    std::make_unique<BoxFilter>(props),
+    std::make_unique<GaussianFilter>(props),
+    std::make_unique<GaussianFilter>(wide)
+  };
+
+  printf("ImageBlock::put(), %ix%i block:\n", BlockSize, BlockSize);
+  for (auto& filter : filters)
+    benchmark(*filter);
+
+  return 0;
+}
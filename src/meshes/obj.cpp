@@ -1,140 +1,236 @@
-#include <fstream>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
-#include <unordered_map>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
 #include <minpt/core/timer.h>
+#include <minpt/core/lowdiscrepancy.h>
+#include <minpt/utils/mappedfile.h>
 #include <minpt/meshes/obj.h>
 
 namespace minpt {
 
+/// Indices of a face vertex as written in the file, starting at 1
 struct Vertex {
-  Vertex() noexcept = default;
-
-  Vertex(const std::string& string) noexcept : n((std::uint32_t)-1), uv((std::uint32_t)-1) {
-    auto tokens = tokenize(string, "/", true);
-    p = toUInt(tokens[0]);
-    if (tokens.size() >= 2 && !tokens[1].empty())
-      uv = toUInt(tokens[1]);
-    if (tokens.size() == 3 && !tokens[2].empty())
-      n = toUInt(tokens[2]);
-  }
+  static constexpr std::uint32_t Missing = (std::uint32_t)-1;
 
-  inline bool operator==(const Vertex& v) const {
+  bool operator==(const Vertex& v) const {
     return p == v.p && n == v.n && uv == v.uv;
   }
 
-  inline bool operator!=(const Vertex& v) const {
-    return p != v.p && n != v.n && uv != v.uv;
-  }
-
   std::uint32_t p, n, uv;
 };
 
-struct VertexHash {
-  std::size_t operator()(const Vertex& v) const {
-    auto hash = std::hash<std::uint32_t>()(v.p);
-    hash = hash * 37 + std::hash<std::uint32_t>()(v.uv);
-    return hash * 37 + std::hash<std::uint32_t>()(v.n);
-  }
+/// Everything read from one chunk of lines, faces are already triangulated
+struct OBJChunk {
+  std::vector<Vector3f> positions;
+  std::vector<Vector3f> normals;
+  std::vector<Vector2f> uvs;
+  std::vector<Vertex> vertices;
 };
 
-WavefrontOBJ::WavefrontOBJ(const PropertyList& props) {
-  reverseOrientation = props.getBoolean("reverseOrientation", false);
-  auto mat = props.getTransform("toWorld", Matrix4f::identity());
-  transformSwapsHandedness = mat.swapsHandedness();
+static constexpr double Pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-  name = props.getString("filename");
-  auto path = getFileResolver()->resolve(name);
-  std::ifstream file(path.str());
-  if (file.fail())
-    throw Exception("Unable to open OBJ file \"%s\"!", name);
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
 
-  std::cout << "Loading \"" << name << "\" .. ";
-  Timer timer;
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
 
-  std::vector<Vector3f> positions;
-  std::vector<Vector3f> normals;
-  std::vector<Vector2f> uvs;
-  std::vector<std::uint32_t> indices;
-  std::vector<Vertex> vertices;
-  std::unordered_map<Vertex, uint32_t, VertexHash> vertexMap;
-
-  std::string lineStr;
-  while (std::getline(file, lineStr)) {
-    std::string prefix;
-    std::istringstream line(lineStr);
-    line >> prefix;
-
-    if (prefix == "v") {
-      Vector3f p;
-      line >> p.x >> p.y >> p.z;
-      p = mat.applyP(p);
-      bounds.merge(p);
-      positions.push_back(p);
-    } else if (prefix == "vt") {
-      Vector2f uv;
-      line >> uv.x >> uv.y;
-      uvs.push_back(uv);
-    } else if (prefix == "vn") {
-      Vector3f n;
-      line >> n.x >> n.y >> n.z;
-      normals.push_back(normalize(mat.applyN(n)));
-    } else if (prefix == "f") {
-      Vertex verts[6];
-      auto nVerts = 3;
-      std::string v1, v2, v3, v4;
-      line >> v1 >> v2 >> v3 >> v4;
-
-      verts[0] = Vertex(v1);
-      verts[1] = Vertex(v2);
-      verts[2] = Vertex(v3);
-
-      if (!v4.empty()) {
-        verts[3] = Vertex(v4);
-        verts[4] = verts[0];
-        verts[5] = verts[2];
-        nVerts = 6;
+static void skipSpaces(const char*& s, const char* end) {
+  while (s < end && isSpace(*s)) ++s;
+}
+
+/**
+ * Parses a decimal float, without the locale and the allocations of
+ * iostreams. Up to 19 significant digits are kept, scaling by an exact
+ * power of ten in double precision rounds like strtof for all the numbers
+ * an OBJ exporter writes.
+ */
+static float parseFloat(const char*& s, const char* end) {
+  skipSpaces(s, end);
+  auto negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+
+  std::uint64_t mantissa = 0;
+  auto exponent = 0;
+  auto digits = 0;
+  auto any = false;
+  for (; s < end && isDigit(*s); ++s, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*s - '0');
+      if (mantissa) ++digits;
+    } else
+      ++exponent;
+  }
+  if (s < end && *s == '.')
+    for (++s; s < end && isDigit(*s); ++s, any = true)
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*s - '0');
+        if (mantissa) ++digits;
+        --exponent;
       }
+  if (!any)
+    throw Exception("Expected a number, got \"%s\"", std::string(s, std::min(end, s + 16)));
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    ++s;
+    auto negativeExponent = false;
+    if (s < end && (*s == '-' || *s == '+'))
+      negativeExponent = *s++ == '-';
+    auto e = 0;
+    for (; s < end && isDigit(*s); ++s)
+      e = std::min(e * 10 + (*s - '0'), 10000);
+    exponent += negativeExponent ? -e : e;
+  }
+
+  auto value = (double)mantissa;
+  if (exponent < 0)
+    value = exponent >= -22 ? value / Pow10[-exponent] : value * std::pow(10.0, exponent);
+  else if (exponent > 0)
+    value = exponent <= 22 ? value * Pow10[exponent] : value * std::pow(10.0, exponent);
+  return (float)(negative ? -value : value);
+}
+
+/// Parses a face vertex index, Vertex::Missing if there is none
+static std::uint32_t parseIndex(const char*& s, const char* end) {
+  if (s < end && *s == '-')
+    throw Exception("Negative face indices are not supported");
+  if (s == end || !isDigit(*s))
+    return Vertex::Missing;
+  std::uint64_t index = 0;
+  for (; s < end && isDigit(*s); ++s)
+    index = std::min<std::uint64_t>(index * 10 + (*s - '0'), Vertex::Missing);
+  return (std::uint32_t)index;
+}
+
+static bool hasPrefix(const char* s, const char* end, const char* prefix) {
+  auto length = std::strlen(prefix);
+  return (std::size_t)(end - s) > length && !std::memcmp(s, prefix, length) && isSpace(s[length]);
+}
+
+static void parseChunk(const char* s, const char* end, OBJChunk& chunk) {
+  std::vector<Vertex> polygon;
+  while (s < end) {
+    auto lineEnd = (const char*)std::memchr(s, '\n', end - s);
+    if (!lineEnd) lineEnd = end;
+    skipSpaces(s, lineEnd);
 
-      for (auto i = 0; i < nVerts; ++i) {
-        auto& v = verts[i];
-        auto it = vertexMap.find(v);
-        if (it == vertexMap.end()) {
-          vertexMap[v] = (uint32_t)vertices.size();
-          indices.push_back((uint32_t)vertices.size());
-          vertices.push_back(v);
-        } else {
-          indices.push_back(it->second);
+    if (hasPrefix(s, lineEnd, "v")) {
+      s += 1;
+      auto x = parseFloat(s, lineEnd);
+      auto y = parseFloat(s, lineEnd);
+      auto z = parseFloat(s, lineEnd);
+      chunk.positions.emplace_back(x, y, z);
+    } else if (hasPrefix(s, lineEnd, "vt")) {
+      s += 2;
+      auto u = parseFloat(s, lineEnd);
+      auto v = parseFloat(s, lineEnd);
+      chunk.uvs.emplace_back(u, v);
+    } else if (hasPrefix(s, lineEnd, "vn")) {
+      s += 2;
+      auto x = parseFloat(s, lineEnd);
+      auto y = parseFloat(s, lineEnd);
+      auto z = parseFloat(s, lineEnd);
+      chunk.normals.emplace_back(x, y, z);
+    } else if (hasPrefix(s, lineEnd, "f")) {
+      s += 1;
+      polygon.clear();
+      for (skipSpaces(s, lineEnd); s < lineEnd; skipSpaces(s, lineEnd)) {
+        Vertex v;
+        v.p = parseIndex(s, lineEnd);
+        v.uv = v.n = Vertex::Missing;
+        if (s < lineEnd && *s == '/') {
+          ++s;
+          v.uv = parseIndex(s, lineEnd);
+          if (s < lineEnd && *s == '/') {
+            ++s;
+            v.n = parseIndex(s, lineEnd);
+          }
         }
+        if (v.p == Vertex::Missing || (s < lineEnd && !isSpace(*s)))
+          throw Exception("Invalid face vertex \"%s\"", std::string(s, lineEnd));
+        polygon.push_back(v);
       }
+      if (polygon.size() < 3)
+        throw Exception("Face with less than three vertices");
+
+      // quads are split like they always were, larger polygons as fans
+      if (polygon.size() == 4) {
+        for (auto i : { 0, 1, 2, 3, 0, 2 })
+          chunk.vertices.push_back(polygon[i]);
+      } else
+        for (std::size_t i = 1; i + 1 < polygon.size(); ++i) {
+          chunk.vertices.push_back(polygon[0]);
+          chunk.vertices.push_back(polygon[i]);
+          chunk.vertices.push_back(polygon[i + 1]);
+        }
     }
+
+    s = lineEnd + 1;
   }
+}
 
-  nVertices = (std::uint32_t)vertices.size();
-  nTriangles = (std::uint32_t)(indices.size() / 3);
+/// Concatenates the arrays selected by member, in chunk order
+template <typename T>
+static std::vector<T> concatenate(std::vector<OBJChunk>& chunks, std::vector<T> OBJChunk::* member) {
+  std::vector<std::size_t> offsets(chunks.size() + 1, 0);
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+    offsets[i + 1] = offsets[i] + (chunks[i].*member).size();
+  std::vector<T> result(offsets.back());
+  tbb::parallel_for(std::size_t(0), chunks.size(), [&](std::size_t i) {
+    auto& values = chunks[i].*member;
+    std::copy(values.begin(), values.end(), result.begin() + offsets[i]);
+    values.clear();
+    values.shrink_to_fit();
+  });
+  return result;
+}
 
-  f.reset(new std::uint32_t[indices.size()]);
-  memcpy(f.get(), indices.data(), sizeof(std::uint32_t) * indices.size());
+template <typename T>
+static const T& lookup(const std::vector<T>& values, std::uint32_t index, const char* what) {
+  if (index == 0 || index > values.size())
+    throw Exception("Invalid %s index %i", what, index == Vertex::Missing ? -1 : (std::int64_t)index);
+  return values[index - 1];
+}
 
-  p.reset(new Vector3f[nVertices]);
-  for (auto i = 0u; i < nVertices; ++i)
-    p[i] = positions[vertices[i].p - 1];
+WavefrontOBJ::WavefrontOBJ(const PropertyList& props) {
+  reverseOrientation = props.getBoolean("reverseOrientation", false);
+  compact = props.getBoolean("compact", false);
+  auto mat = props.getTransform("toWorld", Matrix4f::identity());
+  transformSwapsHandedness = mat.swapsHandedness();
 
-  if (!normals.empty()) {
-    n.reset(new Vector3f[nVertices]);
-    for (auto i = 0u; i < nVertices; ++i)
-      n[i] = normals[vertices[i].n - 1];
+  name = props.getString("filename");
+  properties = props;
+  auto path = getFileResolver()->resolve(name);
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(path.str());
+  } catch (const std::exception&) {
+    throw Exception("Unable to open OBJ file \"%s\"!", name);
   }
 
-  if (!uvs.empty()) {
-    uv.reset(new Vector2f[nVertices]);
-    for (auto i = 0u; i < nVertices; ++i)
-      uv[i] = uvs[vertices[i].uv - 1];
+  std::cout << "Loading \"" << name << "\" .. ";
+  Timer timer;
+
+  try {
+    load(file->data(), file->size(), mat);
+  } catch (const std::exception& e) {
+    throw Exception("Unable to load OBJ file \"%s\": %s!", name, e.what());
   }
 
+  auto seconds = std::max(timer.elapsed(), 1.0) / 1000;
   std::cout
     << "done. (V=" << nVertices << ", F=" << nTriangles << ", took "
-    << timer.elapsedString() << " and "
+    << timer.elapsedString() << " at " << tfm::format("%.1f MB/s", file->size() / seconds / (1 << 20)) << " and "
     << memString(
       nTriangles * 3 * sizeof(uint32_t) +
       nVertices * sizeof(Vector3f) +
@@ -143,4 +239,129 @@ WavefrontOBJ::WavefrontOBJ(const PropertyList& props) {
     << ")" << std::endl;
 }
 
+void WavefrontOBJ::load(const char* data, std::size_t size, const Matrix4f& mat) {
+  // chunks end at line boundaries and are parsed in parallel
+  std::vector<const char*> chunkBounds(1, data);
+  for (auto end = data + size; chunkBounds.back() < end;) {
+    auto next = chunkBounds.back() + std::min<std::size_t>(ChunkSize, end - chunkBounds.back());
+    if (next < end) {
+      auto newline = (const char*)std::memchr(next, '\n', end - next);
+      next = newline ? newline + 1 : end;
+    }
+    chunkBounds.push_back(next);
+  }
+  std::vector<OBJChunk> chunks(chunkBounds.size() - 1);
+  tbb::parallel_for(std::size_t(0), chunks.size(), [&](std::size_t i) {
+    parseChunk(chunkBounds[i], chunkBounds[i + 1], chunks[i]);
+  });
+
+  auto positions = concatenate(chunks, &OBJChunk::positions);
+  auto normals = concatenate(chunks, &OBJChunk::normals);
+  auto uvs = concatenate(chunks, &OBJChunk::uvs);
+  auto vertices = concatenate(chunks, &OBJChunk::vertices);
+  if (vertices.size() >= Vertex::Missing)
+    throw Exception("Too many face vertices");
+  auto nOccurrences = (std::uint32_t)vertices.size();
+
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, positions.size()), [&](auto& range) {
+    for (auto i = range.begin(); i < range.end(); ++i)
+      positions[i] = mat.applyP(positions[i]);
+  });
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, normals.size()), [&](auto& range) {
+    for (auto i = range.begin(); i < range.end(); ++i)
+      normals[i] = normalize(mat.applyN(normals[i]));
+  });
+  bounds = tbb::parallel_reduce(
+    tbb::blocked_range<std::size_t>(0, positions.size()), Bounds3f(),
+    [&](auto& range, Bounds3f b) {
+      for (auto i = range.begin(); i < range.end(); ++i)
+        b.merge(positions[i]);
+      return b;
+    },
+    [](const Bounds3f& a, const Bounds3f& b) {
+      return merge(a, b);
+    }
+  );
+
+  // deduplicate the face vertices in an open addressing table holding the
+  // first occurrence of every vertex, vertices are numbered in the order of
+  // their first occurrence, so the mesh does not depend on the thread count
+  std::size_t tableSize = 1;
+  while (tableSize < nOccurrences + nOccurrences / 2 + 1) tableSize *= 2;
+  auto mask = tableSize - 1;
+  constexpr auto Empty = Vertex::Missing;
+  std::unique_ptr<std::atomic<std::uint32_t>[]> table(new std::atomic<std::uint32_t>[tableSize]);
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, tableSize), [&](auto& range) {
+    for (auto i = range.begin(); i < range.end(); ++i)
+      table[i].store(Empty, std::memory_order_relaxed);
+  });
+
+  auto hash = [](const Vertex& v) {
+    return mixBits(((std::uint64_t)v.p << 32 | v.uv) ^ ((std::uint64_t)v.n << 17));
+  };
+  auto find = [&](const Vertex& v) -> std::atomic<std::uint32_t>& {
+    for (auto slot = hash(v) & mask; ; slot = (slot + 1) & mask) {
+      auto first = table[slot].load();
+      if (first == Empty || vertices[first] == v)
+        return table[slot];
+    }
+  };
+
+  tbb::parallel_for(tbb::blocked_range<std::uint32_t>(0, nOccurrences), [&](auto& range) {
+    for (auto i = range.begin(); i < range.end(); ++i) {
+      auto& v = vertices[i];
+      for (auto slot = hash(v) & mask; ; slot = (slot + 1) & mask) {
+        auto first = table[slot].load();
+        // a failed exchange leaves the vertex another thread put here in first
+        if (first == Empty && table[slot].compare_exchange_strong(first, i))
+          break;
+        if (vertices[first] == v) {
+          while (i < first && !table[slot].compare_exchange_weak(first, i)) { }
+          break;
+        }
+      }
+    }
+  });
+
+  // number the first occurrences with a prefix sum over blocks
+  constexpr std::uint32_t BlockSize = 1 << 16;
+  std::vector<std::uint32_t> firsts(nOccurrences);
+  std::vector<std::uint32_t> blockCounts((nOccurrences + BlockSize - 1) / BlockSize + 1, 0);
+  tbb::parallel_for(std::size_t(0), blockCounts.size() - 1, [&](std::size_t block) {
+    auto end = (std::uint32_t)std::min<std::size_t>(nOccurrences, (block + 1) * BlockSize);
+    for (auto i = (std::uint32_t)(block * BlockSize); i < end; ++i) {
+      firsts[i] = find(vertices[i]).load();
+      if (firsts[i] == i) ++blockCounts[block + 1];
+    }
+  });
+  for (std::size_t block = 1; block < blockCounts.size(); ++block)
+    blockCounts[block] += blockCounts[block - 1];
+  table.reset();
+
+  nVertices = blockCounts.back();
+  nTriangles = nOccurrences / 3;
+  f.reset(new std::uint32_t[nOccurrences]);
+  p.reset(new Vector3f[nVertices]);
+  if (!normals.empty()) n.reset(new Vector3f[nVertices]);
+  if (!uvs.empty()) uv.reset(new Vector2f[nVertices]);
+
+  // f first holds the number of every first occurrence, then of every occurrence
+  tbb::parallel_for(std::size_t(0), blockCounts.size() - 1, [&](std::size_t block) {
+    auto index = blockCounts[block];
+    auto end = (std::uint32_t)std::min<std::size_t>(nOccurrences, (block + 1) * BlockSize);
+    for (auto i = (std::uint32_t)(block * BlockSize); i < end; ++i) {
+      if (firsts[i] != i) continue;
+      auto& v = vertices[i];
+      p[index] = lookup(positions, v.p, "position");
+      if (n) n[index] = lookup(normals, v.n, "normal");
+      if (uv) uv[index] = lookup(uvs, v.uv, "texture coordinate");
+      f[i] = index++;
+    }
+  });
+  tbb::parallel_for(tbb::blocked_range<std::uint32_t>(0, nOccurrences), [&](auto& range) {
+    for (auto i = range.begin(); i < range.end(); ++i)
+      if (firsts[i] != i) f[i] = f[firsts[i]];
+  });
+}
+
 }
@@ -1,148 +1,176 @@
-#include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
 #include <minpt/core/timer.h>
+#include <minpt/utils/mappedfile.h>
 #include <minpt/meshes/ply.h>
 
 namespace minpt {
 
-class Property {
-public:
-  explicit Property(const std::string& name) noexcept : name(name)
-  { }
-
-  virtual ~Property() = default;
-
-  virtual void parse(std::istringstream& line) = 0;
-
-  virtual void read(std::ifstream& stream) = 0;
-
-public:
-  std::string name;
+enum class PLYType {
+  Int8,
+  UInt8,
+  Int16,
+  UInt16,
+  Int32,
+  UInt32,
+  Float32,
+  Float64
 };
 
-template <typename T>
-class TypedProperty : public Property {
-public:
-  explicit TypedProperty(const std::string& name) noexcept : Property(name)
-  { }
-
-  void parse(std::istringstream& line) override {
-    T val;
-    line >> val;
-    data.push_back(val);
-  }
-
-  void read(std::ifstream& stream) override {
-    T val;
-    stream.read((char*)&val, sizeof(T));
-    data.push_back(val);
-  }
+static PLYType parseType(const std::string& type) {
+  if (type == "char" || type == "int8") return PLYType::Int8;
+  if (type == "uchar" || type == "uint8") return PLYType::UInt8;
+  if (type == "short" || type == "int16") return PLYType::Int16;
+  if (type == "ushort" || type == "uint16") return PLYType::UInt16;
+  if (type == "int" || type == "int32") return PLYType::Int32;
+  if (type == "uint" || type == "uint32") return PLYType::UInt32;
+  if (type == "float" || type == "float32") return PLYType::Float32;
+  if (type == "double" || type == "float64") return PLYType::Float64;
+  throw Exception("PLY loader: unrecognized data type: %s!", type);
+}
 
-public:
-  std::vector<T> data;
-};
+static std::size_t typeSize(PLYType type) {
+  static const std::size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+  return sizes[(int)type];
+}
 
 template <typename T>
-class TypedListProperty : public Property {
-public:
-  TypedListProperty(const std::string& name) noexcept : Property(name)
-  { }
+static T load(const char* ptr, bool swap) {
+  char bytes[sizeof(T)];
+  if (swap) std::reverse_copy(ptr, ptr + sizeof(T), bytes);
+  else std::memcpy(bytes, ptr, sizeof(T));
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
 
-  void parse(std::istringstream& line) override {
-    int n;
-    line >> n;
-    std::vector<T> vec;
-    vec.reserve(n);
-    for (auto i = 0; i < n; ++i) {
-      T val;
-      line >> val;
-      vec.push_back(val);
-    }
-    data.push_back(std::move(vec));
+/// Reads one value of the given type and converts it to T
+template <typename T>
+static T decode(const char* ptr, PLYType type, bool swap) {
+  switch (type) {
+    case PLYType::Int8: return (T)load<std::int8_t>(ptr, swap);
+    case PLYType::UInt8: return (T)load<std::uint8_t>(ptr, swap);
+    case PLYType::Int16: return (T)load<std::int16_t>(ptr, swap);
+    case PLYType::UInt16: return (T)load<std::uint16_t>(ptr, swap);
+    case PLYType::Int32: return (T)load<std::int32_t>(ptr, swap);
+    case PLYType::UInt32: return (T)load<std::uint32_t>(ptr, swap);
+    case PLYType::Float32: return (T)load<float>(ptr, swap);
+    default: return (T)load<double>(ptr, swap);
   }
+}
 
-  void read(std::ifstream& stream) override {
-    std::uint8_t n = 0;
-    stream.read((char*)&n, 1);
-    auto count = (int)n;
-    std::vector<T> vec;
-    vec.reserve(count);
-    for (auto i = 0; i < count; ++i) {
-      T val;
-      stream.read((char*)&val, sizeof(T));
-      vec.push_back(val);
-    }
-    data.push_back(std::move(vec));
+/// Writes value as the given type, in the byte order of the host
+static void encode(std::vector<char>& buffer, PLYType type, double value) {
+  auto store = [&](auto v) {
+    char bytes[sizeof(v)];
+    std::memcpy(bytes, &v, sizeof(v));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(v));
+  };
+  switch (type) {
+    case PLYType::Int8: store((std::int8_t)value); break;
+    case PLYType::UInt8: store((std::uint8_t)value); break;
+    case PLYType::Int16: store((std::int16_t)value); break;
+    case PLYType::UInt16: store((std::uint16_t)value); break;
+    case PLYType::Int32: store((std::int32_t)value); break;
+    case PLYType::UInt32: store((std::uint32_t)value); break;
+    case PLYType::Float32: store((float)value); break;
+    default: store(value); break;
   }
+}
 
-public:
-  std::vector<std::vector<T>> data;
+struct PLYProperty {
+  std::string name;
+  PLYType type;
+  bool isList = false;
+  PLYType countType = PLYType::UInt8;
+  // offset inside a record, for the properties before the first list
+  std::size_t offset = 0;
 };
 
-Property* createProperty(bool isList, const std::string& name, const std::string& type) {
-  if ((type == "float" || type == "float32") && !isList)
-    return new TypedProperty<float>(name);
-  if (type == "int" || type == "int32")
-    return isList ? (Property*)new TypedListProperty<int>(name) : new TypedProperty<int>(name);
-  throw Exception("PLY loader: unrecognized data type: %s!", type);
-}
-
-class Element {
-public:
-  Element(const std::string& name, int count) noexcept : count(count), name(name)
+struct PLYElement {
+  PLYElement(const std::string& name, std::size_t count) noexcept : name(name), count(count)
   { }
 
-  bool hasProperty(const std::string& name) const {
-    for (auto& p : properties)
-      if (p->name == name) return true;
-    return false;
-  }
-
-  void addProperty(Property* property) {
-    if (hasProperty(property->name))
-      throw Exception("PLY loader: property with name: \"%s\" already exist!", name);
-    properties.emplace_back(property);
-  }
-
-  const Property* getProperty(const std::string& name) const {
+  const PLYProperty* getProperty(const std::string& name) const {
     for (auto& p : properties)
-      if (p->name == name) return p.get();
+      if (p.name == name) return &p;
     return nullptr;
   }
 
-public:
-  int count;
   std::string name;
-  std::vector<std::unique_ptr<Property>> properties;
+  std::size_t count;
+  std::vector<PLYProperty> properties;
+  // size of a record, zero if it has lists and records differ in size
+  std::size_t stride = 0;
+  // first record in the body
+  const char* data = nullptr;
 };
 
 enum class DataFormat {
   Text,
-  Binary
+  BinaryLittleEndian,
+  BinaryBigEndian
 };
 
+/**
+ * Layout of a PLY file. Binary bodies are read straight from the mapped
+ * file, text bodies are converted to a binary body in host byte order once
+ * so that both are decoded the same way.
+ */
 class PLYData {
 public:
-  explicit PLYData(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (file.fail())
-      throw Exception("Unable to load ply file: \"%s\"!", filename);
-    parseHeader(file);
-    if (inputFormat == DataFormat::Text) parseTextBody(file);
-    else parseBinaryBody(file);
+  explicit PLYData(const std::string& filename) : file(filename) {
+    auto begin = file.data(), end = begin + file.size();
+    auto body = parseHeader(begin, end);
+    if (inputFormat == DataFormat::Text) {
+      convertTextBody(body, end);
+      body = converted.data();
+      end = body + converted.size();
+      swap = false;
+    } else
+      swap = (inputFormat == DataFormat::BinaryBigEndian) != (std::endian::native == std::endian::big);
+    layoutBody(body, end);
+  }
+
+  const PLYElement* getElement(const std::string& name) const {
+    for (auto& e : elements)
+      if (e.name == name) return &e;
+    return nullptr;
+  }
+
+  std::size_t size() const {
+    return file.size();
   }
 
-  void parseHeader(std::ifstream& stream) {
+private:
+  const char* parseHeader(const char* begin, const char* end) {
+    static const char EndHeader[] = "end_header";
+    auto headerEnd = std::search(begin, end, EndHeader, EndHeader + sizeof(EndHeader) - 1);
+    if (headerEnd == end || end - begin < 3 || std::memcmp(begin, "ply", 3))
+      throw Exception("PLY loader: not a PLY file!");
+    auto body = std::find(headerEnd, end, '\n');
+    body = body == end ? end : body + 1;
+
+    std::istringstream header(std::string(begin, headerEnd));
     std::string line;
-    while (std::getline(stream, line)) {
+    while (std::getline(header, line)) {
       std::string token;
       std::istringstream lineStream(line);
       lineStream >> token;
       if (token == "format") parseFormatHeader(lineStream);
       else if (token == "element") parseElementHeader(lineStream);
       else if (token == "property") parsePropertyHeader(lineStream);
-      else if (token == "end_header") break;
     }
+    return body;
   }
 
   void parseFormatHeader(std::istringstream& line) {
@@ -150,132 +178,271 @@ public:
     line >> type >> version;
     if (version != "1.0") throw Exception("PLY loader: only version 1.0 is supported!");
     if (type == "ascii") inputFormat = DataFormat::Text;
-    else if (type == "binary_little_endian") inputFormat = DataFormat::Binary;
-    else if (type == "binary_big_endian") throw Exception("PLY loader: big endian binary format not supported!");
+    else if (type == "binary_little_endian") inputFormat = DataFormat::BinaryLittleEndian;
+    else if (type == "binary_big_endian") inputFormat = DataFormat::BinaryBigEndian;
     else throw Exception("PLY loader: unknown file format!");
   }
 
   void parseElementHeader(std::istringstream& line) {
-    int count;
+    std::size_t count = 0;
     std::string name;
     line >> name >> count;
-    if (hasElement(name))
+    if (getElement(name))
       throw Exception("PLY loader: element \"%s\" already exist!", name);
     elements.emplace_back(name, count);
   }
 
   void parsePropertyHeader(std::istringstream& line) {
+    if (elements.empty())
+      throw Exception("PLY loader: property outside of an element!");
+    auto& element = elements.back();
+    PLYProperty property;
     std::string token;
     line >> token;
     if (token == "list") {
-      std::string countType, type, name;
-      line >> countType >> type >> name;
-      elements.back().addProperty(createProperty(true, name, type));
+      std::string countType, type;
+      line >> countType >> type >> property.name;
+      property.isList = true;
+      property.countType = parseType(countType);
+      property.type = parseType(type);
     } else {
-      std::string name;
-      auto& type = token;
-      line >> name;
-      elements.back().addProperty(createProperty(false, name, type));
+      line >> property.name;
+      property.type = parseType(token);
     }
+    if (element.getProperty(property.name))
+      throw Exception("PLY loader: property with name: \"%s\" already exist!", property.name);
+    element.properties.push_back(property);
   }
 
-  void parseBinaryBody(std::ifstream& stream) {
-    for (auto& e : elements)
-      for (auto i = 0; i < e.count; ++i)
-        for (auto& p : e.properties)
-          p->read(stream);
+  /// Finds the records of all elements, the offsets of their properties and their strides
+  void layoutBody(const char* body, const char* end) {
+    bodyEnd = end;
+    for (auto& e : elements) {
+      auto offset = std::size_t(0);
+      auto fixed = true;
+      for (auto& p : e.properties) {
+        p.offset = offset;
+        if (p.isList) fixed = false;
+        if (fixed) offset += typeSize(p.type);
+      }
+      e.data = body;
+      e.stride = fixed ? offset : 0;
+
+      if (fixed)
+        body += e.count * e.stride;
+      else
+        for (std::size_t i = 0; i < e.count && body <= end; ++i)
+          body = skipRecord(e, body, end);
+      if (body > end)
+        throw Exception("PLY loader: file ends inside element \"%s\"!", e.name);
+    }
   }
 
-  void parseTextBody(std::ifstream& stream) {
-    for (auto& e : elements)
-      for (auto i = 0; i < e.count; ++i) {
-        std::string line;
-        std::getline(stream, line);
-        std::istringstream lineStream(line);
-        for (auto& p : e.properties)
-          p->parse(lineStream);
+  const char* skipRecord(const PLYElement& e, const char* record, const char* end) const {
+    for (auto& p : e.properties) {
+      if (!p.isList) {
+        record += typeSize(p.type);
+        continue;
       }
+      if (record + typeSize(p.countType) > end) return end + 1;
+      auto count = decode<std::int64_t>(record, p.countType, swap);
+      if (count < 0)
+        throw Exception("PLY loader: negative list length in element \"%s\"!", e.name);
+      record += typeSize(p.countType) + count * typeSize(p.type);
+    }
+    return record;
   }
 
-  bool hasElement(const std::string& name) const {
-    for (auto& e : elements)
-      if (e.name == name) return true;
-    return false;
-  }
+  void convertTextBody(const char* s, const char* end) {
+    auto next = [&]() {
+      while (s < end && std::isspace((unsigned char)*s)) ++s;
+      double value;
+      auto [ptr, ec] = std::from_chars(s, end, value);
+      if (ec != std::errc())
+        throw Exception("PLY loader: expected a number, got \"%s\"!", std::string(s, std::min(end, s + 16)));
+      s = ptr;
+      return value;
+    };
 
-  const Element* getElement(const std::string& name) const {
     for (auto& e : elements)
-      if (e.name == name) return &e;
-    return nullptr;
+      for (std::size_t i = 0; i < e.count; ++i)
+        for (auto& p : e.properties) {
+          if (!p.isList) {
+            encode(converted, p.type, next());
+            continue;
+          }
+          auto count = next();
+          encode(converted, p.countType, count);
+          for (auto j = 0; j < (int)count; ++j)
+            encode(converted, p.type, next());
+        }
   }
 
 public:
   DataFormat inputFormat = DataFormat::Text;
-  std::vector<Element> elements;
+  // whether the byte order of the body differs from the host
+  bool swap = false;
+  std::vector<PLYElement> elements;
+  const char* bodyEnd = nullptr;
+
+private:
+  MappedFile file;
+  std::vector<char> converted;
 };
 
+static const PLYProperty* getScalar(const PLYElement& element, const std::string& name) {
+  auto property = element.getProperty(name);
+  if (property && property->isList)
+    throw Exception("PLY loader: vertex property \"%s\" is a list!", name);
+  return property;
+}
+
 PLY::PLY(const PropertyList& props) {
   reverseOrientation = props.getBoolean("reverseOrientation", false);
+  compact = props.getBoolean("compact", false);
   auto mat = props.getTransform("toWorld", Matrix4f::identity());
   transformSwapsHandedness = mat.swapsHandedness();
 
   name = props.getString("filename");
+  properties = props;
   std::cout << "Loading \"" << name << "\" .. ";
   Timer timer;
 
   PLYData ply(getFileResolver()->resolve(name).str());
+  auto swap = ply.swap;
 
   auto vertex = ply.getElement("vertex");
-  auto px = (TypedProperty<float>*)vertex->getProperty("x");
-  auto py = (TypedProperty<float>*)vertex->getProperty("y");
-  auto pz = (TypedProperty<float>*)vertex->getProperty("z");
+  if (!vertex)
+    throw Exception("PLY loader: no vertex element!");
+  if (!vertex->stride)
+    throw Exception("PLY loader: list properties of vertices are not supported!");
+  if (vertex->count > std::numeric_limits<std::uint32_t>::max())
+    throw Exception("PLY loader: too many vertices!");
+  auto px = getScalar(*vertex, "x"), py = getScalar(*vertex, "y"), pz = getScalar(*vertex, "z");
+  if (!px || !py || !pz)
+    throw Exception("PLY loader: vertices without positions!");
+  auto nx = getScalar(*vertex, "nx"), ny = getScalar(*vertex, "ny"), nz = getScalar(*vertex, "nz");
+  if (!nx || !ny || !nz) nx = ny = nz = nullptr;
+  const PLYProperty *pu = nullptr, *pv = nullptr;
+  for (auto names : { std::make_pair("u", "v"), std::make_pair("s", "t"), std::make_pair("texture_u", "texture_v") })
+    if (!pu || !pv) {
+      pu = getScalar(*vertex, names.first);
+      pv = getScalar(*vertex, names.second);
+    }
 
-  nVertices = vertex->count;
+  nVertices = (std::uint32_t)vertex->count;
   p.reset(new Vector3f[nVertices]);
-  for (auto i = 0u; i < nVertices; ++i) {
-    p[i] = mat.applyP(Vector3f(px->data[i], py->data[i], pz->data[i]));
-    bounds.merge(p[i]);
-  }
-
-  if (vertex->getProperty("nx")) {
-    auto nx = (TypedProperty<float>*)vertex->getProperty("nx");
-    auto ny = (TypedProperty<float>*)vertex->getProperty("ny");
-    auto nz = (TypedProperty<float>*)vertex->getProperty("nz");
-    n.reset(new Vector3f[nVertices]);
-    for (auto i = 0u; i < nVertices; ++i)
-      n[i] = normalize(mat.applyN(Vector3f(nx->data[i], ny->data[i], nz->data[i])));
-  }
-
-  if (vertex->getProperty("u")) {
-    auto u = (TypedProperty<float>*)vertex->getProperty("u");
-    auto v = (TypedProperty<float>*)vertex->getProperty("v");
-    uv.reset(new Vector2f[nVertices]);
-    for (auto i = 0u; i < nVertices; ++i)
-      uv[i] = Vector2f(u->data[i], v->data[i]);
+  if (nx) n.reset(new Vector3f[nVertices]);
+  if (pu && pv) uv.reset(new Vector2f[nVertices]);
+
+  // vertices have a fixed stride, they are decoded straight from the file in parallel
+  auto read = [&](const char* record, const PLYProperty* property) {
+    return decode<float>(record + property->offset, property->type, swap);
+  };
+  bounds = tbb::parallel_reduce(
+    tbb::blocked_range<std::uint32_t>(0, nVertices), Bounds3f(),
+    [&](auto& range, Bounds3f b) {
+      for (auto i = range.begin(); i < range.end(); ++i) {
+        auto record = vertex->data + (std::size_t)i * vertex->stride;
+        p[i] = mat.applyP(Vector3f(read(record, px), read(record, py), read(record, pz)));
+        b.merge(p[i]);
+        if (n) n[i] = normalize(mat.applyN(Vector3f(read(record, nx), read(record, ny), read(record, nz))));
+        if (uv) uv[i] = Vector2f(read(record, pu), read(record, pv));
+      }
+      return b;
+    },
+    [](const Bounds3f& a, const Bounds3f& b) {
+      return merge(a, b);
+    }
+  );
+
+  auto face = ply.getElement("face");
+  auto indices = face ? face->getProperty("vertex_indices") : nullptr;
+  if (face && !indices) indices = face->getProperty("vertex_index");
+  if (!indices || !indices->isList)
+    throw Exception("PLY loader: no face vertex indices!");
+
+  auto readIndex = [&](const char* ptr) {
+    auto index = decode<std::int64_t>(ptr, indices->type, swap);
+    if (index < 0 || index >= nVertices)
+      throw Exception("PLY loader: invalid vertex index %i!", index);
+    return (std::uint32_t)index;
+  };
+
+  // a record of a triangle with the index list at a fixed offset
+  auto countSize = typeSize(indices->countType), indexSize = typeSize(indices->type);
+  auto triangleStride = std::size_t(0);
+  auto fixedTriangles = true;
+  for (auto& property : face->properties) {
+    if (&property != indices && property.isList) fixedTriangles = false;
+    triangleStride += &property == indices ? countSize + 3 * indexSize : typeSize(property.type);
   }
-
-  auto faces = (TypedListProperty<int>*)ply.getElement("face")->getProperty("vertex_indices");
-  std::vector<int> indices;
-  indices.reserve(faces->data.size() * 6);
-  for (auto& face : faces->data) {
-    if (face.size() != 3 && face.size() != 4) continue;
-    indices.emplace_back(face[0]);
-    indices.emplace_back(face[1]);
-    indices.emplace_back(face[2]);
-    if (face.size() == 4) {
-      indices.emplace_back(face[3]);
-      indices.emplace_back(face[0]);
-      indices.emplace_back(face[2]);
+  auto triangleRecord = [&](std::size_t i) {
+    return face->data + i * triangleStride;
+  };
+  // the fixed layout holds if every face is a triangle, by induction over the records
+  fixedTriangles = fixedTriangles && (std::size_t)(ply.bodyEnd - face->data) >= face->count * triangleStride && tbb::parallel_reduce(
+    tbb::blocked_range<std::size_t>(0, face->count), true,
+    [&](auto& range, bool all) {
+      for (auto i = range.begin(); i < range.end() && all; ++i)
+        all = decode<std::int64_t>(triangleRecord(i) + indices->offset, indices->countType, swap) == 3;
+      return all;
+    },
+    [](bool a, bool b) {
+      return a && b;
     }
+  );
+
+  if (fixedTriangles) {
+    if (face->count > std::numeric_limits<std::uint32_t>::max())
+      throw Exception("PLY loader: too many faces!");
+    nTriangles = (std::uint32_t)face->count;
+    f.reset(new std::uint32_t[3 * (std::size_t)nTriangles]);
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, face->count), [&](auto& range) {
+      for (auto i = range.begin(); i < range.end(); ++i) {
+        auto list = triangleRecord(i) + indices->offset + countSize;
+        for (auto k = 0; k < 3; ++k)
+          f[3 * i + k] = readIndex(list + k * indexSize);
+      }
+    });
+  } else {
+    // mixed polygons, quads are split like before, larger polygons as fans
+    std::vector<std::uint32_t> triangles;
+    triangles.reserve(face->count * 3);
+    std::vector<std::uint32_t> polygon;
+    auto record = face->data;
+    for (std::size_t i = 0; i < face->count; ++i)
+      for (auto& property : face->properties) {
+        if (!property.isList) {
+          record += typeSize(property.type);
+          continue;
+        }
+        auto count = decode<std::int64_t>(record, property.countType, swap);
+        record += typeSize(property.countType);
+        if (&property == indices) {
+          polygon.clear();
+          for (auto k = 0; k < count; ++k)
+            polygon.push_back(readIndex(record + k * indexSize));
+          if (polygon.size() == 4) {
+            for (auto k : { 0, 1, 2, 3, 0, 2 })
+              triangles.push_back(polygon[k]);
+          } else
+            for (std::size_t k = 1; k + 1 < polygon.size(); ++k)
+              triangles.insert(triangles.end(), { polygon[0], polygon[k], polygon[k + 1] });
+        }
+        record += count * typeSize(property.type);
+      }
+    if (triangles.size() / 3 > std::numeric_limits<std::uint32_t>::max())
+      throw Exception("PLY loader: too many faces!");
+    nTriangles = (std::uint32_t)(triangles.size() / 3);
+    f.reset(new std::uint32_t[triangles.size()]);
+    std::copy(triangles.begin(), triangles.end(), f.get());
   }
 
-  nTriangles = indices.size() / 3;
-  f.reset(new std::uint32_t[indices.size()]);
-  memcpy(f.get(), indices.data(), sizeof(std::uint32_t) * indices.size());
-
+  auto seconds = std::max(timer.elapsed(), 1.0) / 1000;
   std::cout
     << "done. (V=" << nVertices << ", F=" << nTriangles << ", took "
-    << timer.elapsedString() << " and "
+    << timer.elapsedString() << " at " << tfm::format("%.1f MB/s", ply.size() / seconds / (1 << 20)) << " and "
     << memString(
       nTriangles * 3 * sizeof(uint32_t) +
       nVertices * sizeof(Vector3f) +
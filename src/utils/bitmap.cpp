@@ -149,6 +149,8 @@ void Bitmap::writeImageEXR(const std::string& filename) const {
   channels.insert("R", Imf::Channel(Imf::FLOAT));
   channels.insert("G", Imf::Channel(Imf::FLOAT));
   channels.insert("B", Imf::Channel(Imf::FLOAT));
+  for (auto& name : channelNames)
+    channels.insert(name, Imf::Channel(Imf::FLOAT));
 
   Imf::FrameBuffer frameBuffer;
   size_t compStride = sizeof(float);
@@ -158,6 +160,10 @@ void Bitmap::writeImageEXR(const std::string& filename) const {
   frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, bytes, pixelStride, rowStride)); bytes += compStride;
   frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, bytes, pixelStride, rowStride)); bytes += compStride;
   frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, bytes, pixelStride, rowStride));
+  for (std::size_t i = 0; i < channelNames.size(); ++i) {
+    bytes = const_cast<char*>(reinterpret_cast<const char*>(this->channels[i].data()));
+    frameBuffer.insert(channelNames[i], Imf::Slice(Imf::FLOAT, bytes, compStride, compStride * cols()));
+  }
 
   Imf::OutputFile file(filename.c_str(), header);
   file.setFrameBuffer(frameBuffer);
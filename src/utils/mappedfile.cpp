@@ -0,0 +1,75 @@
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+#include <minpt/core/exception.h>
+#include <minpt/utils/mappedfile.h>
+
+namespace minpt {
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& filename) {
+  file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw Exception("Unable to open \"%s\"!", filename);
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file, &fileSize);
+  length = (std::size_t)fileSize.QuadPart;
+  // empty files can not be mapped
+  if (!length) return;
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
+    bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!bytes) {
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    throw Exception("Unable to map \"%s\" into memory!", filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) UnmapViewOfFile(bytes);
+  if (mapping) CloseHandle(mapping);
+  CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+  auto fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw Exception("Unable to open \"%s\"!", filename);
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    throw Exception("Unable to read the size of \"%s\"!", filename);
+  }
+  length = (std::size_t)info.st_size;
+  // empty files can not be mapped
+  if (!length) {
+    close(fd);
+    return;
+  }
+  auto address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid without the descriptor
+  close(fd);
+  if (address == MAP_FAILED)
+    throw Exception("Unable to map \"%s\" into memory!", filename);
+  madvise(address, length, MADV_SEQUENTIAL);
+  bytes = (const char*)address;
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) munmap((void*)bytes, length);
+}
+
+#endif
+
+}